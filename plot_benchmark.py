@@ -39,7 +39,7 @@ except pd.errors.ParserError:
     sys.exit(1)
 
 def prepare_data_1(mode_filter, b_name_filter):
-    r = r'BM_SingleEngineBlocking_(.*)_([0-9]*)kB_name_(.*)_entropy_(.*)_mode_(.)_(qpl.*)_mean'
+    r = r'BM_SingleEngineBlocking_(.*)_([0-9]*)kB_name_(.*)_entropy_(.*)_mode_(.)_(qpl_path_[a-z]*)_mean'
     compress_data = {}
     decompress_data = {}
     compress_data['Software'] = {}
@@ -304,7 +304,7 @@ def prepare_and_plot_exp_2(plot_name, b_name_filter):
         print(f"Plot saved in {plot_name_}")
 
 def prepare_and_plot_exp_3(plot_name, b_name_filter, mode_filter):
-    r = r'BM_MultipleEngine_(.*)_([0-9]*)kB_name_(.*)_entropy_(.*)_jobs_(.*)_mode_(.*)_mean'
+    r = r'BM_MultipleEngine_(.*)_([0-9]*)kB_name_(.*)_entropy_(.*)_jobs_(.*)_mode_([0-9]*)_mean'
     data = {}
     modes = []
     mode_names = ['Fixed Block', 'Dynamic Block', 'Static Block']
@@ -390,7 +390,7 @@ def prepare_and_plot_exp_4(plot_name, b_name_filter):
     r = r'BM_SingleEngineMinorPageFault_(.*)_([0-9]*)kB_name_(.*)_entropy_(.*)_pfscenario_(.*)_mean'
     data = {}
     modes = []
-    pfscenarios = {0: 'Major \npf', 1: 'Minor \npf', 2: 'ATS \nmiss', 3: 'No \nfaults'}
+    pfscenarios = {0: 'Major \npf', 1: 'Minor \npf', 2: 'ATS \nmiss', 3: 'No \nfaults', 4: 'Touch + \nresubmit', 5: 'Prefault \nall'}
     for index, row in df.iterrows():
         re_name = re.match(r, row['name'])
         if re_name == None:
@@ -437,7 +437,7 @@ def prepare_and_plot_exp_4(plot_name, b_name_filter):
         bars = []
         for (op, op_v), axx, c, idx, l in zip(b_data.items(), [ax, ax_1], ['gray', 'darkred'], range(len(b_data.items())), ['Compression', 'Decompression']):
             width = 0.23
-            x_positions = [t + width * idx for t in range(len(pfscenarios.values()))]
+            x_positions = [t + width * idx for t in range(len(op_v))]
             b = axx.bar(x_positions, op_v, width, align='center', color=c, label=l)
             bars.append(b)
 
@@ -448,8 +448,10 @@ def prepare_and_plot_exp_4(plot_name, b_name_filter):
                     axis.text(bar.get_x() + bar.get_width() / 2., 0.3002 * height, f'{height:.3f}', ha='center', va='bottom', fontsize=text_size_big, rotation=90)
             add_value_labels(b, axx)
 
-        ax.set_xticks([t for t in range(len(pfscenarios.values()))])
-        ax.set_xticklabels(pfscenarios.values(), fontsize=text_size_ultrabig+2, rotation=0)
+        # Results may predate the last scenarios.
+        scenario_count = len(list(b_data.values())[0])
+        ax.set_xticks([t for t in range(scenario_count)])
+        ax.set_xticklabels(list(pfscenarios.values())[:scenario_count], fontsize=text_size_ultrabig+2, rotation=0)
         ax.yaxis.set_tick_params(labelsize=text_size_big, rotation=0)
         ax_1.yaxis.set_tick_params(labelsize=text_size_big, rotation=0)
         ax.set_title(f'{b_name}', fontsize=text_size_ultrabig)
@@ -525,6 +527,246 @@ def prepare_and_plot_exp_5(plot_name):
         plt.savefig(f'{plot_name_}', format=r, bbox_inches="tight")
         print(f"Plot saved in {plot_name_}")
 
+def prepare_and_plot_exp_6(plot_name, b_name_filter):
+    r = r'BM_PageFaultDensity_(.*)_([0-9]*)kB_name_(.*)_entropy_(.*)_engine_(.*)_pattern_(.*)_faults_([0-9]*)_mean'
+    data = {}
+    engines = {0: 'CPU', 1: 'Single engine', 2: 'Multiple engines'}
+    patterns = {0: 'stride', 1: 'random'}
+    for index, row in df.iterrows():
+        re_name = re.match(r, row['name'])
+        if re_name == None:
+            continue
+
+        op = re_name.group(1)
+        b_name = re_name.group(3)
+        b_name = b_name.replace('dataset/silesia_tmp/', '')
+        b_name = b_name.replace('dataset/snapshots_tmp/', '')
+        if not b_name_filter == None and not b_name in b_name_filter:
+            continue
+
+        engine = (int)(re_name.group(5))
+        pattern = (int)(re_name.group(6))
+        fault_percent = (int)(re_name.group(7))
+        if not engine in engines or not pattern in patterns:
+            exit(0)
+
+        time_ms = row['real_time'] / time_ns_to_ms
+        data.setdefault(b_name, {}).setdefault(op, {}).setdefault((engine, pattern), {})[fault_percent] = time_ms
+
+    #
+    if data == {}:
+        print("No data for exp_6 found")
+        return
+
+    for b_name, b_data in data.items():
+        fig, axs = plt.subplots(1, len(b_data), figsize=(8.5 * len(b_data), 5), squeeze=False)
+        for (op, op_v), ax in zip(sorted(b_data.items()), axs[0]):
+            for (engine, pattern), line in sorted(op_v.items()):
+                x = sorted(line.keys())
+                ax.plot(x, [line[t] for t in x], color=['darkred', 'gray', 'black'][engine], linestyle=['-', '--'][pattern], marker='o', linewidth=2, label=f'{engines[engine]}, {patterns[pattern]}')
+
+            # Lowest fault density at which the single engine loses to the CPU.
+            cpu = op_v.get((0, 0), {})
+            engine = op_v.get((1, 0), {})
+            crossover = [t for t in sorted(engine.keys()) if t in cpu and engine[t] > cpu[t]]
+            if crossover:
+                ax.axvline(crossover[0], color='darkred', linestyle=':', linewidth=1.5)
+
+            ax.set_title(f'{b_name}, {op}', fontsize=text_size_big)
+            ax.set_xlabel('Faulting pages, %', fontsize=text_size_big)
+            ax.set_ylabel('Latency, ms', fontsize=text_size_big)
+            ax.xaxis.set_tick_params(labelsize=text_size_medium)
+            ax.yaxis.set_tick_params(labelsize=text_size_medium)
+            ax.grid()
+            ax.legend(fontsize=text_size_small, loc='upper left')
+
+        for r in ['png', 'pdf']:
+            plot_name_ = f'out/{plot_name}_{b_name}.{r}'
+            fig.tight_layout(pad=2.0)
+            plt.savefig(f'{plot_name_}', format=r, bbox_inches="tight")
+            print(f"Plot saved in {plot_name_}")
+
+def prepare_and_plot_exp_7(plot_name, b_name_filter):
+    r = r'BM_SingleEngineBlocking_(Compress|DeCompress)_([0-9]*)kB_name_(.*)_entropy_(.*)_mode_1_(qpl_path_[a-z]*)(_cache_([0-9]))?_mean'
+    data = {}
+    paths = {'qpl_path_software': 'Software', 'qpl_path_hardware': 'Hardware'}
+    cache_states = {0: 'hot', 1: 'flushed', 2: 'rotating'}
+    for index, row in df.iterrows():
+        re_name = re.match(r, row['name'])
+        if re_name == None:
+            continue
+
+        op = re_name.group(1)
+        b_name = re_name.group(3)
+        b_name = b_name.replace('dataset/silesia_tmp/', '')
+        b_name = b_name.replace('dataset/snapshots_tmp/', '')
+        if not b_name_filter == None and not b_name in b_name_filter:
+            continue
+
+        path = paths[re_name.group(5)]
+        cache_state = (int)(re_name.group(7)) if re_name.group(7) else 0
+        # Bytes per ns are GB/s.
+        throughput_gbs = (int)(re_name.group(2)) * 1024 / row['real_time']
+        data.setdefault(op, {}).setdefault(path, {}).setdefault(b_name, {})[cache_state] = throughput_gbs
+
+    #
+    if data == {}:
+        print("No data for exp_7 found")
+        return
+
+    fig, axs = plt.subplots(1, len(data), figsize=(8.5 * len(data), 5), squeeze=False)
+    for (op, op_v), ax in zip(sorted(data.items()), axs[0]):
+        b_names = sorted({b for path_v in op_v.values() for b in path_v})
+        width = 0.8 / (len(op_v) * len(cache_states))
+        bar = 0
+        for path, path_v in sorted(op_v.items()):
+            for cache_state, label in cache_states.items():
+                x = np.arange(len(b_names)) + bar * width
+                y = [path_v.get(b, {}).get(cache_state, 0) for b in b_names]
+                ax.bar(x, y, width, color=['darkred', 'gray'][path == 'Software'], alpha=[1.0, 0.65, 0.35][cache_state], edgecolor='black', label=f'{path}, {label}')
+                bar += 1
+
+        ax.set_title(f'Dynamic DEFLATE, {op}', fontsize=text_size_big)
+        ax.set_xticks(np.arange(len(b_names)) + 0.4 - width / 2)
+        ax.set_xticklabels(b_names, rotation=45, fontsize=text_size_medium)
+        ax.set_ylabel('Throughput, GB/s', fontsize=text_size_big)
+        ax.yaxis.set_tick_params(labelsize=text_size_medium)
+        ax.grid(axis='y')
+        ax.legend(fontsize=text_size_small, loc='upper left')
+
+    for r in ['png', 'pdf']:
+        plot_name_ = f'out/{plot_name}.{r}'
+        fig.tight_layout(pad=2.0)
+        plt.savefig(f'{plot_name_}', format=r, bbox_inches="tight")
+        print(f"Plot saved in {plot_name_}")
+
+def pareto_frontier(points):
+    # Points no other point beats in both throughput and ratio.
+    frontier = []
+    for p in sorted(points, key=lambda p: (-p[0], -p[1])):
+        if not frontier or p[1] > frontier[-1][1]:
+            frontier.append(p)
+    return frontier
+
+def prepare_and_plot_exp_8(plot_name, b_name_filter):
+    r = r'BM_Pareto_(Compress|DeCompress)_([0-9]*)kB_name_(.*)_entropy_(.*)_size_([0-9]*)kB_mode_([0-9])_level_([0-9])_(qpl_path_[a-z]*)_mean'
+    data = {}
+    modes = {0: 'fixed', 1: 'dynamic', 2: 'huffman only', 3: 'static'}
+    paths = {'qpl_path_software': 'SW', 'qpl_path_hardware': 'HW'}
+    for index, row in df.iterrows():
+        re_name = re.match(r, row['name'])
+        if re_name == None:
+            continue
+
+        op = re_name.group(1)
+        b_name = re_name.group(3)
+        b_name = b_name.replace('dataset/silesia_tmp/', '')
+        b_name = b_name.replace('dataset/snapshots_tmp/', '')
+        if not b_name_filter == None and not b_name in b_name_filter:
+            continue
+
+        size_kb = (int)(re_name.group(5))
+        config = (re_name.group(8), (int)(re_name.group(6)), (int)(re_name.group(7)))
+        # Bytes per ns are GB/s.
+        throughput_gbs = size_kb * 1024 / row['real_time']
+        point = data.setdefault(b_name, {}).setdefault(size_kb, {}).setdefault(config, {})
+        point[op] = throughput_gbs
+        if op == 'Compress':
+            point['ratio'] = row['Compression Ratio']
+
+    #
+    if data == {}:
+        print("No data for exp_8 found")
+        return
+
+    for b_name, b_data in data.items():
+        fig, axs = plt.subplots(2, len(b_data), figsize=(7 * len(b_data), 10), squeeze=False)
+        for column, (size_kb, size_v) in enumerate(sorted(b_data.items())):
+            for row_i, op in enumerate(['Compress', 'DeCompress']):
+                ax = axs[row_i][column]
+                points = []
+                for (path, mode, level), v in sorted(size_v.items()):
+                    if not op in v or not 'ratio' in v:
+                        continue
+                    label = f'{paths[path]}, {modes[mode]}, level {level}'
+                    points.append((v[op], v['ratio'], label))
+                    ax.scatter(v[op], v['ratio'], color=['darkred', 'gray'][path == 'qpl_path_software'], marker=['o', 's', '^', 'D'][mode], s=80, edgecolor='black', alpha=[1.0, 0.5][level != 0], label=label)
+
+                frontier = pareto_frontier(points)
+                ax.plot([p[0] for p in frontier], [p[1] for p in frontier], color='black', linestyle='--', linewidth=1.5)
+                print(f'Pareto frontier, {b_name}, {size_kb} kB, {op}: ' + '; '.join(f'{p[2]} ({p[0]:.2f} GB/s, x{p[1]:.2f})' for p in frontier))
+
+                ax.set_title(f'{b_name}, {size_kb} kB, {op}', fontsize=text_size_big)
+                ax.set_xlabel('Throughput, GB/s', fontsize=text_size_big)
+                ax.set_ylabel('Compression ratio', fontsize=text_size_big)
+                ax.xaxis.set_tick_params(labelsize=text_size_medium)
+                ax.yaxis.set_tick_params(labelsize=text_size_medium)
+                ax.grid()
+                if column == 0 and row_i == 0:
+                    ax.legend(fontsize=text_size_small, loc='lower left')
+
+        for r in ['png', 'pdf']:
+            plot_name_ = f'out/{plot_name}_{b_name}.{r}'
+            fig.tight_layout(pad=2.0)
+            plt.savefig(f'{plot_name_}', format=r, bbox_inches="tight")
+            print(f"Plot saved in {plot_name_}")
+
+def prepare_and_plot_exp_9(plot_name):
+    r = r'BM_Stream_(Compress|DeCompress)_([0-9]*)MB_window_([0-9]*)kB_(qpl_path_[a-z]*)_mean'
+    data = {}
+    paths = {'qpl_path_software': 'Software', 'qpl_path_hardware': 'Hardware'}
+    for index, row in df.iterrows():
+        re_name = re.match(r, row['name'])
+        if re_name == None:
+            continue
+
+        op = re_name.group(1)
+        stream_mb = (int)(re_name.group(2))
+        window_kb = (int)(re_name.group(3))
+        path = paths[re_name.group(4)]
+        # Bytes per ns are GB/s.
+        throughput_gbs = stream_mb * 1024 * 1024 / row['real_time']
+        data.setdefault((op, path), {})[(stream_mb, window_kb)] = (throughput_gbs, row['Peak RSS Growth, MB'])
+
+    #
+    if data == {}:
+        print("No data for exp_9 found")
+        return
+
+    fig, axs = plt.subplots(2, len(data), figsize=(7 * len(data), 10), squeeze=False)
+    for column, ((op, path), v) in enumerate(sorted(data.items())):
+        streams = sorted({k[0] for k in v})
+        windows = sorted({k[1] for k in v})
+
+        ax = axs[0][column]
+        for stream_mb in streams:
+            x = [w for w in windows if (stream_mb, w) in v]
+            ax.plot(x, [v[(stream_mb, w)][0] for w in x], marker='o', linewidth=2, label=f'{stream_mb} MB stream')
+        ax.set_xscale('log', base=2)
+        ax.set_title(f'{path}, {op}', fontsize=text_size_big)
+        ax.set_xlabel('Window, kB', fontsize=text_size_big)
+        ax.set_ylabel('Throughput, GB/s', fontsize=text_size_big)
+
+        ax = axs[1][column]
+        for window_kb in windows:
+            x = [s_ for s_ in streams if (s_, window_kb) in v]
+            ax.plot(x, [v[(s_, window_kb)][1] for s_ in x], marker='o', linewidth=2, label=f'{window_kb} kB window')
+        ax.set_xscale('log', base=2)
+        ax.set_xlabel('Stream, MB', fontsize=text_size_big)
+        ax.set_ylabel('Peak RSS growth, MB', fontsize=text_size_big)
+
+        for ax in [axs[0][column], axs[1][column]]:
+            ax.xaxis.set_tick_params(labelsize=text_size_medium)
+            ax.yaxis.set_tick_params(labelsize=text_size_medium)
+            ax.grid()
+            ax.legend(fontsize=text_size_small, loc='upper left')
+
+    for r in ['png', 'pdf']:
+        plot_name_ = f'out/{plot_name}.{r}'
+        fig.tight_layout(pad=2.0)
+        plt.savefig(f'{plot_name_}', format=r, bbox_inches="tight")
+        print(f"Plot saved in {plot_name_}")
+
 #
 # Plot experiments.
 #
@@ -558,8 +800,24 @@ def plot_figure_4():
 def plot_figure_5():
     prepare_and_plot_exp_5(plot_name + '_5')
 
+def plot_figure_6():
+    prepare_and_plot_exp_6(plot_name + '_6', ['mozilla', 'pillow'])
+
+def plot_figure_7():
+    prepare_and_plot_exp_7(plot_name + '_7', ['xml', 'mozilla', 'pillow', 'x-ray'])
+
+def plot_figure_8():
+    prepare_and_plot_exp_8(plot_name + '_8', None)
+
+def plot_figure_9():
+    prepare_and_plot_exp_9(plot_name + '_9')
+
 plot_figure_1()
 plot_figure_2()
 plot_figure_3()
 plot_figure_4()
 plot_figure_5()
+plot_figure_6()
+plot_figure_7()
+plot_figure_8()
+plot_figure_9()
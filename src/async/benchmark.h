@@ -0,0 +1,171 @@
+#ifndef _ASYNC_BENCHMARK_H_
+#define _ASYNC_BENCHMARK_H_
+
+#include <chrono>
+#include <cstdarg>
+#include <memory>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../util.h"
+#include "qpl_async.h"
+
+namespace async_engine {
+
+enum RestoreMode { kRestoreBlocking, kRestoreCoroutines };
+
+static constexpr size_t kRestorePageSize = 4 * kkB;
+
+#define _PARSE_ARGS_ASYNC_                                                     \
+  _PARSE_IN                                                                    \
+  auto restore_mode = Inputs;                                                  \
+  auto concurrency = _PARSE_ARG(int);                                          \
+  auto max_inflight_jobs = _PARSE_ARG(int);                                    \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+// Independently compressed 4 kB pages of a memory image.
+struct CompressedPages {
+  std::vector<uint8_t> arena;
+  // [<offset in arena, compressed size, original size>].
+  std::vector<std::tuple<size_t, size_t, size_t>> pages;
+  bool failed = false;
+};
+
+static DetachedTask compress_page(Reactor &reactor, CompressedPages &pages,
+                                  const uint8_t *src, size_t page) {
+  auto &[offset, compressed_size, size] = pages.pages[page];
+  auto result = co_await reactor.compress(
+      single_engine::kModeFixed, src + page * kRestorePageSize, size,
+      pages.arena.data() + offset, 2 * kRestorePageSize);
+  if (result.status != QPL_STS_OK)
+    pages.failed = true;
+  compressed_size = result.total_out;
+}
+
+/// Compress @param src page by page (itself done with coroutines).
+static int compress_pages(const uint8_t *src, size_t src_size,
+                          size_t max_inflight_jobs, CompressedPages *pages) {
+  size_t page_count = (src_size + kRestorePageSize - 1) / kRestorePageSize;
+  pages->arena.assign(page_count * 2 * kRestorePageSize, _PAGE_PREFAULT_);
+  pages->pages.clear();
+  for (size_t page = 0; page < page_count; ++page)
+    pages->pages.push_back(std::make_tuple(
+        page * 2 * kRestorePageSize, 0,
+        std::min(kRestorePageSize, src_size - page * kRestorePageSize)));
+
+  Reactor reactor(max_inflight_jobs);
+  if (!reactor.ok())
+    return -1;
+  for (size_t page = 0; page < page_count; ++page)
+    compress_page(reactor, *pages, src, page);
+  reactor.run();
+  return pages->failed ? -1 : 0;
+}
+
+// Page-restore coroutine: restores every @param stride-th page starting from
+// @param first_page and records the latency of each restore.
+static DetachedTask restore_pages(Reactor &reactor, CompressedPages &pages,
+                                  uint8_t *dst, size_t first_page,
+                                  size_t stride,
+                                  std::vector<double> &latencies_us) {
+  for (size_t page = first_page; page < pages.pages.size(); page += stride) {
+    auto [offset, compressed_size, size] = pages.pages[page];
+    TimeScope latency;
+    auto result = co_await reactor.decompress(pages.arena.data() + offset,
+                                              compressed_size,
+                                              dst + page * kRestorePageSize,
+                                              size);
+    latencies_us[page] =
+        latency.GetTimeStamp<std::chrono::nanoseconds>() / 1000.0;
+    if (result.status != QPL_STS_OK || result.total_out != size)
+      pages.failed = true;
+  }
+}
+
+static int restore_blocking(CompressedPages &pages, uint8_t *dst,
+                            std::vector<double> &latencies_us) {
+  for (size_t page = 0; page < pages.pages.size(); ++page) {
+    auto [offset, compressed_size, size] = pages.pages[page];
+    TimeScope latency;
+    size_t decompressed_size = 0;
+    if (single_engine::decompress(
+            qpl_path_hardware, single_engine::kModeFixed, nullptr, 0,
+            pages.arena.data() + offset, compressed_size,
+            dst + page * kRestorePageSize, size, &decompressed_size) ||
+        decompressed_size != size)
+      return -1;
+    latencies_us[page] =
+        latency.GetTimeStamp<std::chrono::nanoseconds>() / 1000.0;
+  }
+  return 0;
+}
+
+auto BM_Async_PageRestore = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_ASYNC_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+
+  // Compress page by page.
+  CompressedPages pages;
+  if (compress_pages(source_buff, mem_size,
+                     static_cast<size_t>(max_inflight_jobs), &pages)) {
+    state.SkipWithMessage("Failed to compress.");
+    return;
+  }
+  size_t compressed_size = 0;
+  for (auto &page : pages.pages)
+    compressed_size += std::get<1>(page);
+  state.counters["Compression Ratio"] = 1.0 * mem_size / compressed_size;
+
+  auto decompressed_buff = mmap_allocate(mem_size);
+  memset(decompressed_buff.get(), _PAGE_PREFAULT_, mem_size);
+  std::vector<double> latencies_us(pages.pages.size(), 0);
+
+  // Benchmark restore; the reactor and its jobs only for the coroutines.
+  std::unique_ptr<Reactor> reactor;
+  if (static_cast<RestoreMode>(restore_mode) == kRestoreCoroutines) {
+    reactor = std::make_unique<Reactor>(static_cast<size_t>(max_inflight_jobs));
+    if (!reactor->ok()) {
+      state.SkipWithMessage("Failed to init reactor.");
+      return;
+    }
+  }
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    if (static_cast<RestoreMode>(restore_mode) == kRestoreBlocking) {
+      if (restore_blocking(pages, decompressed_buff.get(), latencies_us))
+        state.SkipWithMessage("Failed to decompress.");
+    } else {
+      for (int i = 0; i < concurrency; ++i)
+        restore_pages(*reactor, pages, decompressed_buff.get(),
+                      static_cast<size_t>(i),
+                      static_cast<size_t>(concurrency), latencies_us);
+      reactor->run();
+      if (pages.failed)
+        state.SkipWithMessage("Failed to decompress.");
+    }
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
+  state.counters["Pages"] = pages.pages.size();
+  state.counters["Latency p50, us"] = percentile(latencies_us, 50);
+  state.counters["Latency p99, us"] = percentile(latencies_us, 99);
+
+  // Verify.
+  if (memcmp(source_buff, decompressed_buff.get(), mem_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace async_engine
+
+#endif
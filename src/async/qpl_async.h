@@ -0,0 +1,210 @@
+#ifndef _QPL_ASYNC_H_
+#define _QPL_ASYNC_H_
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+
+#include "qpl/qpl.h"
+
+namespace async_engine {
+
+struct JobResult {
+  qpl_status status;
+  size_t total_out;
+};
+
+//
+/// Fire-and-forget coroutine: starts eagerly and destroys itself on
+/// completion; its lifetime is driven by the Reactor it awaits on.
+//
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+class Reactor;
+
+//
+/// co_await-able compression/decompression job; suspends the coroutine until
+/// the reactor observes the job completion.
+//
+class JobAwaitable {
+public:
+  JobAwaitable(Reactor &reactor, qpl_operation op, uint32_t flags,
+               const uint8_t *src, size_t src_size, uint8_t *dst,
+               size_t dst_size)
+      : reactor_(reactor), op_(op), flags_(flags), src_(src),
+        src_size_(src_size), dst_(dst), dst_size_(dst_size) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle);
+  JobResult await_resume() const noexcept { return result_; }
+
+private:
+  friend class Reactor;
+
+  Reactor &reactor_;
+  qpl_operation op_;
+  uint32_t flags_;
+  const uint8_t *src_;
+  size_t src_size_;
+  uint8_t *dst_;
+  size_t dst_size_;
+  std::coroutine_handle<> handle_;
+  JobResult result_{QPL_STS_OK, 0};
+};
+
+//
+/// Single-threaded reactor: owns a bounded pool of hardware jobs, submits the
+/// awaited operations as jobs become free, polls the outstanding ones and
+/// resumes their waiters on completion.
+//
+class Reactor {
+public:
+  Reactor(size_t max_inflight_jobs, WaitStrategy wait = kWaitBusyPoll)
+      : wait_(wait) {
+    uint32_t job_size = 0;
+    qpl_status status = qpl_get_job_size(qpl_path_hardware, &job_size);
+    if (status != QPL_STS_OK) {
+      LOG(WARNING) << "An error acquired during job size getting.";
+      return;
+    }
+
+    for (size_t i = 0; i < max_inflight_jobs; ++i) {
+      auto job_buffer = std::make_unique<uint8_t[]>(job_size);
+      auto job = reinterpret_cast<qpl_job *>(job_buffer.get());
+      status = qpl_init_job(qpl_path_hardware, job);
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error acquired during job initializing.";
+        return;
+      }
+      free_jobs_.push_back(job);
+      job_buffers_.push_back(std::move(job_buffer));
+    }
+  }
+
+  ~Reactor() {
+    for (auto &job_buffer : job_buffers_)
+      qpl_fini_job(reinterpret_cast<qpl_job *>(job_buffer.get()));
+  }
+
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+
+  bool ok() const { return !job_buffers_.empty(); }
+
+  JobAwaitable compress(single_engine::CompressionMode mode,
+                        const uint8_t *src, size_t src_size, uint8_t *dst,
+                        size_t dst_size) {
+    uint32_t flags = QPL_FLAG_FIRST | QPL_FLAG_OMIT_VERIFY | QPL_FLAG_LAST;
+    if (mode == single_engine::kModeDynamic)
+      flags |= QPL_FLAG_DYNAMIC_HUFFMAN;
+    return JobAwaitable(*this, qpl_op_compress, flags, src, src_size, dst,
+                        dst_size);
+  }
+
+  JobAwaitable decompress(const uint8_t *src, size_t src_size, uint8_t *dst,
+                          size_t dst_size) {
+    return JobAwaitable(*this, qpl_op_decompress,
+                        QPL_FLAG_FIRST | QPL_FLAG_LAST, src, src_size, dst,
+                        dst_size);
+  }
+
+  void enqueue(JobAwaitable *op) { pending_.push_back(op); }
+
+  /// Drive all the coroutines awaiting on this reactor to completion.
+  void run() {
+    CompletionWaiter waiter(wait_);
+    std::vector<JobAwaitable *> completed;
+    while (!pending_.empty() || !inflight_.empty() || !completed.empty()) {
+      dispatch(&completed);
+
+      for (size_t i = 0; i < inflight_.size();) {
+        auto [job, op] = inflight_[i];
+        auto status = qpl_check_job(job);
+        if (status == QPL_STS_BEING_PROCESSED) {
+          ++i;
+          continue;
+        }
+        op->result_ = {status, job->total_out};
+        inflight_[i] = inflight_.back();
+        inflight_.pop_back();
+        free_jobs_.push_back(job);
+        completed.push_back(op);
+      }
+
+      if (completed.empty()) {
+        waiter.wait();
+        continue;
+      }
+      waiter.reset();
+
+      // Resuming may enqueue new operations.
+      auto resumable = std::move(completed);
+      completed.clear();
+      for (auto op : resumable)
+        op->handle_.resume();
+    }
+  }
+
+private:
+  /// Submit pending operations while free jobs are available; operations
+  /// failing to submit complete immediately with the error.
+  void dispatch(std::vector<JobAwaitable *> *completed) {
+    while (!pending_.empty() && !free_jobs_.empty()) {
+      auto op = pending_.front();
+      auto job = free_jobs_.back();
+      job->op = op->op_;
+      job->level = qpl_default_level;
+      job->next_in_ptr = const_cast<uint8_t *>(op->src_);
+      job->available_in = op->src_size_;
+      job->next_out_ptr = op->dst_;
+      job->available_out = op->dst_size_;
+      job->flags = op->flags_;
+
+      qpl_status status = qpl_submit_job(job);
+      if (status == QPL_STS_QUEUES_ARE_BUSY_ERR)
+        break; // Retry on the next pass.
+
+      pending_.pop_front();
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status
+                     << " acquired during job submission.";
+        op->result_ = {status, 0};
+        completed->push_back(op);
+        continue;
+      }
+      free_jobs_.pop_back();
+      inflight_.push_back(std::make_pair(job, op));
+    }
+  }
+
+  WaitStrategy wait_;
+  std::vector<std::unique_ptr<uint8_t[]>> job_buffers_;
+  std::vector<qpl_job *> free_jobs_;
+  std::deque<JobAwaitable *> pending_;
+  std::vector<std::pair<qpl_job *, JobAwaitable *>> inflight_;
+};
+
+inline void JobAwaitable::await_suspend(std::coroutine_handle<> handle) {
+  handle_ = handle;
+  reactor_.enqueue(this);
+}
+
+} // namespace async_engine
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef _BENCHMARK_REGISTRY_H_
+#define _BENCHMARK_REGISTRY_H_
+
+#include <algorithm>
+#include <functional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+/// Split a comma-separated flag value, e.g. "a,b,c".
+std::vector<std::string> parse_list_flag(const std::string &flag) {
+  std::vector<std::string> items;
+  std::stringstream ss(flag);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty())
+      items.push_back(item);
+  }
+  return items;
+}
+
+template <class T>
+std::vector<T> parse_number_list_flag(const std::string &flag) {
+  std::vector<T> numbers;
+  for (const auto &item : parse_list_flag(flag))
+    numbers.push_back(static_cast<T>(std::stoull(item)));
+  return numbers;
+}
+
+//
+/// Filter-aware benchmark registration.
+///
+/// Benchmarks are only registered (and their datasets and prepared files only
+/// materialized) when their name survives --benchmark_filter, using the same
+/// semantics as Google Benchmark: extended regex search, "all" selects
+/// everything, a leading '-' negates the filter.
+//
+class BenchmarkRegistry {
+public:
+  /// Names of the dataset-driven benchmarks contain the dataset entropy which
+  /// is only known after reading the file; they are first matched with this
+  /// placeholder instead.
+  static constexpr const char *kEntropyPlaceholder = "0.000000";
+
+  BenchmarkRegistry(std::string filter, const std::string &families)
+      : families_(parse_list_flag(families)) {
+    if (filter.empty() || filter == "all")
+      filter = ".";
+    if (filter[0] == '-') {
+      negative_ = true;
+      filter = filter.substr(1);
+    }
+    filter_mentions_entropy_ = filter.find("entropy") != std::string::npos;
+    filter_ = std::regex(filter, std::regex::extended);
+  }
+
+  bool family_enabled(const std::string &family) const {
+    return std::find(families_.begin(), families_.end(), "all") !=
+               families_.end() ||
+           std::find(families_.begin(), families_.end(), family) !=
+               families_.end();
+  }
+
+  bool selected(const std::string &name) const {
+    return std::regex_search(name, filter_) != negative_;
+  }
+
+  /// Conservative check for a name built with kEntropyPlaceholder: filters
+  /// that reference the entropy field can only be decided after loading.
+  bool may_be_selected(const std::string &name_with_placeholder) const {
+    return filter_mentions_entropy_ || selected(name_with_placeholder);
+  }
+
+  /// Register the benchmark through @param reg if @param name is selected.
+  void add(const std::string &name,
+           const std::function<void(const std::string &)> &reg) {
+    if (!selected(name)) {
+      ++filtered_out_;
+      return;
+    }
+    reg(name);
+    ++registered_;
+  }
+
+  void skip(size_t n) { filtered_out_ += n; }
+
+  size_t registered() const { return registered_; }
+  size_t filtered_out() const { return filtered_out_; }
+
+private:
+  std::vector<std::string> families_;
+  std::regex filter_;
+  bool negative_ = false;
+  bool filter_mentions_entropy_ = false;
+  size_t registered_ = 0;
+  size_t filtered_out_ = 0;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef _CACHE_STATE_H_
+#define _CACHE_STATE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <immintrin.h>
+
+#include <benchmark/benchmark.h>
+
+#include "cpu_counters.h"
+#include "util.h"
+
+enum CacheState {
+  // The same buffers every iteration: after the first one, inputs that fit
+  // are served from the LLC.
+  kCacheHot,
+  // The same buffers, evicted from every cache level before each iteration.
+  kCacheFlushed,
+  // A different set of buffers every iteration, from a pool of sets larger
+  // than the LLC, so that every iteration reads and writes memory.
+  kCacheRotating
+};
+
+static constexpr size_t kCacheLineSize = 64;
+// Pool of rotating sets as a multiple of the LLC size, so that a set is
+// evicted before its next turn.
+static constexpr size_t kRotationLlcMultiple = 2;
+// Bounds the bookkeeping for tiny inputs.
+static constexpr size_t kMaxRotationSets = 16384;
+
+/// Write back and evict @param size bytes at @param ptr from every cache
+/// level.
+static void flush_cache_lines(const void *ptr, size_t size) {
+  if (ptr == nullptr || size == 0)
+    return;
+  auto line = reinterpret_cast<uintptr_t>(ptr) & ~(kCacheLineSize - 1);
+  const auto end = reinterpret_cast<uintptr_t>(ptr) + size;
+  for (; line < end; line += kCacheLineSize)
+#ifdef __CLFLUSHOPT__
+    _mm_clflushopt(reinterpret_cast<void *>(line));
+#else
+    _mm_clflush(reinterpret_cast<const void *>(line));
+#endif
+  // Order the flushes before the accesses of the next iteration.
+  _mm_sfence();
+}
+
+/// Number of buffer sets of @param set_size bytes (source + destination)
+/// @param cache_state needs.
+static size_t cache_state_sets(CacheState cache_state, size_t set_size) {
+  if (cache_state != kCacheRotating)
+    return 1;
+  const size_t pool_size = kRotationLlcMultiple * llc_size();
+  set_size = std::max<size_t>(set_size, 1);
+  const size_t sets = (pool_size + set_size - 1) / set_size;
+  return std::clamp<size_t>(sets, 2, kMaxRotationSets);
+}
+
+//
+/// Source and destination buffers of a benchmark loop in a given CacheState.
+/// Set 0 is the caller's source; the other sets hold copies of it. Buffers
+/// the caller keeps per set (e.g. the chunks of a CompressedFormat) are
+/// added as regions. next() before every iteration flushes the current set
+/// or moves to the next one.
+//
+class CacheStateBuffers {
+public:
+  /// @param src of @param src_size bytes might be nullptr if the caller
+  /// manages the source; destinations of @param dst_size bytes are prefaulted.
+  CacheStateBuffers(CacheState cache_state, size_t sets, const uint8_t *src,
+                    size_t src_size, size_t dst_size)
+      : cache_state_(cache_state), src_size_(src_size), dst_size_(dst_size),
+        srcs_(sets, src) {
+    for (size_t set = 1; src != nullptr && set < sets; ++set) {
+      copies_.emplace_back(src, src + src_size);
+      srcs_[set] = copies_.back().data();
+    }
+    for (size_t set = 0; set < sets; ++set)
+      dsts_.emplace_back(dst_size, _PAGE_PREFAULT_);
+    regions_.resize(sets);
+  }
+
+  CacheStateBuffers(const CacheStateBuffers &) = delete;
+  CacheStateBuffers &operator=(const CacheStateBuffers &) = delete;
+
+  /// Flush @param size bytes at @param ptr with set @param set as well.
+  void add_region(size_t set, const void *ptr, size_t size) {
+    regions_[set].emplace_back(ptr, size);
+  }
+
+  /// Prepare the buffers of the next iteration.
+  void next() {
+    switch (cache_state_) {
+    case kCacheHot:
+      break;
+    case kCacheFlushed:
+      flush_cache_lines(src(), src_size_);
+      flush_cache_lines(dst(), dst_size_);
+      for (const auto &[ptr, size] : regions_[index_])
+        flush_cache_lines(ptr, size);
+      break;
+    case kCacheRotating:
+      index_ = (index_ + 1) % srcs_.size();
+      break;
+    }
+  }
+
+  /// next() outside the timed region of @param state and the counted one of
+  /// @param cpu_counters; nothing to do for kCacheHot.
+  void next(benchmark::State &state, CpuCounters &cpu_counters) {
+    if (cache_state_ == kCacheHot)
+      return;
+    state.PauseTiming();
+    cpu_counters.pause();
+    next();
+    cpu_counters.resume();
+    state.ResumeTiming();
+  }
+
+  const uint8_t *src() const { return srcs_[index_]; }
+  uint8_t *dst() { return dsts_[index_].data(); }
+  size_t index() const { return index_; }
+  size_t sets() const { return srcs_.size(); }
+
+private:
+  CacheState cache_state_;
+  size_t src_size_;
+  size_t dst_size_;
+  std::vector<const uint8_t *> srcs_;
+  std::vector<std::vector<uint8_t>> copies_;
+  std::vector<std::vector<uint8_t>> dsts_;
+  std::vector<std::vector<std::pair<const void *, size_t>>> regions_;
+  size_t index_ = 0;
+};
+
+#endif
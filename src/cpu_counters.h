@@ -0,0 +1,268 @@
+#ifndef _CPU_COUNTERS_H_
+#define _CPU_COUNTERS_H_
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "util.h"
+
+enum CpuEvent {
+  kEventCycles,
+  kEventInstructions,
+  kEventLlcMisses,
+  kEventDtlbMisses,
+  kEventPageFaults,
+  kEventCount
+};
+
+enum CpuScope {
+  // The thread and the threads it starts while counting (events), every
+  // thread of the process (CPU time).
+  kScopeProcess,
+  // The thread only, e.g. next to load generators running on other threads.
+  kScopeThread
+};
+
+static constexpr uint64_t kGB = 1024 * kMB;
+
+//
+/// Hardware and software events of perf_event_open plus getrusage CPU time
+/// (user + system), counted over the benchmark loop and reported per GB
+/// processed. With kScopeProcess, "Core Seconds per GB" is process-wide: it
+/// includes any thread running meanwhile. Events the kernel does not permit
+/// (perf_event_paranoid, no PMU in a VM) are reported as 0 with "Perf Events"
+/// counting the ones that were opened.
+//
+class CpuCounters {
+public:
+  /// Open the events and start counting, in @param scope of the calling
+  /// thread or of the thread @param tid of the process (events only: the CPU
+  /// time is the calling thread's or the process').
+  explicit CpuCounters(CpuScope scope = kScopeProcess, pid_t tid = 0)
+      : scope_(scope) {
+    fds_.fill(-1);
+    for (size_t event = 0; event < kEventCount; ++event)
+      fds_[event] = open_event(static_cast<CpuEvent>(event), scope, tid);
+    resume();
+  }
+
+  ~CpuCounters() {
+    for (int fd : fds_)
+      if (fd != -1)
+        close(fd);
+  }
+
+  CpuCounters(const CpuCounters &) = delete;
+  CpuCounters &operator=(const CpuCounters &) = delete;
+
+  /// Stop counting, e.g. with state.PauseTiming().
+  void pause() {
+    if (!running_)
+      return;
+    for (int fd : fds_)
+      if (fd != -1)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    cpu_time_ += cpu_time() - cpu_time_start_;
+    running_ = false;
+  }
+
+  /// Count again, e.g. with state.ResumeTiming().
+  void resume() {
+    if (running_)
+      return;
+    cpu_time_start_ = cpu_time();
+    for (int fd : fds_)
+      if (fd != -1)
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    running_ = true;
+  }
+
+  /// Count of @param event so far; 0 if it could not be opened.
+  double count(CpuEvent event) const {
+    double count = 0;
+    if (fds_[event] != -1)
+      read_event(fds_[event], &count);
+    return count;
+  }
+
+  /// Number of events that could be opened.
+  int opened() const {
+    return static_cast<int>(std::count_if(fds_.begin(), fds_.end(),
+                                          [](int fd) { return fd != -1; }));
+  }
+
+  /// Stop counting and report the counts per GB of @param bytes processed.
+  void report(benchmark::State &state, double bytes) {
+    pause();
+    const double gb = bytes > 0 ? bytes / kGB : 0;
+    const auto per_gb = [gb](double count) {
+      return gb > 0 ? count / gb : 0;
+    };
+    std::array<double, kEventCount> counts{};
+    for (size_t event = 0; event < kEventCount; ++event)
+      counts[event] = count(static_cast<CpuEvent>(event));
+    state.counters["Perf Events"] = opened();
+    state.counters["Cycles per GB"] = per_gb(counts[kEventCycles]);
+    state.counters["Instructions per GB"] =
+        per_gb(counts[kEventInstructions]);
+    state.counters["LLC Misses per GB"] = per_gb(counts[kEventLlcMisses]);
+    state.counters["dTLB Misses per GB"] = per_gb(counts[kEventDtlbMisses]);
+    state.counters["Page Faults per GB"] = per_gb(counts[kEventPageFaults]);
+    state.counters["Core Seconds per GB"] = per_gb(cpu_time_);
+  }
+
+private:
+  static int open_event(CpuEvent event, CpuScope scope, pid_t tid) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+    case kEventCycles:
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case kEventInstructions:
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case kEventLlcMisses:
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case kEventDtlbMisses:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    default:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+      break;
+    }
+    attr.disabled = 1;
+    // Count the threads the benchmark starts as well.
+    attr.inherit = scope == kScopeProcess;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = perf_event_open(&attr, tid);
+    if (fd == -1) {
+      // Unprivileged users may still count user space only.
+      attr.exclude_kernel = 1;
+      fd = perf_event_open(&attr, tid);
+    }
+    if (fd == -1) {
+      static bool warned = false;
+      if (!warned)
+        LOG(WARNING) << "perf_event_open is not permitted ("
+                     << strerror(errno)
+                     << "), perf counters are reported as 0.";
+      warned = true;
+    }
+    return fd;
+  }
+
+  /// Count @param attr for thread @param tid (0: the calling thread), and its
+  /// new threads if inherited, on any CPU.
+  static int perf_event_open(struct perf_event_attr *attr, pid_t tid) {
+    return static_cast<int>(syscall(SYS_perf_event_open, attr, tid, -1, -1,
+                                    PERF_FLAG_FD_CLOEXEC));
+  }
+
+  /// Read the count of @param fd, scaled up if the event was multiplexed.
+  static void read_event(int fd, double *count) {
+    uint64_t values[3] = {0, 0, 0};
+    if (read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0)
+      return;
+    *count = static_cast<double>(values[0]) * static_cast<double>(values[1]) /
+             static_cast<double>(values[2]);
+  }
+
+  /// CPU time (user + system) of every thread of the process, or of the
+  /// calling thread for kScopeThread, in seconds.
+  double cpu_time() const {
+    struct rusage usage;
+    if (getrusage(scope_ == kScopeThread ? RUSAGE_THREAD : RUSAGE_SELF,
+                  &usage))
+      return 0;
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec +
+                               usage.ru_stime.tv_usec) /
+               1e6;
+  }
+
+  CpuScope scope_;
+  std::array<int, kEventCount> fds_;
+  bool running_ = false;
+  double cpu_time_ = 0;
+  double cpu_time_start_ = 0;
+};
+
+//
+/// CpuCounters of a benchmark loop, reported per GB of bytes_per_iteration
+/// bytes on destruction:
+///
+///   CountedLoop loop(state, source_size);
+///   for (auto _ : loop) {
+///     ...
+///   }
+///
+/// Counting stops as the loop ends, so the verification that follows is not
+/// counted.
+//
+class CountedLoop : public CpuCounters {
+public:
+  CountedLoop(benchmark::State &state, size_t bytes_per_iteration,
+              CpuScope scope = kScopeProcess)
+      : CpuCounters(scope), state_(state),
+        bytes_per_iteration_(bytes_per_iteration) {}
+
+  ~CountedLoop() {
+    report(state_, static_cast<double>(state_.iterations()) *
+                       static_cast<double>(bytes_per_iteration_));
+  }
+
+  /// Iterator of the state that stops counting at the end of the loop.
+  class Iterator {
+  public:
+    Iterator(CountedLoop *loop, benchmark::State::StateIterator it)
+        : loop_(loop), it_(it) {}
+
+    auto operator*() const { return *it_; }
+    Iterator &operator++() {
+      ++it_;
+      return *this;
+    }
+    bool operator!=(const Iterator &end) const {
+      if (it_ != end.it_)
+        return true;
+      loop_->pause();
+      return false;
+    }
+
+  private:
+    CountedLoop *loop_;
+    benchmark::State::StateIterator it_;
+  };
+
+  Iterator begin() { return Iterator(this, state_.begin()); }
+  Iterator end() { return Iterator(this, state_.end()); }
+
+private:
+  benchmark::State &state_;
+  size_t bytes_per_iteration_;
+};
+
+#endif
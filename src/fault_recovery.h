@@ -0,0 +1,195 @@
+#ifndef _FAULT_RECOVERY_H_
+#define _FAULT_RECOVERY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "job_submitter.h"
+#include "util.h"
+#include "wait_strategy.h"
+
+#include "qpl/qpl.h"
+
+static constexpr uintptr_t kFaultRecoveryPageSize = 4 * kkB;
+// Present bit of a /proc/<pid>/pagemap entry.
+static constexpr uint64_t kPagemapPresent = 1ULL << 63;
+
+//
+/// What to do with a hardware job that failed on a page fault. The default
+/// fails the job as is; only benchmarks measuring the recovery opt in.
+//
+struct FaultRecoveryPolicy {
+  // Touch-and-resubmit attempts before giving up on the hardware.
+  size_t max_resubmits = 0;
+  // Then execute the job on qpl_path_software instead of failing (not
+  // possible for jobs using Huffman tables).
+  bool software_fallback = false;
+
+  bool enabled() const { return max_resubmits != 0 || software_fallback; }
+};
+
+//
+/// Process-wide fault recovery counters.
+//
+struct FaultRecoveryStats {
+  // Jobs failed with a fault-related status.
+  std::atomic<uint64_t> faulted{0};
+  // Faulted jobs that had made partial progress, discarded on resubmission.
+  std::atomic<uint64_t> partial{0};
+  // Pages faulted in from the CPU.
+  std::atomic<uint64_t> touched_pages{0};
+  // Hardware resubmissions after touching the buffers.
+  std::atomic<uint64_t> resubmitted{0};
+  // Jobs completed on the hardware after a resubmission.
+  std::atomic<uint64_t> recovered{0};
+  // Jobs executed on qpl_path_software after the resubmissions.
+  std::atomic<uint64_t> fallbacks{0};
+  // Jobs given up.
+  std::atomic<uint64_t> failed{0};
+
+  static FaultRecoveryStats &instance() {
+    static FaultRecoveryStats stats;
+    return stats;
+  }
+};
+
+//
+/// Buffers of a job as set up before its submission: the hardware advances
+/// next_in_ptr/next_out_ptr as it makes progress.
+//
+struct JobBuffers {
+  uint8_t *in = nullptr;
+  uint32_t in_size = 0;
+  uint8_t *out = nullptr;
+  uint32_t out_size = 0;
+
+  JobBuffers() = default;
+  explicit JobBuffers(const qpl_job *job)
+      : in(job->next_in_ptr), in_size(job->available_in),
+        out(job->next_out_ptr), out_size(job->available_out) {}
+
+  /// Point @param job back at the start of the buffers.
+  void rewind(qpl_job *job) const {
+    job->next_in_ptr = in;
+    job->available_in = in_size;
+    job->next_out_ptr = out;
+    job->available_out = out_size;
+  }
+};
+
+/// Number of pages of [@param ptr, @param ptr + size) not mapped in the page
+/// table (present bit of /proc/self/pagemap), i.e. that fault on access. The
+/// page cache residency of mincore() would miss minor faults.
+static size_t count_unmapped_pages(const uint8_t *ptr, size_t size) {
+  if (ptr == nullptr || size == 0)
+    return 0;
+  int fd = open("/proc/self/pagemap", O_RDONLY);
+  if (fd == -1)
+    return 0;
+  const uintptr_t first_page =
+      reinterpret_cast<uintptr_t>(ptr) / kFaultRecoveryPageSize;
+  const uintptr_t last_page =
+      (reinterpret_cast<uintptr_t>(ptr) + size - 1) / kFaultRecoveryPageSize;
+  std::vector<uint64_t> entries(last_page - first_page + 1);
+  const size_t bytes = entries.size() * sizeof(uint64_t);
+  size_t unmapped = 0;
+  if (pread(fd, entries.data(), bytes,
+            static_cast<off_t>(first_page * sizeof(uint64_t))) ==
+      static_cast<ssize_t>(bytes))
+    unmapped = static_cast<size_t>(
+        std::count_if(entries.begin(), entries.end(), [](uint64_t entry) {
+          return (entry & kPagemapPresent) == 0;
+        }));
+  close(fd);
+  return unmapped;
+}
+
+/// Fault in the pages of [@param ptr, @param ptr + size) from the CPU,
+/// writable if @param write, keeping their content. Returns the number of
+/// pages touched.
+static size_t touch_pages(uint8_t *ptr, size_t size, bool write) {
+  if (ptr == nullptr || size == 0)
+    return 0;
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(ptr);
+  size_t pages = 0;
+  for (uintptr_t page = begin & ~(kFaultRecoveryPageSize - 1);
+       page < begin + size; page += kFaultRecoveryPageSize, ++pages) {
+    auto byte = reinterpret_cast<volatile uint8_t *>(std::max(page, begin));
+    uint8_t value = *byte;
+    if (write)
+      *byte = value;
+  }
+  return pages;
+}
+
+/// Whether a hardware job over @param buffers that completed with
+/// @param status failed on a page fault: an error status other than output
+/// capacity or queue errors, with pages of its buffers still not mapped. QPL
+/// has no public status dedicated to translation failures, so the pages are
+/// what tells them apart; a job with mapped buffers failed on its data
+/// (e.g. a corrupt stream), whatever progress it made.
+static bool is_fault_related(qpl_status status, const JobBuffers &buffers) {
+  if (status == QPL_STS_OK || status == QPL_STS_BEING_PROCESSED ||
+      status == QPL_STS_MORE_OUTPUT_NEEDED ||
+      status == QPL_STS_DST_IS_SHORT_ERR ||
+      status == QPL_STS_QUEUES_ARE_BUSY_ERR)
+    return false;
+  return count_unmapped_pages(buffers.in, buffers.in_size) != 0 ||
+         count_unmapped_pages(buffers.out, buffers.out_size) != 0;
+}
+
+/// Complete the hardware @param job, set up on @param buffers, that finished
+/// with @param status: if @param policy is enabled and the job failed on a
+/// page fault, fault in its buffers from the CPU and resubmit it from the
+/// start (a FIRST|LAST job cannot continue from the intermediate state of the
+/// engine), then fall back to qpl_path_software if the policy allows. Returns
+/// the final status; other failures are returned as is.
+static qpl_status recover_faulted_job(qpl_job *job, const JobBuffers &buffers,
+                                      qpl_status status, WaitStrategy wait,
+                                      const FaultRecoveryPolicy &policy) {
+  if (!policy.enabled() || !is_fault_related(status, buffers))
+    return status;
+
+  auto &stats = FaultRecoveryStats::instance();
+  ++stats.faulted;
+  if (job->total_in > 0)
+    ++stats.partial;
+  for (size_t attempt = 0; attempt < policy.max_resubmits; ++attempt) {
+    stats.touched_pages += touch_pages(buffers.in, buffers.in_size, false) +
+                           touch_pages(buffers.out, buffers.out_size, true);
+    buffers.rewind(job);
+    ++stats.resubmitted;
+    status = execute_job(job, wait);
+    if (status == QPL_STS_OK) {
+      ++stats.recovered;
+      return status;
+    }
+    if (!is_fault_related(status, buffers))
+      return status;
+  }
+
+  if (!policy.software_fallback || job->huffman_table != nullptr) {
+    LOG(WARNING) << "Failed to recover a faulted job: " << status;
+    ++stats.failed;
+    return status;
+  }
+  ++stats.fallbacks;
+  buffers.rewind(job);
+  std::unique_ptr<uint8_t[]> software_job;
+  status = execute_on_software_path(job, &software_job);
+  if (software_job != nullptr)
+    qpl_fini_job(reinterpret_cast<qpl_job *>(software_job.get()));
+  if (status != QPL_STS_OK)
+    ++stats.failed;
+  return status;
+}
+
+#endif
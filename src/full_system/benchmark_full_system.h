@@ -11,14 +11,16 @@
 
 #include <benchmark/benchmark.h>
 
+#include "../cpu_counters.h"
+#include "../prepared_cache.h"
 #include "../single_engine/qpl_compress_decompress.h"
 #include "../util.h"
 
 namespace full_system {
 
-static int prepare_compressed_files(uint8_t *src, size_t src_size,
-                                    const char *filename,
-                                    size_t *compressed_size_out) {
+static int write_compressed_file(uint8_t *src, size_t src_size,
+                                 const char *filename,
+                                 size_t *compressed_size_out) {
   // Compress.
   size_t compressed_size = 2 * src_size;
   auto compressed_buff = malloc_allocate(compressed_size);
@@ -53,6 +55,39 @@ static int prepare_compressed_files(uint8_t *src, size_t src_size,
   return 0;
 }
 
+/// Compress @param src into @param filename, reusing the file from the
+/// prepared inputs cache if the same content was already compressed.
+static int prepare_compressed_files(uint8_t *src, size_t src_size,
+                                    const char *filename,
+                                    size_t *compressed_size_out) {
+  using prepared_cache::PreparedFileCache;
+  std::string cached_path;
+  if (PreparedFileCache::instance().get_or_create(
+          PreparedFileCache::make_key(src, src_size, "iaa_deflate",
+                                      "dynamic_aligned4k"),
+          [&](const std::string &path, size_t *compressed_size) {
+            return write_compressed_file(src, src_size, path.c_str(),
+                                         compressed_size);
+          },
+          filename, &cached_path, compressed_size_out)) {
+    LOG(WARNING) << "Failed to prepare compressed file.";
+    return -1;
+  }
+
+  // Link the cached file in place.
+  if (cached_path != filename) {
+    std::error_code ec;
+    std::filesystem::remove(filename, ec);
+    std::filesystem::create_hard_link(cached_path, filename, ec);
+    if (ec && !std::filesystem::copy_file(cached_path, filename, ec)) {
+      LOG(WARNING) << "Failed to link cached file " << cached_path;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
 enum FullSystemMode {
   kBenchmarkDiskRead,
   kBenchmarkDiskReadIODirect,
@@ -135,7 +170,8 @@ auto BM_FullSystem = [](benchmark::State &state, auto Inputs...) {
   if (static_cast<FullSystemMode>(mode) == kBenchmarkDiskRead ||
       static_cast<FullSystemMode>(mode) == kBenchmarkDiskReadIODirect) {
     // Benchmark read file.
-    for (auto _ : state) {
+    CountedLoop loop(state, source_size);
+    for (auto _ : loop) {
       ssize_t res = read(fd, mem_buff, source_size);
       if (res == -1 || static_cast<size_t>(res) != source_size) {
         state.SkipWithMessage(
@@ -155,7 +191,8 @@ auto BM_FullSystem = [](benchmark::State &state, auto Inputs...) {
            decompression_expected_size);
 
     size_t decompression_size = 0;
-    for (auto _ : state) {
+    CountedLoop loop(state, decompression_expected_size);
+    for (auto _ : loop) {
       if (single_engine::decompress(
               qpl_path_hardware, single_engine::kModeDynamic, nullptr, 0,
               mem_buff, compressed_size, decompressed_buff.get(),
@@ -0,0 +1,182 @@
+#ifndef _AGGRESSORS_H_
+#define _AGGRESSORS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../util.h"
+
+namespace interference {
+
+enum HogPattern {
+  // Sequential loads over the buffer.
+  kHogRead,
+  // Sequential stores over the buffer (memset, non-temporal for large
+  // buffers).
+  kHogWrite,
+  // memcpy from one half of the buffer to the other.
+  kHogCopy
+};
+
+// Bytes streamed between checks of the stop flag.
+static constexpr size_t kHogBlockSize = 1 * kMB;
+
+/// @param count CPUs of the affinity mask of the process other than the one
+/// of the calling thread, in order; CPUs are reused if there are not enough.
+static std::vector<size_t> spare_cpus(size_t count) {
+  std::vector<size_t> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set)) {
+    LOG(WARNING) << "Failed to get the CPU affinity.";
+    return cpus;
+  }
+  const auto self = static_cast<size_t>(sched_getcpu());
+  std::vector<size_t> candidates;
+  for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    if (CPU_ISSET(cpu, &set) && cpu != self)
+      candidates.push_back(cpu);
+  if (candidates.empty())
+    candidates.push_back(self);
+  if (count > candidates.size())
+    LOG(WARNING) << count << " threads share " << candidates.size()
+                 << " spare CPUs.";
+  for (size_t i = 0; i < count; ++i)
+    cpus.push_back(candidates[i % candidates.size()]);
+  return cpus;
+}
+
+/// Pin @param thread to @param cpu.
+static int pin_thread(std::thread &thread, size_t cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set)) {
+    LOG(WARNING) << "Failed to pin a thread to CPU " << cpu;
+    return -1;
+  }
+  return 0;
+}
+
+//
+/// Pins the calling thread to the CPU it runs on until destroyed, so that
+/// the measured thread does not migrate onto the CPUs of co-runners.
+//
+class ScopedPin {
+public:
+  ScopedPin() {
+    CPU_ZERO(&previous_);
+    if (sched_getaffinity(0, sizeof(previous_), &previous_))
+      return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(static_cast<size_t>(sched_getcpu()), &set);
+    pinned_ = sched_setaffinity(0, sizeof(set), &set) == 0;
+  }
+
+  ~ScopedPin() {
+    if (pinned_)
+      sched_setaffinity(0, sizeof(previous_), &previous_);
+  }
+
+  ScopedPin(const ScopedPin &) = delete;
+  ScopedPin &operator=(const ScopedPin &) = delete;
+
+private:
+  cpu_set_t previous_;
+  bool pinned_ = false;
+};
+
+//
+/// Threads pinned to spare CPUs streaming over buffers of their own, larger
+/// than the LLC, to load the memory bandwidth of the host until destroyed.
+//
+class BandwidthHogs {
+public:
+  BandwidthHogs(size_t threads, HogPattern pattern, size_t buffer_size)
+      : pattern_(pattern), buffer_size_(buffer_size / kHogBlockSize *
+                                        kHogBlockSize) {
+    if (threads == 0 || buffer_size_ < 2 * kHogBlockSize)
+      return;
+    const auto cpus = spare_cpus(threads);
+    for (size_t t = 0; t < cpus.size(); ++t) {
+      auto buff = mmap_allocate(buffer_size_);
+      memset(buff.get(), _PAGE_PREFAULT_, buffer_size_);
+      buffers_.push_back(std::move(buff));
+    }
+    start_ = TimeScope();
+    for (size_t t = 0; t < cpus.size(); ++t) {
+      threads_.emplace_back([this, t] { stream(buffers_[t].get()); });
+      pin_thread(threads_.back(), cpus[t]);
+    }
+  }
+
+  ~BandwidthHogs() { stop(); }
+
+  BandwidthHogs(const BandwidthHogs &) = delete;
+  BandwidthHogs &operator=(const BandwidthHogs &) = delete;
+
+  /// Stop the threads; returns the bandwidth they used, in GB/s.
+  double stop() {
+    if (!threads_.empty()) {
+      stop_ = true;
+      for (auto &thread : threads_)
+        thread.join();
+      threads_.clear();
+      seconds_ = start_.GetTimeStamp<std::chrono::microseconds>() / 1e6;
+    }
+    return seconds_ > 0 ? static_cast<double>(bytes_) / seconds_ / 1e9 : 0;
+  }
+
+private:
+  void stream(uint8_t *buff) {
+    const size_t half = buffer_size_ / 2 / kHogBlockSize * kHogBlockSize;
+    uint64_t sum = 0;
+    for (size_t offset = 0; !stop_;) {
+      switch (pattern_) {
+      case kHogRead: {
+        auto words = reinterpret_cast<const uint64_t *>(buff + offset);
+        for (size_t i = 0; i < kHogBlockSize / sizeof(uint64_t); ++i)
+          sum += words[i];
+        offset = (offset + kHogBlockSize) % buffer_size_;
+        break;
+      }
+      case kHogWrite:
+        memset(buff + offset, static_cast<int>(sum++), kHogBlockSize);
+        offset = (offset + kHogBlockSize) % buffer_size_;
+        break;
+      case kHogCopy:
+        memcpy(buff + half + offset, buff + offset, kHogBlockSize);
+        offset = (offset + kHogBlockSize) % half;
+        break;
+      }
+      // Copies read and write every byte.
+      bytes_ += pattern_ == kHogCopy ? 2 * kHogBlockSize : kHogBlockSize;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  HogPattern pattern_;
+  size_t buffer_size_;
+  std::vector<std::unique_ptr<uint8_t, MMapDeleter>> buffers_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> bytes_{0};
+  TimeScope start_;
+  double seconds_ = 0;
+};
+
+} // namespace interference
+
+#endif
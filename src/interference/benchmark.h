@@ -0,0 +1,212 @@
+#ifndef _INTERFERENCE_BENCHMARK_H_
+#define _INTERFERENCE_BENCHMARK_H_
+
+#include <cstdarg>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../multi_engine/qpl_parallel.h"
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../util.h"
+#include "aggressors.h"
+
+namespace interference {
+
+enum InterferenceOperation { kInterferenceCompress, kInterferenceDecompress };
+
+enum InterferenceEngine {
+  // CPU reference: qpl_path_software.
+  kInterferenceSoftware,
+  // One hardware job over the whole operation.
+  kInterferenceSingleEngine,
+  // Work queue of kInterferenceChunkSize chunks.
+  kInterferenceMultiEngine
+};
+
+static constexpr size_t kInterferenceChunkSize = 64 * kkB;
+static constexpr size_t kInterferenceInflightJobs = 16;
+// Operations timed before the aggressors start.
+static constexpr size_t kInterferenceBaselineOps = 16;
+
+#define _PARSE_ARGS_INTERFERENCE_                                              \
+  _PARSE_IN                                                                    \
+  auto operation = Inputs;                                                     \
+  auto engine = _PARSE_ARG(int);                                               \
+  auto aggressors = _PARSE_ARG(int);                                           \
+  auto hog_pattern = _PARSE_ARG(int);                                          \
+  auto hog_buffer_size = _PARSE_ARG(size_t);                                   \
+  auto op_size = _PARSE_ARG(size_t);                                           \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+//
+/// Compression or decompression of one source region on the software path,
+/// one engine or a work queue of engines.
+//
+class InterferenceOp {
+public:
+  InterferenceOp(InterferenceOperation operation, InterferenceEngine engine,
+                 const uint8_t *src, size_t size)
+      : operation_(operation), engine_(engine), src_(src), size_(size),
+        compressed_buff_(2 * size, _PAGE_PREFAULT_),
+        decompressed_buff_(size, _PAGE_PREFAULT_),
+        chunks_(multi_engine::make_fixed_chunks(size, kInterferenceChunkSize)) {
+  }
+
+  /// Compress the source once; decompressions restore it.
+  int prepare() {
+    return operation_ == kInterferenceDecompress ? compress() : 0;
+  }
+
+  /// Give the chunks back the output space the previous compression shrank
+  /// them to; needed before every run() of a multi-engine compression.
+  void reset() {
+    if (!resets_chunks())
+      return;
+    for (auto &[chunk, size] : chunks_)
+      chunk.resize(2 * size);
+  }
+
+  /// reset() outside the timed region of @param state and the counted one of
+  /// @param cpu_counters.
+  void reset(benchmark::State &state, CpuCounters &cpu_counters) {
+    if (!resets_chunks())
+      return;
+    state.PauseTiming();
+    cpu_counters.pause();
+    reset();
+    cpu_counters.resume();
+    state.ResumeTiming();
+  }
+
+  int run() {
+    return operation_ == kInterferenceCompress ? compress() : decompress();
+  }
+
+  int verify() {
+    if (operation_ == kInterferenceCompress && decompress())
+      return -1;
+    return memcmp(src_, decompressed_buff_.data(), size_) == 0 ? 0 : -1;
+  }
+
+private:
+  bool resets_chunks() const {
+    return operation_ == kInterferenceCompress &&
+           engine_ == kInterferenceMultiEngine;
+  }
+
+  int compress() {
+    if (engine_ == kInterferenceMultiEngine)
+      return multi_engine::compress_queued(multi_engine::kParallelDynamic,
+                                           src_, size_,
+                                           kInterferenceInflightJobs, &chunks_);
+    compressed_size_ = compressed_buff_.size();
+    return single_engine::compress(path(), qpl_default_level,
+                                   single_engine::kModeDynamic, nullptr,
+                                   nullptr, src_, size_,
+                                   compressed_buff_.data(), &compressed_size_);
+  }
+
+  int decompress() {
+    size_t decompressed_size = 0;
+    int ret =
+        engine_ == kInterferenceMultiEngine
+            ? multi_engine::decompress_queued(
+                  chunks_, decompressed_buff_.data(),
+                  kInterferenceInflightJobs, &decompressed_size)
+            : single_engine::decompress(
+                  path(), single_engine::kModeDynamic, nullptr, 0,
+                  compressed_buff_.data(), compressed_size_,
+                  decompressed_buff_.data(), size_, &decompressed_size);
+    return ret == 0 && decompressed_size == size_ ? 0 : -1;
+  }
+
+  qpl_path_t path() const {
+    return engine_ == kInterferenceSoftware ? qpl_path_software
+                                            : qpl_path_hardware;
+  }
+
+  InterferenceOperation operation_;
+  InterferenceEngine engine_;
+  const uint8_t *src_;
+  size_t size_;
+  std::vector<uint8_t> compressed_buff_;
+  size_t compressed_size_ = 0;
+  std::vector<uint8_t> decompressed_buff_;
+  multi_engine::CompressedFormat chunks_;
+};
+
+//
+/// Latency and throughput of compressing or decompressing op_size bytes
+/// while @param aggressors threads pinned to other CPUs stream over
+/// hog_buffer_size buffers of their own, relative to the latency measured
+/// before they start.
+//
+auto BM_BandwidthInterference = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_INTERFERENCE_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  ScopedPin pin;
+  InterferenceOp op(static_cast<InterferenceOperation>(operation),
+                    static_cast<InterferenceEngine>(engine), source_buff,
+                    op_size);
+  if (op.prepare()) {
+    state.SkipWithMessage("Failed to compress.");
+    return;
+  }
+
+  // Baseline on an idle memory bus.
+  std::vector<double> baseline_us;
+  for (size_t i = 0; i < kInterferenceBaselineOps; ++i) {
+    op.reset();
+    TimeScope latency;
+    if (op.run()) {
+      state.SkipWithMessage("Failed to run the baseline.");
+      return;
+    }
+    baseline_us.push_back(latency.GetTimeStamp<std::chrono::nanoseconds>() /
+                          1000.0);
+  }
+
+  // Benchmark.
+  BandwidthHogs hogs(static_cast<size_t>(aggressors),
+                     static_cast<HogPattern>(hog_pattern), hog_buffer_size);
+  std::vector<double> latencies_us;
+  // The aggressors run on other threads: count this one only.
+  CountedLoop loop(state, op_size, kScopeThread);
+  for (auto _ : loop) {
+    op.reset(state, loop);
+    TimeScope latency;
+    if (op.run())
+      state.SkipWithMessage("Failed to run the operation.");
+    latencies_us.push_back(latency.GetTimeStamp<std::chrono::nanoseconds>() /
+                           1000.0);
+  }
+  state.counters["Aggressor GB/s"] = hogs.stop();
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(op_size));
+  const double baseline_p50 = percentile(baseline_us, 50);
+  const double baseline_p99 = percentile(baseline_us, 99);
+  const double p50 = percentile(latencies_us, 50);
+  const double p99 = percentile(latencies_us, 99);
+  state.counters["Baseline p50, us"] = baseline_p50;
+  state.counters["Latency p50, us"] = p50;
+  state.counters["Latency p99, us"] = p99;
+  state.counters["Slowdown p50"] = baseline_p50 > 0 ? p50 / baseline_p50 : 0;
+  state.counters["Slowdown p99"] = baseline_p99 > 0 ? p99 / baseline_p99 : 0;
+
+  // Verify.
+  if (op.verify())
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace interference
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef _BENCHMARK_CACHE_POLLUTION_H_
+#define _BENCHMARK_CACHE_POLLUTION_H_
+
+#include <cstdarg>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../util.h"
+#include "benchmark.h"
+#include "victim.h"
+
+namespace interference {
+
+// How long the victim runs alone before the decompressions start.
+static constexpr auto kVictimBaselineTime = std::chrono::milliseconds(200);
+
+#define _PARSE_ARGS_CACHE_POLLUTION_                                           \
+  _PARSE_IN                                                                    \
+  auto engine = Inputs;                                                        \
+  auto victim_kind = _PARSE_ARG(int);                                          \
+  auto victim_set_size = _PARSE_ARG(size_t);                                   \
+  auto op_size = _PARSE_ARG(size_t);                                           \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+/// Victim operations and LLC misses over a measurement window.
+struct VictimSample {
+  double seconds = 0;
+  uint64_t ops = 0;
+  double llc_misses = 0;
+
+  double mops() const {
+    return seconds > 0 ? static_cast<double>(ops) / seconds / 1e6 : 0;
+  }
+  double misses_per_op() const {
+    return ops > 0 ? llc_misses / static_cast<double>(ops) : 0;
+  }
+};
+
+//
+/// Slowdown and LLC misses of a co-located victim (pointer chase or hash
+/// lookups over victim_set_size bytes on another CPU) while op_size bytes are
+/// decompressed on the software path, one engine or a work queue of engines,
+/// compared with the victim running alone.
+//
+auto BM_CachePollution = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_CACHE_POLLUTION_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  ScopedPin pin;
+  InterferenceOp op(kInterferenceDecompress,
+                    static_cast<InterferenceEngine>(engine), source_buff,
+                    op_size);
+  if (op.prepare()) {
+    state.SkipWithMessage("Failed to compress.");
+    return;
+  }
+
+  VictimWorkload victim(static_cast<VictimKind>(victim_kind), victim_set_size);
+  // Let the victim load its working set into the LLC.
+  std::this_thread::sleep_for(kVictimBaselineTime);
+
+  // Baseline: the victim alone.
+  VictimSample baseline, loaded;
+  {
+    CpuCounters victim_counters(kScopeThread, victim.tid());
+    const uint64_t ops = victim.ops();
+    TimeScope time;
+    std::this_thread::sleep_for(kVictimBaselineTime);
+    baseline.ops = victim.ops() - ops;
+    baseline.seconds = time.GetTimeStamp<std::chrono::microseconds>() / 1e6;
+    victim_counters.pause();
+    baseline.llc_misses = victim_counters.count(kEventLlcMisses);
+  }
+
+  // Benchmark.
+  CpuCounters victim_counters(kScopeThread, victim.tid());
+  const uint64_t ops = victim.ops();
+  TimeScope time;
+  // The victim runs on another thread: count this one only.
+  CountedLoop loop(state, op_size, kScopeThread);
+  for (auto _ : loop) {
+    if (op.run())
+      state.SkipWithMessage("Failed to decompress.");
+  }
+  loaded.ops = victim.ops() - ops;
+  loaded.seconds = time.GetTimeStamp<std::chrono::microseconds>() / 1e6;
+  victim_counters.pause();
+  loaded.llc_misses = victim_counters.count(kEventLlcMisses);
+
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(op_size));
+  state.counters["Victim Baseline Mops/s"] = baseline.mops();
+  state.counters["Victim Mops/s"] = loaded.mops();
+  state.counters["Victim Slowdown"] =
+      loaded.mops() > 0 ? baseline.mops() / loaded.mops() : 0;
+  state.counters["Victim Baseline LLC Misses per Op"] =
+      baseline.misses_per_op();
+  state.counters["Victim LLC Misses per Op"] = loaded.misses_per_op();
+  state.counters["Victim Perf Events"] = victim_counters.opened();
+
+  // Verify.
+  if (op.verify())
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace interference
+
+#endif
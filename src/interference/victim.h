@@ -0,0 +1,135 @@
+#ifndef _VICTIM_H_
+#define _VICTIM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../synthetic_dataset.h"
+#include "../util.h"
+#include "aggressors.h"
+
+namespace interference {
+
+enum VictimKind {
+  // Dependent loads along a random cycle through the cache lines of the set.
+  kVictimPointerChase,
+  // Lookups of random keys in an open-addressing hash table filling the set.
+  kVictimHashLookup
+};
+
+static constexpr size_t kVictimLineSize = 64;
+// Operations between updates of the shared operation count.
+static constexpr size_t kVictimBatch = 1024;
+static constexpr uint64_t kVictimSeed = 42;
+
+//
+/// A co-located tenant: a thread pinned to a spare CPU running a
+/// latency-bound loop over a working set of working_set_size bytes, sized
+/// against the LLC, until destroyed. Its throughput reflects how much of the
+/// set other work evicts from the LLC.
+//
+class VictimWorkload {
+public:
+  VictimWorkload(VictimKind kind, size_t working_set_size)
+      : kind_(kind), lines_(std::max<size_t>(working_set_size /
+                                                 kVictimLineSize,
+                                             2)) {
+    synthetic::SplitMix64 rng(kVictimSeed);
+    if (kind_ == kVictimPointerChase) {
+      // Sattolo's algorithm: a single cycle through all the lines.
+      next_.resize(lines_ * kLineWords);
+      std::vector<uint64_t> order(lines_);
+      std::iota(order.begin(), order.end(), 0);
+      for (size_t i = lines_ - 1; i > 0; --i)
+        std::swap(order[i], order[rng() % i]);
+      for (size_t i = 0; i < lines_; ++i)
+        next_[order[i] * kLineWords] = order[(i + 1) % lines_] * kLineWords;
+    } else {
+      // Half full, one key per line.
+      next_.assign(lines_ * kLineWords, 0);
+      for (size_t i = 0; i < lines_ / 2; ++i)
+        insert(rng() | 1);
+    }
+    const auto cpus = spare_cpus(1);
+    thread_ = std::thread([this] { run(); });
+    if (!cpus.empty())
+      pin_thread(thread_, cpus[0]);
+    while (tid_ == 0)
+      std::this_thread::yield();
+  }
+
+  ~VictimWorkload() {
+    stop_ = true;
+    thread_.join();
+  }
+
+  VictimWorkload(const VictimWorkload &) = delete;
+  VictimWorkload &operator=(const VictimWorkload &) = delete;
+
+  /// Thread id of the victim, to count its events.
+  pid_t tid() const { return tid_; }
+
+  /// Operations completed so far.
+  uint64_t ops() const { return ops_; }
+
+private:
+  static constexpr size_t kLineWords = kVictimLineSize / sizeof(uint64_t);
+
+  void insert(uint64_t key) {
+    for (size_t line = key % lines_;; line = (line + 1) % lines_)
+      if (next_[line * kLineWords] == 0) {
+        next_[line * kLineWords] = key;
+        return;
+      }
+  }
+
+  void run() {
+    tid_ = static_cast<pid_t>(syscall(SYS_gettid));
+    synthetic::SplitMix64 rng(kVictimSeed + 1);
+    uint64_t position = 0, found = 0;
+    while (!stop_) {
+      if (kind_ == kVictimPointerChase) {
+        for (size_t i = 0; i < kVictimBatch; ++i)
+          position = next_[position];
+      } else {
+        for (size_t i = 0; i < kVictimBatch; ++i) {
+          const uint64_t key = rng() | 1;
+          for (size_t line = key % lines_;; line = (line + 1) % lines_) {
+            const uint64_t slot = next_[line * kLineWords];
+            if (slot == key || slot == 0) {
+              found += slot == key;
+              break;
+            }
+          }
+        }
+      }
+      ops_.fetch_add(kVictimBatch, std::memory_order_relaxed);
+    }
+    benchmark::DoNotOptimize(position);
+    benchmark::DoNotOptimize(found);
+  }
+
+  VictimKind kind_;
+  size_t lines_;
+  // Pointer chase: index of the next line in the first word of every line.
+  // Hash lookup: the key of every slot (0 if empty).
+  std::vector<uint64_t> next_;
+  std::thread thread_;
+  std::atomic<pid_t> tid_{0};
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> ops_{0};
+};
+
+} // namespace interference
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef _JOB_SUBMITTER_H_
+#define _JOB_SUBMITTER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "util.h"
+#include "wait_strategy.h"
+
+#include "qpl/qpl.h"
+
+//
+/// What to do when the hardware queues reject a job submission.
+//
+struct SubmitPolicy {
+  // Keep retrying with bounded exponential PAUSE backoff for this long;
+  // 0 - fail at the first rejection.
+  std::chrono::microseconds deadline{1000};
+  // Once the deadline expires, execute the job on qpl_path_software instead
+  // of failing (not possible for jobs using Huffman tables).
+  bool software_fallback = false;
+};
+
+//
+/// Process-wide submission counters.
+//
+struct SubmitStats {
+  // Jobs rejected at least once with QPL_STS_QUEUES_ARE_BUSY_ERR.
+  std::atomic<uint64_t> rejected{0};
+  // Resubmissions after a rejection.
+  std::atomic<uint64_t> retries{0};
+  // Jobs executed on qpl_path_software after the deadline.
+  std::atomic<uint64_t> fallbacks{0};
+  // Jobs given up after the deadline.
+  std::atomic<uint64_t> failed{0};
+
+  static SubmitStats &instance() {
+    static SubmitStats stats;
+    return stats;
+  }
+};
+
+/// Execute the operation described by @param job on qpl_path_software and
+/// report its results in @param job. @param software_job_buffer holds the
+/// software job, initialized on first use; the caller finalizes it.
+static qpl_status
+execute_on_software_path(qpl_job *job,
+                         std::unique_ptr<uint8_t[]> *software_job_buffer) {
+  if (*software_job_buffer == nullptr) {
+    uint32_t job_size = 0;
+    qpl_status status = qpl_get_job_size(qpl_path_software, &job_size);
+    if (status != QPL_STS_OK)
+      return status;
+    *software_job_buffer = std::make_unique<uint8_t[]>(job_size);
+    status = qpl_init_job(qpl_path_software, reinterpret_cast<qpl_job *>(
+                                                 software_job_buffer->get()));
+    if (status != QPL_STS_OK) {
+      software_job_buffer->reset();
+      return status;
+    }
+  }
+
+  auto software_job = reinterpret_cast<qpl_job *>(software_job_buffer->get());
+  software_job->op = job->op;
+  software_job->level = job->level;
+  software_job->flags = job->flags;
+  software_job->next_in_ptr = job->next_in_ptr;
+  software_job->available_in = job->available_in;
+  software_job->next_out_ptr = job->next_out_ptr;
+  software_job->available_out = job->available_out;
+  software_job->ignore_end_bits = job->ignore_end_bits;
+  software_job->crc64_poly = job->crc64_poly;
+  software_job->huffman_table = nullptr;
+  qpl_status status = qpl_execute_job(software_job);
+  job->total_in = software_job->total_in;
+  job->total_out = software_job->total_out;
+  job->crc64 = software_job->crc64;
+  return status;
+}
+
+//
+/// Overload-safe replacement of qpl_submit_job()/qpl_check_job() for
+/// hardware jobs: rejected submissions are retried according to a
+/// SubmitPolicy and possibly completed in software, in which case check()
+/// reports the software status.
+//
+class JobSubmitter {
+public:
+  explicit JobSubmitter(const SubmitPolicy &policy = SubmitPolicy())
+      : policy_(policy) {}
+
+  ~JobSubmitter() {
+    if (software_job_ != nullptr)
+      qpl_fini_job(reinterpret_cast<qpl_job *>(software_job_.get()));
+  }
+
+  JobSubmitter(const JobSubmitter &) = delete;
+  JobSubmitter &operator=(const JobSubmitter &) = delete;
+
+  /// Submit @param job; QPL_STS_OK if it was accepted by the hardware or
+  /// completed in software.
+  qpl_status submit(qpl_job *job) {
+    forget(job);
+    qpl_status status = qpl_submit_job(job);
+    if (status != QPL_STS_QUEUES_ARE_BUSY_ERR)
+      return status;
+
+    auto &stats = SubmitStats::instance();
+    ++stats.rejected;
+    TimeScope time;
+    CompletionWaiter backoff(kWaitPauseBackoff);
+    while (time.GetTimeStamp<std::chrono::microseconds>() <
+           policy_.deadline.count()) {
+      backoff.wait();
+      ++stats.retries;
+      status = qpl_submit_job(job);
+      if (status != QPL_STS_QUEUES_ARE_BUSY_ERR)
+        return status;
+    }
+
+    if (!policy_.software_fallback || job->huffman_table != nullptr) {
+      ++stats.failed;
+      return status;
+    }
+    ++stats.fallbacks;
+    software_completed_.push_back(
+        std::make_pair(job, execute_on_software_path(job, &software_job_)));
+    return QPL_STS_OK;
+  }
+
+  /// qpl_check_job() counterpart for the jobs passed to submit(); the status
+  /// of a job completed in software is kept until the job is submitted
+  /// again, so that it can be checked any number of times.
+  qpl_status check(qpl_job *job) {
+    for (const auto &[completed_job, status] : software_completed_)
+      if (completed_job == job)
+        return status;
+    return qpl_check_job(job);
+  }
+
+private:
+  void forget(qpl_job *job) {
+    for (size_t i = 0; i < software_completed_.size(); ++i) {
+      if (software_completed_[i].first != job)
+        continue;
+      software_completed_[i] = software_completed_.back();
+      software_completed_.pop_back();
+      return;
+    }
+  }
+
+  SubmitPolicy policy_;
+  std::unique_ptr<uint8_t[]> software_job_;
+  // Jobs completed in software since their last submission.
+  std::vector<std::pair<qpl_job *, qpl_status>> software_completed_;
+};
+
+#endif
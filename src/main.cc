@@ -2,170 +2,1094 @@
 
 #include <benchmark/benchmark.h>
 
+#include "async/benchmark.h"
+#include "benchmark_registry.h"
 #include "full_system/benchmark_full_system.h"
+#include "interference/benchmark.h"
+#include "interference/benchmark_cache_pollution.h"
 #include "multi_engine/benchmark.h"
+#include "multi_engine/benchmark_mixed.h"
+#include "multi_engine/benchmark_overload.h"
+#include "multi_engine/benchmark_wait_strategy.h"
 #include "single_engine/benchmark.h"
+#include "single_engine/benchmark_fault_density.h"
 #include "single_engine/benchmark_page_faults.h"
+#include "single_engine/benchmark_pareto.h"
+#include "single_engine/benchmark_stream.h"
+#include "snapshot/benchmark.h"
+#include "snapshot/benchmark_capture.h"
+#include "snapshot/benchmark_dedup.h"
+#include "snapshot/benchmark_delta.h"
+#include "snapshot/benchmark_incremental.h"
+#include "snapshot/benchmark_layout.h"
+#include "synthetic_dataset.h"
 
 #include <gflags/gflags.h>
 
+// Benchmark matrix.
+DEFINE_string(benchmark_families, "all",
+              "Comma-separated list of benchmark families to register: "
+              "single_engine, single_engine_canned, pareto, multi_engine, "
+              "multi_engine_queued, wait_strategy, async, dedup, delta, "
+              "page_faults, fault_density, full_system, snapshot_write, "
+              "snapshot_restore, overload, mixed, incremental, capture, "
+              "layout, interference, cache_pollution, stream; or 'all'.");
+DEFINE_string(corpus_datasets, "dataset/silesia_tmp,dataset/snapshots_tmp",
+              "Comma-separated list of corpus dataset directories.");
+DEFINE_string(synthetic_datasets, "",
+              "Comma-separated list of synthetic snapshot datasets as "
+              "<size_mb>:<zero_page_fraction>:<duplicate_page_fraction>:"
+              "<target_compression_ratio>, e.g. 2048:0.3:0.1:3.0; "
+              "below 4096 MB, the input limit of one job.");
+DEFINE_uint64(synthetic_seed, 42, "Seed of the synthetic datasets.");
+DEFINE_double(synthetic_entropy_mean_bits, 6.0,
+              "Mean per-page symbol entropy of the synthetic datasets.");
+DEFINE_double(synthetic_entropy_stddev_bits, 1.5,
+              "Standard deviation of the per-page symbol entropy of the "
+              "synthetic datasets.");
+DEFINE_string(pareto_sizes_kb, "4,64,1024,0",
+              "Input sizes (kB, cut from the start of every corpus file; 0: "
+              "the whole file) of the pareto benchmarks.");
+DEFINE_string(multi_engine_jobs, "1,2,4,6,8,10,12,14,16,18,20,22,24,26",
+              "Job counts for the multi-engine benchmarks.");
+DEFINE_string(multi_engine_chunk_sizes_kb, "4,8,16,32,64,128,256,512,1024,2048",
+              "Chunk sizes (kB) for the work-queue multi-engine benchmarks.");
+DEFINE_string(multi_engine_inflight_jobs, "1,2,4,8,16,32",
+              "In-flight job counts for the work-queue multi-engine "
+              "benchmarks.");
+DEFINE_string(multi_engine_output_layouts, "0,1",
+              "Output layouts of the multi-engine queued benchmarks "
+              "(0: per-chunk buffers, 1: contiguous arena).");
+DEFINE_string(cache_states, "0,1,2",
+              "Cache states of the single-engine, canned and multi-engine "
+              "benchmarks (0: hot, 1: flushed, 2: rotating buffers).");
+DEFINE_string(wait_strategy_jobs, "1,8",
+              "Job counts for the wait strategy benchmarks; 1 uses the single "
+              "engine path.");
+DEFINE_string(async_concurrency, "1,16,256,1024,4096",
+              "Numbers of concurrent page-restore coroutines.");
+DEFINE_int32(async_max_inflight_jobs, 128,
+             "Maximum number of hardware jobs in flight in the coroutine "
+             "reactor.");
+DEFINE_string(delta_mutated_percent, "1,5,10,25,50",
+              "Shares (%) of the pages mutated in the derived images of the "
+              "delta compression benchmarks.");
+DEFINE_string(fault_density_percent, "0,1,5,10,25,50,75,100",
+              "Shares (%) of the source and destination pages left to fault "
+              "in the fault density benchmarks.");
+DEFINE_string(overload_threads, "1,4,16,64",
+              "Thread counts oversubscribing the work queues in the overload "
+              "benchmarks.");
+DEFINE_string(overload_inflight_jobs, "32",
+              "In-flight job counts per thread in the overload benchmarks.");
+DEFINE_uint64(overload_op_size_kb, 256,
+              "Size (kB) of one operation in the overload benchmarks.");
+DEFINE_int32(submit_deadline_us, 100,
+             "How long rejected submissions are retried before failing or "
+             "falling back to software in the overload benchmarks.");
+DEFINE_string(mixed_read_percent, "0,50,90,99,100",
+              "Shares (%) of decompressions in the mixed workload benchmarks.");
+DEFINE_string(mixed_compress_sizes_kb, "1024",
+              "Sizes (kB) of the compressions in the mixed workload "
+              "benchmarks.");
+DEFINE_string(mixed_decompress_sizes_kb, "4",
+              "Sizes (kB) of the decompressions in the mixed workload "
+              "benchmarks.");
+DEFINE_string(mixed_inflight_jobs, "16",
+              "In-flight job counts in the mixed workload benchmarks.");
+DEFINE_string(incremental_region_sizes_kb, "1048576",
+              "Sizes (kB) of the regions snapshotted incrementally.");
+DEFINE_string(incremental_chunk_sizes_kb, "4,64,256",
+              "Chunk sizes (kB) of the incremental snapshot store.");
+DEFINE_string(incremental_dirty_percent, "0,1,5,25,100",
+              "Shares (%) of the pages dirtied between incremental "
+              "snapshots.");
+DEFINE_string(capture_target_sizes_mb, "256,1024",
+              "Sizes (MB) of the synthetic images held by the processes "
+              "captured in the capture benchmarks.");
+DEFINE_string(capture_chunk_sizes_kb, "256",
+              "Chunk sizes (kB) of the captured process images.");
+DEFINE_uint64(capture_batch_size_kb, 4096,
+              "Memory read with one batch of process_vm_readv() calls by the "
+              "capture benchmarks.");
+DEFINE_string(capture_inflight_jobs, "16",
+              "In-flight compression job counts for the capture benchmarks.");
+DEFINE_uint64(capture_target_mb, 0,
+              "Internal: run as the target process of the capture benchmarks "
+              "holding a synthetic image of this size (MB).");
+DEFINE_string(layout_image_sizes_kb, "262144",
+              "Sizes (kB) of the images restored up to their working set.");
+DEFINE_string(layout_chunk_sizes_kb, "64,256",
+              "Chunk sizes (kB) of the snapshots restored up to their "
+              "working set.");
+DEFINE_string(layout_working_set_percent, "5,20",
+              "Shares (%) of the pages in the synthetic access traces.");
+DEFINE_string(layout_trace_file, "",
+              "Recorded access trace (one guest address per line) replacing "
+              "the synthetic ones.");
+DEFINE_string(interference_aggressors, "0,1,2,4,8,16",
+              "Numbers of memory bandwidth hog threads running next to the "
+              "interference benchmarks.");
+DEFINE_string(interference_patterns, "0,2",
+              "Access patterns of the bandwidth hogs (0: read, 1: write, "
+              "2: copy).");
+DEFINE_string(interference_op_sizes_kb, "64,4096",
+              "Sizes (kB) of the operations of the interference benchmarks.");
+DEFINE_uint64(interference_hog_buffer_mb, 256,
+              "Size (MB) of the buffer every bandwidth hog streams over.");
+DEFINE_string(cache_pollution_sizes_kb, "16384,65536,262144",
+              "Sizes (kB) of the decompressions running next to the victim "
+              "of the cache pollution benchmarks.");
+DEFINE_string(cache_pollution_victim_set_kb, "0",
+              "Working set sizes (kB) of the victim of the cache pollution "
+              "benchmarks; 0 for the LLC size.");
+DEFINE_string(stream_window_sizes_kb, "4,16,64,256,1024,4096",
+              "Window and output buffer sizes (kB) of the stream benchmarks.");
+DEFINE_string(stream_sizes_mb, "64,512,2048",
+              "Stream sizes (MB, the full system dataset repeated) of the "
+              "stream benchmarks; one job streams less than 4096 MB.");
+DEFINE_string(full_system_dataset, "dataset/wiki_tmp",
+              "Dataset directory with a single file for the full system "
+              "benchmarks.");
+DEFINE_string(full_system_read_sizes_kb,
+              "32,64,128,256,512,1024,2048,4096,8192,16384,32768,65536,131072,"
+              "232144",
+              "Read sizes (kB) for the full system benchmarks.");
+DEFINE_string(snapshot_chunk_sizes_kb, "256",
+              "Chunk sizes (kB) of the seekable snapshot files.");
+DEFINE_string(snapshot_inflight_jobs, "8",
+              "In-flight compression job counts for the snapshot write "
+              "benchmarks.");
+DEFINE_string(snapshot_restore_counts, "1,2,4,8,16,32,64",
+              "Numbers of snapshots restored concurrently.");
+DEFINE_string(snapshot_restore_sizes_kb, "16384",
+              "Sizes (kB) of the concurrently restored snapshots.");
+DEFINE_int32(snapshot_readahead_chunks, 4,
+             "Chunks read ahead of the decompression by every snapshot "
+             "restore.");
+
+// A dataset-driven benchmark: its name given the dataset entropy and how to
+// register it once the dataset is materialized.
+struct DatasetBenchmark {
+  std::function<std::string(const std::string &entropy)> name;
+  std::function<void(const std::string &name)> reg;
+};
+
 // Benchmarks:
 //  - qpl_path_software vs qpl_path_hardware for kModeFixed and kModeDynamic for
 //  each benchmarks from corpus;
+//  - qpl_path_software vs qpl_path_hardware for every CompressionMode and
+//  qpl_compression_levels (qpl_high_level on the software path only) for
+//  several input sizes cut from each benchmark from corpus.
 //  - qpl_path_hardware for kContinious, kNaive, and kCanned for each benchmarks
 //  from corpus with 4~kB split for each benchmark;
 //  - qpl_path_hardware for kParallelFixed, kParallelDynamic, and
 //  kParallelCanned for each benchmark from corpus with job parallezation.
-//  - qpl_path_hardware for kMajorPageFaults, kMinorPageFaults, kAtsMiss, and
-//  kNoFaults for each benchmark from corpus.
-//  - full system (see code).
-void register_benchmarks_with_corpus_datasets() {
-  static std::map<std::string, std::tuple<uint8_t *, size_t, double>>
-      source_buffs;
-
-  CompressionDataset silesia_dataset =
-      load_corpus_dataset("dataset/silesia_tmp");
-  for (auto const &[mem_size, name, entropy, source_buff] : silesia_dataset) {
-    source_buffs[name] = std::make_tuple(source_buff, mem_size, entropy);
-  }
-
-  CompressionDataset snapshots_dataset =
-      load_corpus_dataset("dataset/snapshots_tmp");
-  for (auto const &[mem_size, name, entropy, source_buff] : snapshots_dataset) {
-    source_buffs[name] = std::make_tuple(source_buff, mem_size, entropy);
-  }
-
-  for (const auto &[benchmark_name, benchmark_data] : source_buffs) {
-    auto const [source_buff, mem_size, entropy] = source_buffs[benchmark_name];
+//  - the three above with hot, flushed (clflushopt) and rotating source and
+//  destination buffers.
+//  - qpl_path_hardware work queue of fixed-size chunks for kParallelFixed,
+//  kParallelDynamic, and kParallelCanned: chunk size x in-flight jobs.
+//  - qpl_path_hardware completion wait strategies for single and multiple
+//  engines with CPU time consumed.
+//  - qpl_path_hardware 4 kB page restore with concurrent coroutines on one
+//  thread vs the blocking wrappers.
+//  - 4 kB page deduplication (software hash vs IAA CRC64) and restore of
+//  the deduplicated image vs the plain one.
+//  - delta compression of a derived image against its base (the corpus file)
+//  vs full compression, for several shares of mutated pages.
+//  - qpl_path_hardware for kMajorPageFaults, kMinorPageFaults, kAtsMiss,
+//  kNoFaults, kFaultRecovery (touch-and-resubmit), and kPrefaultAll for each
+//  benchmark from corpus; kNoFaults also reports the cost and benefit of each
+//  translation warming method.
+//  - software, single engine and multi-engine latency vs the share of
+//  faulting source and destination pages (strided or random).
+std::vector<DatasetBenchmark>
+describe_corpus_benchmarks(const BenchmarkRegistry &registry,
+                           std::shared_ptr<LazyCorpusFile> file) {
+  std::vector<DatasetBenchmark> benchmarks;
+  const auto mem_size = file->size();
+  const auto name_prefix = [file, mem_size](const std::string &family,
+                                            const std::string &entropy) {
+    return family + std::to_string(mem_size / kkB) + "kB" + "_name_" +
+           file->name() + "_entropy_" + entropy;
+  };
+  // Hot runs keep the names they had before the cache state was added.
+  const auto cache_states = parse_number_list_flag<int>(FLAGS_cache_states);
+  const auto cache_suffix = [](int cache_state) {
+    return cache_state == kCacheHot ? std::string()
+                                    : "_cache_" + std::to_string(cache_state);
+  };
 
-    // #1
-    qpl_huffman_table_t empty_table = nullptr;
+  // #1
+  if (registry.family_enabled("single_engine")) {
     for (const auto execution_path : {qpl_path_software, qpl_path_hardware}) {
       for (const auto compression_mode :
            {single_engine::kModeFixed, single_engine::kModeDynamic}) {
-        benchmark::RegisterBenchmark(
-            "BM_SingleEngineBlocking_Compress_" +
-                std::to_string(mem_size / kkB) + "kB" + "_name_" +
-                benchmark_name + "_entropy_" + std::to_string(entropy) +
-                "_mode_" + std::to_string(compression_mode) +
-                (execution_path == qpl_path_software ? "_qpl_path_software"
-                                                     : "_qpl_path_hardware"),
-            single_engine::BM_SingleEngineBlocking_Compress, execution_path,
-            static_cast<int>(compression_mode), mem_size, source_buff,
-            empty_table);
-        benchmark::RegisterBenchmark(
-            "BM_SingleEngineBlocking_DeCompress_" +
-                std::to_string(mem_size / kkB) + "kB" + "_name_" +
-                benchmark_name + "_entropy_" + std::to_string(entropy) +
-                +"_mode_" + std::to_string(compression_mode) +
-                +(execution_path == qpl_path_software ? "_qpl_path_software"
-                                                      : "_qpl_path_hardware"),
-            single_engine::BM_SingleEngineBlocking_DeCompress, execution_path,
-            static_cast<int>(compression_mode), mem_size, source_buff,
-            empty_table);
+        for (const int cache_state : cache_states) {
+          const std::string suffix =
+              "_mode_" + std::to_string(compression_mode) +
+              (execution_path == qpl_path_software ? "_qpl_path_software"
+                                                   : "_qpl_path_hardware") +
+              cache_suffix(cache_state);
+          benchmarks.push_back(
+              {[=](const std::string &entropy) {
+                 return name_prefix("BM_SingleEngineBlocking_Compress_",
+                                    entropy) +
+                        suffix;
+               },
+               [=](const std::string &name) {
+                 qpl_huffman_table_t empty_table = nullptr;
+                 benchmark::RegisterBenchmark(
+                     name, single_engine::BM_SingleEngineBlocking_Compress,
+                     execution_path, static_cast<int>(compression_mode),
+                     mem_size, file->data(), empty_table, cache_state);
+               }});
+          benchmarks.push_back(
+              {[=](const std::string &entropy) {
+                 return name_prefix("BM_SingleEngineBlocking_DeCompress_",
+                                    entropy) +
+                        suffix;
+               },
+               [=](const std::string &name) {
+                 qpl_huffman_table_t empty_table = nullptr;
+                 benchmark::RegisterBenchmark(
+                     name, single_engine::BM_SingleEngineBlocking_DeCompress,
+                     execution_path, static_cast<int>(compression_mode),
+                     mem_size, file->data(), empty_table, cache_state);
+               }});
+        }
       }
     }
+  }
 
-    // #2
+  // #2
+  if (registry.family_enabled("single_engine_canned")) {
     for (const auto compression_mode :
          {single_engine_canned::kContinious, single_engine_canned::kNaive,
           single_engine_canned::kCanned}) {
-      benchmark::RegisterBenchmark(
-          "BM_SingleEngineBlocking_Compress_Canned_" +
-              std::to_string(mem_size / kkB) + "kB" + "_name_" +
-              benchmark_name + "_entropy_" + std::to_string(entropy) +
-              "_mode_" + std::to_string(compression_mode),
-          single_engine::BM_SingleEngineBlocking_CompressCanned,
-          static_cast<int>(compression_mode), mem_size, source_buff);
-      benchmark::RegisterBenchmark(
-          "BM_SingleEngineBlocking_DeCompress_Canned_" +
-              std::to_string(mem_size / kkB) + "kB" + "_name_" +
-              benchmark_name + "_entropy_" + std::to_string(entropy) +
-              "_mode_" + std::to_string(compression_mode),
-          single_engine::BM_SingleEngineBlocking_DeCompressCanned,
-          static_cast<int>(compression_mode), mem_size, source_buff);
+      for (const int cache_state : cache_states) {
+        const std::string suffix = "_mode_" +
+                                   std::to_string(compression_mode) +
+                                   cache_suffix(cache_state);
+        benchmarks.push_back(
+            {[=](const std::string &entropy) {
+               return name_prefix("BM_SingleEngineBlocking_Compress_Canned_",
+                                  entropy) +
+                      suffix;
+             },
+             [=](const std::string &name) {
+               benchmark::RegisterBenchmark(
+                   name, single_engine::BM_SingleEngineBlocking_CompressCanned,
+                   static_cast<int>(compression_mode), mem_size, file->data(),
+                   cache_state);
+             }});
+        benchmarks.push_back(
+            {[=](const std::string &entropy) {
+               return name_prefix("BM_SingleEngineBlocking_DeCompress_Canned_",
+                                  entropy) +
+                      suffix;
+             },
+             [=](const std::string &name) {
+               benchmark::RegisterBenchmark(
+                   name,
+                   single_engine::BM_SingleEngineBlocking_DeCompressCanned,
+                   static_cast<int>(compression_mode), mem_size, file->data(),
+                   cache_state);
+             }});
+      }
+    }
+  }
+
+  // #2.1
+  if (registry.family_enabled("pareto")) {
+    // Sizes beyond the file are skipped, not clamped, so that every point of
+    // the frontier is registered once.
+    std::vector<size_t> source_sizes;
+    for (const auto size_kb :
+         parse_number_list_flag<size_t>(FLAGS_pareto_sizes_kb)) {
+      const size_t source_size = size_kb ? size_kb * kkB : mem_size;
+      if (source_size > mem_size ||
+          std::find(source_sizes.begin(), source_sizes.end(), source_size) !=
+              source_sizes.end())
+        continue;
+      source_sizes.push_back(source_size);
+      for (const auto execution_path : {qpl_path_software, qpl_path_hardware}) {
+        for (const auto compression_mode :
+             {single_engine::kModeFixed, single_engine::kModeDynamic,
+              single_engine::kModeHuffmanOnly, single_engine::kModeStatic}) {
+          for (const auto level : {qpl_default_level, qpl_high_level}) {
+            if (!single_engine::pareto_level_supported(execution_path,
+                                                       compression_mode, level))
+              continue;
+            const std::string suffix =
+                "_size_" + std::to_string(source_size / kkB) + "kB_mode_" +
+                std::to_string(compression_mode) + "_level_" +
+                std::to_string(level) +
+                (execution_path == qpl_path_software ? "_qpl_path_software"
+                                                     : "_qpl_path_hardware");
+            for (const auto operation : {single_engine::kParetoCompress,
+                                         single_engine::kParetoDecompress}) {
+              const std::string prefix =
+                  operation == single_engine::kParetoCompress
+                      ? "BM_Pareto_Compress_"
+                      : "BM_Pareto_DeCompress_";
+              benchmarks.push_back(
+                  {[=](const std::string &entropy) {
+                     return name_prefix(prefix, entropy) + suffix;
+                   },
+                   [=](const std::string &name) {
+                     benchmark::RegisterBenchmark(
+                         name, single_engine::BM_CompressionPareto,
+                         static_cast<int>(operation), execution_path,
+                         static_cast<int>(compression_mode),
+                         static_cast<int>(level), source_size, file->data());
+                   }});
+            }
+          }
+        }
+      }
     }
+  }
 
-    // #3
+  // #3
+  if (registry.family_enabled("multi_engine")) {
     for (const auto compression_mode :
          {multi_engine::kParallelFixed, multi_engine::kParallelDynamic,
           multi_engine::kParallelCanned}) {
       for (const int job_n :
-           {1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26}) {
-        benchmark::RegisterBenchmark(
-            "BM_MultipleEngine_Compress_" + std::to_string(mem_size / kkB) +
-                "kB" + "_name_" + benchmark_name + "_entropy_" +
-                std::to_string(entropy) + "_jobs_" + std::to_string(job_n) +
-                "_mode_" + std::to_string(compression_mode),
-            multi_engine::BM_MultipleEngine_Compress,
-            static_cast<int>(compression_mode), mem_size, job_n, source_buff);
-        benchmark::RegisterBenchmark(
-            "BM_MultipleEngine_DeCompress_" + std::to_string(mem_size / kkB) +
-                "kB" + "_name_" + benchmark_name + "_entropy_" +
-                std::to_string(entropy) + "_jobs_" + std::to_string(job_n) +
-                "_mode_" + std::to_string(compression_mode),
-            multi_engine::BM_MultipleEngine_DeCompress,
-            static_cast<int>(compression_mode), mem_size, job_n, source_buff);
+           parse_number_list_flag<int>(FLAGS_multi_engine_jobs)) {
+        for (const int cache_state : cache_states) {
+          const std::string suffix =
+              "_jobs_" + std::to_string(job_n) + "_mode_" +
+              std::to_string(compression_mode) + cache_suffix(cache_state);
+          benchmarks.push_back(
+              {[=](const std::string &entropy) {
+                 return name_prefix("BM_MultipleEngine_Compress_", entropy) +
+                        suffix;
+               },
+               [=](const std::string &name) {
+                 benchmark::RegisterBenchmark(
+                     name, multi_engine::BM_MultipleEngine_Compress,
+                     static_cast<int>(compression_mode), mem_size, job_n,
+                     file->data(), cache_state);
+               }});
+          benchmarks.push_back(
+              {[=](const std::string &entropy) {
+                 return name_prefix("BM_MultipleEngine_DeCompress_", entropy) +
+                        suffix;
+               },
+               [=](const std::string &name) {
+                 benchmark::RegisterBenchmark(
+                     name, multi_engine::BM_MultipleEngine_DeCompress,
+                     static_cast<int>(compression_mode), mem_size, job_n,
+                     file->data(), cache_state);
+               }});
+        }
       }
     }
+  }
 
-    // #4
+  // #3.1
+  if (registry.family_enabled("multi_engine_queued")) {
+    for (const auto compression_mode :
+         {multi_engine::kParallelFixed, multi_engine::kParallelDynamic,
+          multi_engine::kParallelCanned}) {
+      for (const auto chunk_size_kb :
+           parse_number_list_flag<size_t>(FLAGS_multi_engine_chunk_sizes_kb)) {
+        for (const int inflight_jobs :
+             parse_number_list_flag<int>(FLAGS_multi_engine_inflight_jobs)) {
+          for (const int output_layout : parse_number_list_flag<int>(
+                   FLAGS_multi_engine_output_layouts)) {
+            const size_t chunk_size = chunk_size_kb * kkB;
+            const std::string suffix =
+                "_chunk_" + std::to_string(chunk_size_kb) + "kB" +
+                "_inflight_" + std::to_string(inflight_jobs) + "_mode_" +
+                std::to_string(compression_mode) + "_output_" +
+                std::to_string(output_layout);
+            benchmarks.push_back(
+                {[=](const std::string &entropy) {
+                   return name_prefix("BM_MultipleEngineQueued_Compress_",
+                                      entropy) +
+                          suffix;
+                 },
+                 [=](const std::string &name) {
+                   benchmark::RegisterBenchmark(
+                       name, multi_engine::BM_MultipleEngineQueued_Compress,
+                       static_cast<int>(compression_mode), mem_size,
+                       chunk_size, inflight_jobs, output_layout,
+                       file->data());
+                 }});
+            benchmarks.push_back(
+                {[=](const std::string &entropy) {
+                   return name_prefix("BM_MultipleEngineQueued_DeCompress_",
+                                      entropy) +
+                          suffix;
+                 },
+                 [=](const std::string &name) {
+                   benchmark::RegisterBenchmark(
+                       name, multi_engine::BM_MultipleEngineQueued_DeCompress,
+                       static_cast<int>(compression_mode), mem_size,
+                       chunk_size, inflight_jobs, output_layout,
+                       file->data());
+                 }});
+          }
+        }
+      }
+    }
+  }
+
+  // #3.2
+  if (registry.family_enabled("wait_strategy")) {
+    for (const int job_n :
+         parse_number_list_flag<int>(FLAGS_wait_strategy_jobs)) {
+      for (const auto wait : {kWaitBlocking, kWaitBusyPoll, kWaitPauseBackoff,
+                              kWaitTpause, kWaitYield, kWaitSleep}) {
+        // Only the single engine path can block inside QPL.
+        if (wait == kWaitBlocking && job_n != 1)
+          continue;
+        const std::string suffix = "_jobs_" + std::to_string(job_n) +
+                                   "_wait_" + wait_strategy_name(wait);
+        benchmarks.push_back(
+            {[=](const std::string &entropy) {
+               return name_prefix("BM_WaitStrategy_Compress_", entropy) +
+                      suffix;
+             },
+             [=](const std::string &name) {
+               benchmark::RegisterBenchmark(
+                   name, wait_strategies::BM_WaitStrategy_Compress,
+                   static_cast<int>(wait), mem_size, job_n, file->data());
+             }});
+        benchmarks.push_back(
+            {[=](const std::string &entropy) {
+               return name_prefix("BM_WaitStrategy_DeCompress_", entropy) +
+                      suffix;
+             },
+             [=](const std::string &name) {
+               benchmark::RegisterBenchmark(
+                   name, wait_strategies::BM_WaitStrategy_DeCompress,
+                   static_cast<int>(wait), mem_size, job_n, file->data());
+             }});
+      }
+    }
+  }
+
+  // #3.3
+  if (registry.family_enabled("async")) {
+    std::vector<std::pair<async_engine::RestoreMode, int>> configs = {
+        {async_engine::kRestoreBlocking, 1}};
+    for (const int concurrency :
+         parse_number_list_flag<int>(FLAGS_async_concurrency))
+      configs.push_back({async_engine::kRestoreCoroutines, concurrency});
+    const int max_inflight_jobs = FLAGS_async_max_inflight_jobs;
+    for (const auto &[restore_mode, concurrency] : configs) {
+      const std::string suffix = "_concurrency_" +
+                                 std::to_string(concurrency) + "_mode_" +
+                                 std::to_string(restore_mode);
+      benchmarks.push_back(
+          {[=](const std::string &entropy) {
+             return name_prefix("BM_Async_PageRestore_", entropy) + suffix;
+           },
+           [=](const std::string &name) {
+             benchmark::RegisterBenchmark(
+                 name, async_engine::BM_Async_PageRestore,
+                 static_cast<int>(restore_mode), concurrency,
+                 max_inflight_jobs, mem_size, file->data());
+           }});
+    }
+  }
+
+  // #3.4
+  if (registry.family_enabled("dedup")) {
+    for (const auto dedup_mode :
+         {dedup::kDedupHashSoftware, dedup::kDedupHashCrc64,
+          dedup::kDedupRestore, dedup::kRestoreWithoutDedup}) {
+      const std::string suffix = "_mode_" + std::to_string(dedup_mode);
+      benchmarks.push_back(
+          {[=](const std::string &entropy) {
+             return name_prefix("BM_Dedup_", entropy) + suffix;
+           },
+           [=](const std::string &name) {
+             benchmark::RegisterBenchmark(name, dedup::BM_Dedup,
+                                          static_cast<int>(dedup_mode),
+                                          mem_size, file->data());
+           }});
+    }
+  }
+
+  // #3.5
+  if (registry.family_enabled("delta")) {
+    for (const auto mutated_percent :
+         parse_number_list_flag<int>(FLAGS_delta_mutated_percent)) {
+      for (const auto delta_mode :
+           {delta::kDeltaRestore, delta::kFullRestore}) {
+        const std::string suffix = "_mutated_" +
+                                   std::to_string(mutated_percent) +
+                                   "_mode_" + std::to_string(delta_mode);
+        benchmarks.push_back(
+            {[=](const std::string &entropy) {
+               return name_prefix("BM_Delta_", entropy) + suffix;
+             },
+             [=](const std::string &name) {
+               benchmark::RegisterBenchmark(name, delta::BM_Delta,
+                                            static_cast<int>(delta_mode),
+                                            mutated_percent, mem_size,
+                                            file->data());
+             }});
+      }
+    }
+  }
+
+  // #4
+  if (registry.family_enabled("page_faults")) {
     for (const auto pf_scenario :
          {page_faults::kMajorPageFaults, page_faults::kMinorPageFaults,
-          page_faults::kAtsMiss, page_faults::kNoFaults}) {
-      benchmark::RegisterBenchmark(
-          "BM_SingleEngineMinorPageFault_Compress_" +
-              std::to_string(mem_size / kkB) + "kB" + "_name_" +
-              benchmark_name + "_entropy_" + std::to_string(entropy) +
-              "_pfscenario_" + std::to_string(pf_scenario),
-          page_faults::BM_SingleEngineMinorPageFault_Compress,
-          static_cast<int>(pf_scenario), mem_size, source_buff);
-      benchmark::RegisterBenchmark(
-          "BM_SingleEngineMinorPageFault_DeCompress_" +
-              std::to_string(mem_size / kkB) + "kB" + "_name_" +
-              benchmark_name + "_entropy_" + std::to_string(entropy) +
-              "_pfscenario_" + std::to_string(pf_scenario),
-          page_faults::BM_SingleEngineMinorPageFault_DeCompress,
-          static_cast<int>(pf_scenario), mem_size, source_buff);
+          page_faults::kAtsMiss, page_faults::kNoFaults,
+          page_faults::kFaultRecovery, page_faults::kPrefaultAll}) {
+      const std::string suffix = "_pfscenario_" + std::to_string(pf_scenario);
+      benchmarks.push_back(
+          {[=](const std::string &entropy) {
+             return name_prefix("BM_SingleEngineMinorPageFault_Compress_",
+                                entropy) +
+                    suffix;
+           },
+           [=](const std::string &name) {
+             benchmark::RegisterBenchmark(
+                 name, page_faults::BM_SingleEngineMinorPageFault_Compress,
+                 static_cast<int>(pf_scenario), mem_size, file->data());
+           }});
+      benchmarks.push_back(
+          {[=](const std::string &entropy) {
+             return name_prefix("BM_SingleEngineMinorPageFault_DeCompress_",
+                                entropy) +
+                    suffix;
+           },
+           [=](const std::string &name) {
+             benchmark::RegisterBenchmark(
+                 name, page_faults::BM_SingleEngineMinorPageFault_DeCompress,
+                 static_cast<int>(pf_scenario), mem_size, file->data());
+           }});
     }
   }
 
-  // Full system benchmark.
-  // #5
-  CompressionDataset wiki_1GB_dataset = load_corpus_dataset("dataset/wiki_tmp");
-  assert(wiki_1GB_dataset.size() == 1);
+  // #4.5
+  if (registry.family_enabled("fault_density")) {
+    for (const auto fault_percent :
+         parse_number_list_flag<int>(FLAGS_fault_density_percent)) {
+      for (const auto fault_engine :
+           {page_faults::kFaultSoftware, page_faults::kFaultSingleEngine,
+            page_faults::kFaultMultiEngine}) {
+        for (const auto fault_pattern :
+             {page_faults::kFaultStride, page_faults::kFaultRandom}) {
+          const std::string suffix =
+              "_engine_" + std::to_string(fault_engine) + "_pattern_" +
+              std::to_string(fault_pattern) + "_faults_" +
+              std::to_string(fault_percent);
+          for (const auto fault_op :
+               {page_faults::kFaultCompress, page_faults::kFaultDecompress}) {
+            const std::string prefix =
+                fault_op == page_faults::kFaultCompress
+                    ? "BM_PageFaultDensity_Compress_"
+                    : "BM_PageFaultDensity_DeCompress_";
+            benchmarks.push_back(
+                {[=](const std::string &entropy) {
+                   return name_prefix(prefix, entropy) + suffix;
+                 },
+                 [=](const std::string &name) {
+                   benchmark::RegisterBenchmark(
+                       name, page_faults::BM_PageFaultDensity,
+                       static_cast<int>(fault_op),
+                       static_cast<int>(fault_engine),
+                       static_cast<int>(fault_pattern), fault_percent,
+                       mem_size, file->data());
+                 }});
+          }
+        }
+      }
+    }
+  }
+
+  return benchmarks;
+}
+
+std::vector<synthetic::SnapshotProfile> parse_synthetic_datasets_flag() {
+  std::vector<synthetic::SnapshotProfile> profiles;
+  for (const auto &spec : parse_list_flag(FLAGS_synthetic_datasets)) {
+    synthetic::SnapshotProfile profile;
+    size_t size_mb = 0;
+    if (sscanf(spec.c_str(), "%zu:%lf:%lf:%lf", &size_mb,
+               &profile.zero_page_fraction, &profile.duplicate_page_fraction,
+               &profile.target_compression_ratio) != 4)
+      LOG(FATAL) << "Malformed synthetic dataset: " << spec;
+    profile.size = size_mb * kMB;
+    // available_in and available_out of a job are 32-bit.
+    if (profile.size > UINT32_MAX)
+      LOG(FATAL) << "Synthetic dataset of 4096 MB or more: " << spec;
+    profile.seed = FLAGS_synthetic_seed;
+    profile.entropy_mean_bits = FLAGS_synthetic_entropy_mean_bits;
+    profile.entropy_stddev_bits = FLAGS_synthetic_entropy_stddev_bits;
+    profiles.push_back(profile);
+  }
+  return profiles;
+}
+
+void register_benchmarks_with_corpus_datasets(BenchmarkRegistry &registry) {
+  LazyCompressionDataset files;
+  for (const auto &dataset_path : parse_list_flag(FLAGS_corpus_datasets)) {
+    auto dataset = list_corpus_dataset(dataset_path.c_str());
+    files.insert(files.end(), dataset.begin(), dataset.end());
+  }
+  auto synthetic_files =
+      synthetic::list_synthetic_dataset(parse_synthetic_datasets_flag());
+  files.insert(files.end(), synthetic_files.begin(), synthetic_files.end());
+
+  for (const auto &file : files) {
+    auto benchmarks = describe_corpus_benchmarks(registry, file);
+
+    // Only read the file if any of its benchmarks can survive the filter.
+    bool needed =
+        std::any_of(benchmarks.begin(), benchmarks.end(), [&](const auto &b) {
+          return registry.may_be_selected(
+              b.name(BenchmarkRegistry::kEntropyPlaceholder));
+        });
+    if (!needed) {
+      registry.skip(benchmarks.size());
+      continue;
+    }
+
+    const auto entropy = std::to_string(file->entropy());
+    for (const auto &b : benchmarks)
+      registry.add(b.name(entropy), b.reg);
+  }
+}
+
+// The single file of the full system dataset, listed on first use.
+static std::shared_ptr<LazyCorpusFile> full_system_file() {
+  static std::shared_ptr<LazyCorpusFile> file;
+  if (file == nullptr) {
+    auto dataset = list_corpus_dataset(FLAGS_full_system_dataset.c_str());
+    if (dataset.size() != 1)
+      LOG(FATAL) << "Expected exactly one file in "
+                 << FLAGS_full_system_dataset;
+    file = dataset.front();
+  }
+  return file;
+}
+
+// Full system benchmark.
+// #5
+void register_benchmarks_full_system(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("full_system"))
+    return;
+
   static std::map<size_t, std::string> compressed_filenames;
-  for (const int read_size_ : {32, 64, 128, 256, 512, 1024, 2048, 4096, 8192,
-                               16384, 32768, 65536, 131072, 232144}) {
-    const auto read_size = static_cast<uint64_t>(read_size_) * kkB;
+  for (const auto read_size_ :
+       parse_number_list_flag<uint64_t>(FLAGS_full_system_read_sizes_kb)) {
+    const auto read_size = read_size_ * kkB;
+    const auto modes = {full_system::kBenchmarkDiskRead,
+                        full_system::kBenchmarkDiskReadIODirect,
+                        full_system::kBenchmarkDecompress,
+                        full_system::kBenchmarkDecompressFromFile};
+    const auto name = [read_size](full_system::FullSystemMode mode) {
+      return "BM_FullSystem_" + std::to_string(read_size / kkB) + "kB" +
+             "_mode_" + std::to_string(mode);
+    };
+
+    // Prepare compressed files only for the selected read sizes.
+    if (std::none_of(modes.begin(), modes.end(), [&](auto mode) {
+          return registry.selected(name(mode));
+        })) {
+      registry.skip(modes.size());
+      continue;
+    }
+
+    auto wiki_1GB_file = full_system_file();
     compressed_filenames[read_size] =
         std::string("compressfile_") + std::to_string(read_size) + ".dat";
     size_t compressed_size = 0;
     if (full_system::prepare_compressed_files(
-            std::get<3>(wiki_1GB_dataset.front()), read_size,
+            wiki_1GB_file->data(), read_size,
             compressed_filenames[read_size].c_str(), &compressed_size)) {
       LOG(FATAL) << "Failed to create prepare compressed files.";
     }
 
-    for (auto mode : {full_system::kBenchmarkDiskRead,
-                      full_system::kBenchmarkDiskReadIODirect,
-                      full_system::kBenchmarkDecompress,
-                      full_system::kBenchmarkDecompressFromFile}) {
-      benchmark::RegisterBenchmark(
-          "BM_FullSystem_" + std::to_string(read_size / kkB) + "kB" + "_mode_" +
-              std::to_string(mode),
-          full_system::BM_FullSystem, static_cast<int>(mode), read_size,
-          compressed_filenames[read_size].c_str(), compressed_size);
+    for (auto mode : modes) {
+      registry.add(name(mode), [&](const std::string &bm_name) {
+        benchmark::RegisterBenchmark(bm_name, full_system::BM_FullSystem,
+                                     static_cast<int>(mode), read_size,
+                                     compressed_filenames[read_size].c_str(),
+                                     compressed_size);
+      });
     }
   }
 }
 
-void register_benchmarks() { register_benchmarks_with_corpus_datasets(); }
+// Snapshot write path: raw write vs serial compress-then-write vs chunked
+// compression overlapped with io_uring writes, over the full system sizes.
+// #6
+void register_benchmarks_snapshot_write(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("snapshot_write"))
+    return;
+
+  const auto chunk_sizes =
+      parse_number_list_flag<size_t>(FLAGS_snapshot_chunk_sizes_kb);
+  const auto inflight_jobs =
+      parse_number_list_flag<int>(FLAGS_snapshot_inflight_jobs);
+  for (const auto mem_size_ :
+       parse_number_list_flag<uint64_t>(FLAGS_full_system_read_sizes_kb)) {
+    const size_t mem_size = mem_size_ * kkB;
+    const auto prefix =
+        "BM_SnapshotWrite_" + std::to_string(mem_size / kkB) + "kB";
+    const auto reg = [mem_size](snapshot::SnapshotWriteMode mode,
+                                size_t chunk_size, int inflight) {
+      return [=](const std::string &bm_name) {
+        benchmark::RegisterBenchmark(bm_name, snapshot::BM_SnapshotWrite,
+                                     static_cast<int>(mode), mem_size,
+                                     chunk_size, inflight,
+                                     full_system_file()->data());
+      };
+    };
+
+    for (auto mode :
+         {snapshot::kSnapshotRawWrite, snapshot::kSnapshotSerialCompressWrite})
+      registry.add(prefix + "_mode_" + std::to_string(mode),
+                   reg(mode, 0, 0));
+    for (const auto chunk_size : chunk_sizes)
+      for (const auto inflight : inflight_jobs)
+        registry.add(prefix + "_chunk_" + std::to_string(chunk_size) +
+                         "kB_inflight_" + std::to_string(inflight) +
+                         "_mode_" +
+                         std::to_string(snapshot::kSnapshotOverlapped),
+                     reg(snapshot::kSnapshotOverlapped, chunk_size * kkB,
+                         inflight));
+  }
+}
+
+// Concurrent restore of K snapshots of the full system dataset, each with
+// its own reader and hardware job.
+// #7
+void register_benchmarks_snapshot_restore(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("snapshot_restore"))
+    return;
+
+  for (const auto mem_size_ :
+       parse_number_list_flag<uint64_t>(FLAGS_snapshot_restore_sizes_kb))
+    for (const auto chunk_size :
+         parse_number_list_flag<size_t>(FLAGS_snapshot_chunk_sizes_kb))
+      for (const auto snapshot_n :
+           parse_number_list_flag<int>(FLAGS_snapshot_restore_counts)) {
+        const size_t mem_size = mem_size_ * kkB;
+        registry.add(
+            "BM_SnapshotRestore_" + std::to_string(mem_size_) + "kB_chunk_" +
+                std::to_string(chunk_size) + "kB_snapshots_" +
+                std::to_string(snapshot_n),
+            [=](const std::string &bm_name) {
+              benchmark::RegisterBenchmark(
+                  bm_name, snapshot::BM_SnapshotRestore, snapshot_n, mem_size,
+                  chunk_size * kkB, FLAGS_snapshot_readahead_chunks,
+                  full_system_file()->data())
+                  ->UseRealTime();
+            });
+      }
+}
+
+// Oversubscribed work queues: fail vs bounded retry vs software fallback on
+// rejected submissions, over the full system dataset.
+// #8
+void register_benchmarks_overload(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("overload"))
+    return;
+
+  // Operations are spread over the first kOverloadSourceSize bytes.
+  constexpr size_t kOverloadSourceSize = 64 * kMB;
+  const size_t op_size = FLAGS_overload_op_size_kb * kkB;
+  for (const auto thread_n :
+       parse_number_list_flag<int>(FLAGS_overload_threads))
+    for (const auto inflight :
+         parse_number_list_flag<int>(FLAGS_overload_inflight_jobs))
+      for (auto policy : {overload::kOverloadFail, overload::kOverloadRetry,
+                          overload::kOverloadFallback})
+        registry.add(
+            "BM_Overload_Compress_" + std::to_string(op_size / kkB) +
+                "kB_threads_" + std::to_string(thread_n) + "_inflight_" +
+                std::to_string(inflight) + "_policy_" + std::to_string(policy),
+            [=](const std::string &bm_name) {
+              auto file = full_system_file();
+              benchmark::RegisterBenchmark(
+                  bm_name, overload::BM_Overload_Compress,
+                  static_cast<int>(policy), FLAGS_submit_deadline_us, thread_n,
+                  inflight, op_size,
+                  std::min(file->size(), kOverloadSourceSize), file->data())
+                  ->UseRealTime();
+            });
+}
+
+// Compressions and decompressions sharing the work queues.
+// #9
+void register_benchmarks_mixed(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("mixed"))
+    return;
+
+  constexpr size_t kMixedSourceSize = 64 * kMB;
+  for (const auto compress_size :
+       parse_number_list_flag<size_t>(FLAGS_mixed_compress_sizes_kb))
+    for (const auto decompress_size :
+         parse_number_list_flag<size_t>(FLAGS_mixed_decompress_sizes_kb))
+      for (const auto inflight :
+           parse_number_list_flag<int>(FLAGS_mixed_inflight_jobs))
+        for (const auto read_percent :
+             parse_number_list_flag<int>(FLAGS_mixed_read_percent))
+          registry.add(
+              "BM_Mixed_compress_" + std::to_string(compress_size) +
+                  "kB_decompress_" + std::to_string(decompress_size) +
+                  "kB_inflight_" + std::to_string(inflight) + "_read_" +
+                  std::to_string(read_percent),
+              [=](const std::string &bm_name) {
+                auto file = full_system_file();
+                benchmark::RegisterBenchmark(
+                    bm_name, mixed::BM_Mixed, read_percent,
+                    compress_size * kkB, decompress_size * kkB, inflight,
+                    std::min(file->size(), kMixedSourceSize), file->data())
+                    ->UseRealTime();
+              });
+}
+
+// Soft-dirty incremental snapshots vs full recompression.
+// #10
+void register_benchmarks_incremental(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("incremental"))
+    return;
+
+  for (const auto mem_size_ :
+       parse_number_list_flag<uint64_t>(FLAGS_incremental_region_sizes_kb))
+    for (const auto chunk_size :
+         parse_number_list_flag<size_t>(FLAGS_incremental_chunk_sizes_kb))
+      for (const auto dirty_percent :
+           parse_number_list_flag<int>(FLAGS_incremental_dirty_percent))
+        for (const auto snapshot_mode : {incremental::kIncrementalSnapshot,
+                                         incremental::kFullSnapshot}) {
+          const size_t mem_size = mem_size_ * kkB;
+          registry.add(
+              "BM_IncrementalSnapshot_" + std::to_string(mem_size_) +
+                  "kB_chunk_" + std::to_string(chunk_size) + "kB_dirty_" +
+                  std::to_string(dirty_percent) + "_mode_" +
+                  std::to_string(snapshot_mode),
+              [=](const std::string &bm_name) {
+                auto file = full_system_file();
+                benchmark::RegisterBenchmark(
+                    bm_name, incremental::BM_IncrementalSnapshot,
+                    static_cast<int>(snapshot_mode), dirty_percent, mem_size,
+                    chunk_size * kkB, file->size(), file->data())
+                    ->UseRealTime();
+              });
+        }
+}
+
+// Live process memory capture.
+// #11
+void register_benchmarks_capture(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("capture"))
+    return;
+
+  for (const auto target_size_mb :
+       parse_number_list_flag<size_t>(FLAGS_capture_target_sizes_mb))
+    for (const auto chunk_size :
+         parse_number_list_flag<size_t>(FLAGS_capture_chunk_sizes_kb))
+      for (const auto inflight :
+           parse_number_list_flag<int>(FLAGS_capture_inflight_jobs))
+        for (const auto capture_mode :
+             {capture::kCaptureOverlapped, capture::kCaptureCopyFirst})
+          registry.add(
+              "BM_ProcessCapture_" + std::to_string(target_size_mb) +
+                  "MB_chunk_" + std::to_string(chunk_size) + "kB_inflight_" +
+                  std::to_string(inflight) + "_mode_" +
+                  std::to_string(capture_mode),
+              [=](const std::string &bm_name) {
+                benchmark::RegisterBenchmark(
+                    bm_name, capture::BM_ProcessCapture,
+                    static_cast<int>(capture_mode), target_size_mb,
+                    chunk_size * kkB, FLAGS_capture_batch_size_kb * kkB,
+                    inflight)
+                    ->UseRealTime();
+              });
+}
+
+// Time to working set with address- vs access-ordered snapshots.
+// #12
+void register_benchmarks_layout(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("layout"))
+    return;
+
+  for (const auto mem_size_ :
+       parse_number_list_flag<uint64_t>(FLAGS_layout_image_sizes_kb))
+    for (const auto chunk_size :
+         parse_number_list_flag<size_t>(FLAGS_layout_chunk_sizes_kb))
+      for (const auto working_set_percent :
+           parse_number_list_flag<int>(FLAGS_layout_working_set_percent))
+        for (const auto layout_mode :
+             {snapshot::kLayoutAddressOrder, snapshot::kLayoutAccessOrder})
+          registry.add(
+              "BM_WorkingSetRestore_" + std::to_string(mem_size_) +
+                  "kB_chunk_" + std::to_string(chunk_size) +
+                  "kB_working_set_" + std::to_string(working_set_percent) +
+                  "_mode_" + std::to_string(layout_mode),
+              [=](const std::string &bm_name) {
+                auto file = full_system_file();
+                benchmark::RegisterBenchmark(
+                    bm_name, snapshot::BM_WorkingSetRestore,
+                    static_cast<int>(layout_mode), working_set_percent,
+                    std::min<size_t>(file->size(), mem_size_ * kkB),
+                    chunk_size * kkB, FLAGS_layout_trace_file.c_str(),
+                    file->data());
+              });
+}
+
+// Accelerator and software throughput next to memory bandwidth hogs.
+// #13
+void register_benchmarks_interference(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("interference"))
+    return;
+
+  for (const auto op_size :
+       parse_number_list_flag<size_t>(FLAGS_interference_op_sizes_kb))
+    for (const auto aggressors :
+         parse_number_list_flag<int>(FLAGS_interference_aggressors))
+      for (const auto pattern :
+           parse_number_list_flag<int>(FLAGS_interference_patterns))
+        for (const auto operation : {interference::kInterferenceCompress,
+                                     interference::kInterferenceDecompress})
+          for (const auto engine : {interference::kInterferenceSoftware,
+                                    interference::kInterferenceSingleEngine,
+                                    interference::kInterferenceMultiEngine})
+            registry.add(
+                std::string(operation == interference::kInterferenceCompress
+                                ? "BM_BandwidthInterference_Compress_"
+                                : "BM_BandwidthInterference_DeCompress_") +
+                    std::to_string(op_size) + "kB_engine_" +
+                    std::to_string(engine) + "_aggressors_" +
+                    std::to_string(aggressors) + "_pattern_" +
+                    std::to_string(pattern),
+                [=](const std::string &bm_name) {
+                  auto file = full_system_file();
+                  benchmark::RegisterBenchmark(
+                      bm_name, interference::BM_BandwidthInterference,
+                      static_cast<int>(operation), static_cast<int>(engine),
+                      aggressors, pattern,
+                      FLAGS_interference_hog_buffer_mb * kMB,
+                      std::min<size_t>(file->size(), op_size * kkB),
+                      file->data())
+                      ->UseRealTime();
+                });
+}
+
+// LLC pollution of a co-located victim by hardware vs software decompression.
+// #14
+void register_benchmarks_cache_pollution(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("cache_pollution"))
+    return;
+
+  for (const auto op_size :
+       parse_number_list_flag<size_t>(FLAGS_cache_pollution_sizes_kb))
+    for (const auto set_size :
+         parse_number_list_flag<size_t>(FLAGS_cache_pollution_victim_set_kb))
+      for (const auto victim_kind :
+           {interference::kVictimPointerChase, interference::kVictimHashLookup})
+        for (const auto engine : {interference::kInterferenceSoftware,
+                                  interference::kInterferenceSingleEngine,
+                                  interference::kInterferenceMultiEngine})
+          registry.add(
+              "BM_CachePollution_" + std::to_string(op_size) + "kB_engine_" +
+                  std::to_string(engine) + "_victim_" +
+                  std::to_string(victim_kind) + "_set_" +
+                  std::to_string(set_size) + "kB",
+              [=](const std::string &bm_name) {
+                auto file = full_system_file();
+                benchmark::RegisterBenchmark(
+                    bm_name, interference::BM_CachePollution,
+                    static_cast<int>(engine), static_cast<int>(victim_kind),
+                    set_size ? set_size * kkB : llc_size(),
+                    std::min<size_t>(file->size(), op_size * kkB),
+                    file->data())
+                    ->UseRealTime();
+              });
+}
+
+// Bounded-memory streaming compression and decompression vs window size.
+// #15
+void register_benchmarks_stream(BenchmarkRegistry &registry) {
+  if (!registry.family_enabled("stream"))
+    return;
+
+  for (const auto stream_size_mb :
+       parse_number_list_flag<size_t>(FLAGS_stream_sizes_mb))
+    for (const auto window_size_kb :
+         parse_number_list_flag<size_t>(FLAGS_stream_window_sizes_kb))
+      for (const auto execution_path : {qpl_path_software, qpl_path_hardware})
+        for (const auto operation : {single_engine_stream::kStreamCompress,
+                                     single_engine_stream::kStreamDecompress})
+          registry.add(
+              std::string(operation == single_engine_stream::kStreamCompress
+                              ? "BM_Stream_Compress_"
+                              : "BM_Stream_DeCompress_") +
+                  std::to_string(stream_size_mb) + "MB_window_" +
+                  std::to_string(window_size_kb) + "kB" +
+                  (execution_path == qpl_path_software ? "_qpl_path_software"
+                                                       : "_qpl_path_hardware"),
+              [=](const std::string &bm_name) {
+                auto file = full_system_file();
+                benchmark::RegisterBenchmark(
+                    bm_name, single_engine_stream::BM_Stream,
+                    static_cast<int>(operation), execution_path,
+                    window_size_kb * kkB, stream_size_mb * kMB, file->size(),
+                    file->data());
+              });
+}
+
+void register_benchmarks(BenchmarkRegistry &registry) {
+  register_benchmarks_with_corpus_datasets(registry);
+  register_benchmarks_full_system(registry);
+  register_benchmarks_snapshot_write(registry);
+  register_benchmarks_snapshot_restore(registry);
+  register_benchmarks_overload(registry);
+  register_benchmarks_mixed(registry);
+  register_benchmarks_incremental(registry);
+  register_benchmarks_capture(registry);
+  register_benchmarks_layout(registry);
+  register_benchmarks_interference(registry);
+  register_benchmarks_cache_pollution(registry);
+  register_benchmarks_stream(registry);
+}
 
 int main(int argc, char **argv) {
-  register_benchmarks();
+  TimeScope startup_time;
 
+  // Benchmark flags first, the remaining ones describe the benchmark matrix.
   benchmark::Initialize(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_capture_target_mb)
+    capture::run_target(FLAGS_capture_target_mb * kMB);
+
+  BenchmarkRegistry registry(benchmark::GetBenchmarkFilter(),
+                             FLAGS_benchmark_families);
+  register_benchmarks(registry);
+
+  auto startup_time_ms = startup_time.GetTimeStamp<std::chrono::milliseconds>();
+  LOG(INFO) << "Registered " << registry.registered() << " benchmarks ("
+            << registry.filtered_out() << " filtered out) in "
+            << startup_time_ms << " ms";
+  benchmark::AddCustomContext("startup_time_ms",
+                              std::to_string(startup_time_ms));
+  benchmark::AddCustomContext("registered_benchmarks",
+                              std::to_string(registry.registered()));
+
   benchmark::RunSpecifiedBenchmarks();
+
+  const auto &cache_stats =
+      prepared_cache::PreparedFileCache::instance().stats();
+  LOG(INFO) << "Prepared inputs cache: " << cache_stats.hits << " hits, "
+            << cache_stats.misses << " misses, " << cache_stats.invalid
+            << " invalid, " << cache_stats.evicted << " evicted; "
+            << cache_stats.produce_us / 1000 << " ms spent preparing, "
+            << cache_stats.saved_us / 1000 << " ms of setup time saved";
+
   benchmark::Shutdown();
 }
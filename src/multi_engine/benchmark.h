@@ -1,12 +1,15 @@
 #ifndef _MULTI_ENGINE_BENCHMARK_H_
 #define _MULTI_ENGINE_BENCHMARK_H_
 
+#include <algorithm>
 #include <cstdarg>
 
 #include <glog/logging.h>
 
 #include <benchmark/benchmark.h>
 
+#include "../cache_state.h"
+#include "../cpu_counters.h"
 #include "../util.h"
 #include "qpl_parallel.h"
 
@@ -18,8 +21,22 @@ namespace multi_engine {
   auto mem_size = _PARSE_ARG(size_t);                                          \
   auto job_n = _PARSE_ARG(int);                                                \
   auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  auto cache_state = _PARSE_ARG(int);                                          \
   _PARSE_OUT
 
+/// @param compressed_buff and a copy of it per other set of @param buffers,
+/// with the chunks of every copy added to the regions of its set.
+static std::vector<CompressedFormat>
+make_cache_state_chunks(CompressedFormat compressed_buff,
+                        CacheStateBuffers &buffers) {
+  std::vector<CompressedFormat> sets(buffers.sets() - 1, compressed_buff);
+  sets.insert(sets.begin(), std::move(compressed_buff));
+  for (size_t set = 0; set < sets.size(); ++set)
+    for (const auto &[chunk, size] : sets[set])
+      buffers.add_region(set, chunk.data(), chunk.capacity());
+  return sets;
+}
+
 auto BM_MultipleEngine_Compress = [](benchmark::State &state, auto Inputs...) {
   _PARSE_ARGS_
   assert(source_buff != nullptr);
@@ -37,13 +54,23 @@ auto BM_MultipleEngine_Compress = [](benchmark::State &state, auto Inputs...) {
 
   zero_initialize_counters(state);
 
+  // Rotate or flush the source and the chunks.
+  CacheStateBuffers buffers(
+      static_cast<CacheState>(cache_state),
+      cache_state_sets(static_cast<CacheState>(cache_state), 3 * mem_size),
+      source_buff, mem_size, 0);
+  auto outputs = make_cache_state_chunks(std::move(compressed_buff), buffers);
+
   // Benchmark compress.
-  for (auto _ : state) {
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    buffers.next(state, loop);
     if (multi_engine::compress(
             static_cast<multi_engine::CompressionMode>(compression_mode),
-            source_buff, mem_size, &compressed_buff))
+            buffers.src(), mem_size, &outputs[buffers.index()]))
       state.SkipWithMessage("Failed to compress.");
   }
+  compressed_buff = std::move(outputs[buffers.index()]);
   size_t compressed_size = 0;
   for (auto cb_ : compressed_buff)
     compressed_size += std::get<0>(cb_).size();
@@ -91,15 +118,192 @@ auto BM_MultipleEngine_DeCompress = [](benchmark::State &state,
     compressed_size += std::get<0>(cb_).size();
   state.counters["Compression Ratio"] = 1.0 * mem_size / compressed_size;
 
+  // Rotate or flush the chunks and the output.
+  CacheStateBuffers buffers(
+      static_cast<CacheState>(cache_state),
+      cache_state_sets(static_cast<CacheState>(cache_state),
+                       compressed_size + mem_size),
+      nullptr, 0, mem_size);
+  auto inputs = make_cache_state_chunks(std::move(compressed_buff), buffers);
+
+  // Decompress.
+  size_t decompression_size = 0;
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    buffers.next(state, loop);
+    if (multi_engine::decompress(inputs[buffers.index()], buffers.dst(),
+                                 &decompression_size))
+      state.SkipWithMessage("Failed to decompress.");
+  }
+
+  // Verify.
+  if (decompression_size != mem_size ||
+      memcmp(source_buff, buffers.dst(), decompression_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+enum OutputLayout {
+  // One vector of twice the chunk size per chunk.
+  kOutputPerChunk,
+  // One CompressedArena of compress_bound() per chunk, compacted.
+  kOutputArena
+};
+
+#define _PARSE_ARGS_QUEUED_                                                    \
+  _PARSE_IN                                                                    \
+  auto compression_mode = Inputs;                                              \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto chunk_size = _PARSE_ARG(size_t);                                        \
+  auto inflight_jobs = _PARSE_ARG(int);                                        \
+  auto output_layout = _PARSE_ARG(int);                                        \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+//
+/// Compressed output of the work-queue benchmarks in either layout.
+//
+struct QueuedOutput {
+  OutputLayout layout;
+  CompressedFormat chunks;
+  CompressedArena arena;
+
+  QueuedOutput(OutputLayout layout, size_t mem_size, size_t chunk_size)
+      : layout(layout) {
+    if (layout == kOutputArena)
+      arena = make_arena(mem_size, chunk_size);
+    else
+      chunks = make_fixed_chunks(mem_size, chunk_size);
+  }
+
+  int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
+               size_t inflight_jobs) {
+    return layout == kOutputArena
+               ? compress_arena(mode, src, src_size, inflight_jobs, &arena)
+               : compress_queued(mode, src, src_size, inflight_jobs, &chunks);
+  }
+
+  int decompress(uint8_t *dst, size_t inflight_jobs, size_t *dst_actual_size) {
+    return layout == kOutputArena
+               ? decompress_arena(arena, dst, inflight_jobs, dst_actual_size)
+               : decompress_queued(chunks, dst, inflight_jobs,
+                                   dst_actual_size);
+  }
+
+  size_t chunk_count() const {
+    return layout == kOutputArena ? arena.original_sizes.size()
+                                  : chunks.size();
+  }
+
+  /// Bytes of output memory reserved before compressing.
+  size_t reserved_size() const {
+    if (layout == kOutputArena)
+      return arena.capacity;
+    size_t reserved_size = 0;
+    for (auto &cb_ : chunks)
+      reserved_size += std::get<0>(cb_).capacity();
+    return reserved_size;
+  }
+
+  size_t compressed_size() const {
+    if (layout == kOutputArena)
+      return arena.compressed_size();
+    size_t compressed_size = 0;
+    for (auto &cb_ : chunks)
+      compressed_size += std::get<0>(cb_).size();
+    return compressed_size;
+  }
+};
+
+auto BM_MultipleEngineQueued_Compress = [](benchmark::State &state,
+                                           auto Inputs...) {
+  _PARSE_ARGS_QUEUED_
+  assert(source_buff != nullptr);
+
+  const size_t rss_before = start_rss_measurement();
+  TimeScope setup_time;
+  QueuedOutput output(static_cast<OutputLayout>(output_layout), mem_size,
+                      chunk_size);
+  const double setup_ms =
+      setup_time.GetTimeStamp<std::chrono::microseconds>() / 1000.0;
+
+  zero_initialize_counters(state);
+
+  // Benchmark compress.
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    if (output.compress(
+            static_cast<multi_engine::CompressionMode>(compression_mode),
+            source_buff, mem_size, static_cast<size_t>(inflight_jobs)))
+      state.SkipWithMessage("Failed to compress.");
+  }
+  state.counters["Peak RSS Growth, MB"] = peak_rss_growth_mb(rss_before);
+  state.counters["Setup Time, ms"] = setup_ms;
+  state.counters["Output Reserved, MB"] =
+      1.0 * static_cast<double>(output.reserved_size()) / kMB;
+  state.counters["Overflowed Chunks"] = output.arena.overflows;
+  state.counters["Compression Ratio"] =
+      1.0 * mem_size / output.compressed_size();
+  state.counters["Chunks"] = output.chunk_count();
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
+
+  // Verify with decompress.
+  auto decompressed_buff = mmap_allocate(mem_size);
+  size_t decompression_size = 0;
+  if (output.decompress(decompressed_buff.get(),
+                        static_cast<size_t>(inflight_jobs),
+                        &decompression_size))
+    state.SkipWithMessage("Failed to decompress.");
+  if (decompression_size != mem_size ||
+      memcmp(source_buff, decompressed_buff.get(), decompression_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+auto BM_MultipleEngineQueued_DeCompress = [](benchmark::State &state,
+                                             auto Inputs...) {
+  _PARSE_ARGS_QUEUED_
+  assert(source_buff != nullptr);
+
+  const size_t rss_before = start_rss_measurement();
+  TimeScope setup_time;
+  QueuedOutput output(static_cast<OutputLayout>(output_layout), mem_size,
+                      chunk_size);
+  const double setup_ms =
+      setup_time.GetTimeStamp<std::chrono::microseconds>() / 1000.0;
+
+  zero_initialize_counters(state);
+
+  // Compress.
+  if (output.compress(
+          static_cast<multi_engine::CompressionMode>(compression_mode),
+          source_buff, mem_size, static_cast<size_t>(inflight_jobs))) {
+    state.SkipWithMessage("Failed to compress.");
+  }
+  state.counters["Compression Ratio"] =
+      1.0 * mem_size / output.compressed_size();
+  state.counters["Chunks"] = output.chunk_count();
+
   // Decompress.
   auto decompressed_buff = mmap_allocate(mem_size);
   memset(decompressed_buff.get(), _PAGE_PREFAULT_, mem_size);
   size_t decompression_size = 0;
-  for (auto _ : state) {
-    if (multi_engine::decompress(compressed_buff, decompressed_buff.get(),
-                                 &decompression_size))
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    if (output.decompress(decompressed_buff.get(),
+                          static_cast<size_t>(inflight_jobs),
+                          &decompression_size))
       state.SkipWithMessage("Failed to decompress.");
   }
+  state.counters["Peak RSS Growth, MB"] = peak_rss_growth_mb(rss_before);
+  state.counters["Setup Time, ms"] = setup_ms;
+  state.counters["Output Reserved, MB"] =
+      1.0 * static_cast<double>(output.reserved_size()) / kMB;
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
 
   // Verify.
   if (decompression_size != mem_size ||
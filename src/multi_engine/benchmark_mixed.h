@@ -0,0 +1,200 @@
+#ifndef _BENCHMARK_MIXED_H_
+#define _BENCHMARK_MIXED_H_
+
+#include <cstdarg>
+#include <random>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../job_submitter.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+#include "benchmark.h"
+#include "qpl_parallel.h"
+
+namespace mixed {
+
+enum OperationClass { kClassCompress, kClassDecompress };
+
+// Operations per iteration.
+static constexpr size_t kMixedOpsPerIteration = 1024;
+// Distinct pre-compressed inputs of the decompressions.
+static constexpr size_t kMixedDecompressInputs = 1024;
+static constexpr size_t kNoOp = static_cast<size_t>(-1);
+
+#define _PARSE_ARGS_MIXED_                                                     \
+  _PARSE_IN                                                                    \
+  auto read_percent = Inputs;                                                  \
+  auto compress_size = _PARSE_ARG(size_t);                                     \
+  auto decompress_size = _PARSE_ARG(size_t);                                   \
+  auto inflight_jobs = _PARSE_ARG(int);                                        \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+//
+/// One thread keeps @param inflight_jobs jobs busy on the shared work queues
+/// with a random mix of single-job compressions of compress_size regions
+/// (snapshot creation) and decompressions of decompress_size pages
+/// (restores); read_percent % of the operations are decompressions.
+//
+auto BM_Mixed = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_MIXED_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  if (compress_size > mem_size || decompress_size > mem_size) {
+    state.SkipWithMessage("Source is smaller than one operation.");
+    return;
+  }
+
+  // Pre-compress the pages to restore.
+  size_t page_count =
+      std::min(kMixedDecompressInputs, mem_size / decompress_size);
+  auto pages =
+      multi_engine::make_fixed_chunks(page_count * decompress_size,
+                                      decompress_size);
+  if (multi_engine::compress_queued(multi_engine::kParallelDynamic,
+                                    source_buff, page_count * decompress_size,
+                                    static_cast<size_t>(inflight_jobs),
+                                    &pages)) {
+    state.SkipWithMessage("Failed to compress.");
+    return;
+  }
+
+  const size_t jobs = static_cast<size_t>(inflight_jobs);
+  auto job_buffers = multi_engine::init_qpl(qpl_path_hardware, jobs);
+  if (job_buffers.empty()) {
+    state.SkipWithMessage("Failed to init qpl.");
+    return;
+  }
+  const size_t slot_size = std::max(2 * compress_size, decompress_size);
+  std::vector<std::vector<uint8_t>> slots(
+      jobs, std::vector<uint8_t>(slot_size, _PAGE_PREFAULT_));
+
+  std::mt19937_64 rng(42);
+  std::bernoulli_distribution is_read(read_percent / 100.0);
+  const size_t compress_regions = mem_size / compress_size;
+  std::vector<OperationClass> job_class(jobs, kClassCompress);
+  std::vector<size_t> job_op(jobs, kNoOp);
+  std::vector<size_t> job_page(jobs, 0);
+  std::vector<TimeScope> job_start(jobs);
+  std::vector<double> latencies_us[2];
+  size_t bytes[2] = {0, 0};
+  bool failed = false;
+  JobSubmitter submitter;
+
+  // Benchmark.
+  TimeScope total_time;
+  size_t op = 0;
+  CpuCounters cpu_counters;
+  for (auto _ : state) {
+    size_t issued = 0, completed = 0;
+    CompletionWaiter waiter(kWaitBusyPoll);
+    while (!failed && completed != kMixedOpsPerIteration) {
+      bool progress = false;
+      for (size_t i = 0; i < jobs && !failed; ++i) {
+        auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+        if (job_op[i] == kNoOp) {
+          if (issued == kMixedOpsPerIteration)
+            continue;
+          // Issue the next operation.
+          job_class[i] = is_read(rng) ? kClassDecompress : kClassCompress;
+          if (job_class[i] == kClassCompress) {
+            multi_engine::prepare_compress_job(
+                job, multi_engine::kParallelDynamic, nullptr,
+                source_buff + (op % compress_regions) * compress_size,
+                compress_size, slots[i].data(), slots[i].size());
+          } else {
+            job_page[i] = op % page_count;
+            auto &[page, size] = pages[job_page[i]];
+            job->op = qpl_op_decompress;
+            job->next_in_ptr = page.data();
+            job->available_in = page.size();
+            job->next_out_ptr = slots[i].data();
+            job->available_out = size;
+            job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST;
+          }
+          job_start[i] = TimeScope();
+          if (submitter.submit(job) != QPL_STS_OK) {
+            failed = true;
+            break;
+          }
+          job_op[i] = op++;
+          ++issued;
+          continue;
+        }
+
+        auto status = submitter.check(job);
+        if (status == QPL_STS_BEING_PROCESSED)
+          continue;
+        double latency_us =
+            job_start[i].GetTimeStamp<std::chrono::nanoseconds>() / 1000.0;
+        if (status != QPL_STS_OK ||
+            (job_class[i] == kClassDecompress &&
+             job->total_out != decompress_size)) {
+          LOG(WARNING) << "An error " << status
+                       << " acquired during awaiting for completion";
+          job_op[i] = kNoOp;
+          failed = true;
+          break;
+        }
+        latencies_us[job_class[i]].push_back(latency_us);
+        bytes[job_class[i]] +=
+            job_class[i] == kClassCompress ? compress_size : decompress_size;
+        job_op[i] = kNoOp;
+        ++completed;
+        progress = true;
+      }
+      if (progress)
+        waiter.reset();
+      else
+        waiter.wait();
+    }
+    if (failed)
+      state.SkipWithMessage("Failed to run mixed workload.");
+  }
+  cpu_counters.report(state, static_cast<double>(bytes[kClassCompress] +
+                                                 bytes[kClassDecompress]));
+  double total_s = total_time.GetTimeStamp<std::chrono::microseconds>() / 1e6;
+
+  // Let the jobs still in flight after a failure complete.
+  for (size_t i = 0; i < jobs; ++i)
+    if (job_op[i] != kNoOp)
+      while (submitter.check(reinterpret_cast<qpl_job *>(
+                 job_buffers[i].get())) == QPL_STS_BEING_PROCESSED)
+        _mm_pause();
+
+  // Verify the last restored page of every job.
+  for (size_t i = 0; i < jobs && !failed; ++i)
+    if (job_class[i] == kClassDecompress &&
+        memcmp(slots[i].data(), source_buff + job_page[i] * decompress_size,
+               decompress_size) != 0)
+      state.SkipWithMessage("Data missmatch.");
+
+  state.SetBytesProcessed(
+      static_cast<int64_t>(bytes[kClassCompress] + bytes[kClassDecompress]));
+  for (auto op_class : {kClassCompress, kClassDecompress}) {
+    const std::string name =
+        op_class == kClassCompress ? "Compress" : "Decompress";
+    state.counters[name + " Ops"] = latencies_us[op_class].size();
+    state.counters[name + " Throughput, GB/s"] =
+        total_s > 0 ? bytes[op_class] / total_s / 1e9 : 0;
+    state.counters[name + " Latency p50, us"] =
+        percentile(latencies_us[op_class], 50);
+    state.counters[name + " Latency p99, us"] =
+        percentile(latencies_us[op_class], 99);
+  }
+
+  if (multi_engine::free_qpl(job_buffers))
+    state.SkipWithMessage("Failed to free resources.");
+  state.counters["Status"] = 0;
+};
+
+} // namespace mixed
+
+#endif
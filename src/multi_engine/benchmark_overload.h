@@ -0,0 +1,161 @@
+#ifndef _BENCHMARK_OVERLOAD_H_
+#define _BENCHMARK_OVERLOAD_H_
+
+#include <atomic>
+#include <cstdarg>
+#include <latch>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../job_submitter.h"
+#include "../util.h"
+#include "benchmark.h"
+#include "qpl_parallel.h"
+
+namespace overload {
+
+enum OverloadPolicy {
+  // Fail at the first rejected submission (the former behaviour).
+  kOverloadFail,
+  // Retry with bounded backoff until the deadline, then fail.
+  kOverloadRetry,
+  // Retry until the deadline, then execute in software.
+  kOverloadFallback
+};
+
+// Small jobs maximize the submission rate.
+static constexpr size_t kOverloadChunkSize = 4 * kkB;
+// Operations per thread per iteration.
+static constexpr size_t kOverloadOpsPerThread = 16;
+
+#define _PARSE_ARGS_OVERLOAD_                                                  \
+  _PARSE_IN                                                                    \
+  auto policy_type = Inputs;                                                   \
+  auto deadline_us = _PARSE_ARG(int);                                          \
+  auto thread_n = _PARSE_ARG(int);                                             \
+  auto inflight_jobs = _PARSE_ARG(int);                                        \
+  auto op_size = _PARSE_ARG(size_t);                                           \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+static SubmitPolicy make_policy(OverloadPolicy type, int deadline_us) {
+  SubmitPolicy policy;
+  policy.deadline = std::chrono::microseconds(
+      type == kOverloadFail ? 0 : static_cast<int64_t>(deadline_us));
+  policy.software_fallback = type == kOverloadFallback;
+  return policy;
+}
+
+//
+/// @param thread_n threads oversubscribe the work queues, each compressing
+/// op_size regions of the source in kOverloadChunkSize chunks with
+/// @param inflight_jobs jobs; failed operations do not count towards goodput.
+//
+auto BM_Overload_Compress = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_OVERLOAD_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  const auto policy =
+      make_policy(static_cast<OverloadPolicy>(policy_type), deadline_us);
+  const size_t threads = static_cast<size_t>(thread_n);
+  const size_t op_count = mem_size / op_size;
+  if (op_count == 0) {
+    state.SkipWithMessage("Source is smaller than one operation.");
+    return;
+  }
+
+  std::vector<multi_engine::CompressedFormat> compressed_buffs;
+  for (size_t t = 0; t < threads; ++t)
+    compressed_buffs.push_back(
+        multi_engine::make_fixed_chunks(op_size, kOverloadChunkSize));
+
+  auto &stats = SubmitStats::instance();
+  const uint64_t rejected = stats.rejected, retries = stats.retries,
+                 fallbacks = stats.fallbacks, failed = stats.failed;
+  std::vector<double> latencies_us;
+  size_t ops = 0, failed_ops = 0;
+  // Whether the last operation of every thread succeeded.
+  std::vector<uint8_t> last_op_ok(threads, 0);
+
+  // Benchmark.
+  CpuCounters cpu_counters;
+  for (auto _ : state) {
+    std::vector<std::vector<double>> thread_latencies_us(threads);
+    std::atomic<size_t> iteration_failed_ops{0};
+    std::latch start(static_cast<std::ptrdiff_t>(threads + 1));
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t]() {
+        start.arrive_and_wait();
+        for (size_t i = 0; i < kOverloadOpsPerThread; ++i) {
+          auto &compressed_buff = compressed_buffs[t];
+          for (auto &[chunk, size] : compressed_buff)
+            chunk.resize(2 * size);
+          size_t op = (t * kOverloadOpsPerThread + i) % op_count;
+          TimeScope latency;
+          last_op_ok[t] = multi_engine::compress_queued(
+                              multi_engine::kParallelDynamic,
+                              source_buff + op * op_size, op_size,
+                              static_cast<size_t>(inflight_jobs),
+                              &compressed_buff, kWaitBusyPoll, policy) == 0;
+          if (last_op_ok[t])
+            thread_latencies_us[t].push_back(
+                latency.GetTimeStamp<std::chrono::nanoseconds>() / 1000.0);
+          else
+            ++iteration_failed_ops;
+        }
+      });
+    }
+    start.arrive_and_wait();
+    for (auto &worker : workers)
+      worker.join();
+
+    for (auto &thread_latencies : thread_latencies_us)
+      latencies_us.insert(latencies_us.end(), thread_latencies.begin(),
+                          thread_latencies.end());
+    ops += threads * kOverloadOpsPerThread;
+    failed_ops += iteration_failed_ops;
+  }
+  cpu_counters.report(state, static_cast<double>((ops - failed_ops) * op_size));
+
+  // Goodput: only the successfully compressed bytes.
+  state.SetBytesProcessed(static_cast<int64_t>((ops - failed_ops) * op_size));
+  state.counters["Failed Ops"] = failed_ops;
+  state.counters["Failed Ops Share"] =
+      ops ? 1.0 * failed_ops / static_cast<double>(ops) : 0;
+  state.counters["Rejected Jobs"] = stats.rejected - rejected;
+  state.counters["Retries"] = stats.retries - retries;
+  state.counters["Software Fallbacks"] = stats.fallbacks - fallbacks;
+  state.counters["Failed Submissions"] = stats.failed - failed;
+  state.counters["Latency p50, us"] = percentile(latencies_us, 50);
+  state.counters["Latency p99, us"] = percentile(latencies_us, 99);
+
+  // Verify the last successful operation of every thread.
+  auto decompressed_buff = mmap_allocate(op_size);
+  for (size_t t = 0; t < threads; ++t) {
+    if (!last_op_ok[t])
+      continue;
+    size_t op = (t * kOverloadOpsPerThread + kOverloadOpsPerThread - 1) %
+                op_count;
+    size_t decompression_size = 0;
+    if (multi_engine::decompress(compressed_buffs[t], decompressed_buff.get(),
+                                 &decompression_size) ||
+        decompression_size != op_size ||
+        memcmp(source_buff + op * op_size, decompressed_buff.get(),
+               op_size) != 0)
+      state.SkipWithMessage("Data missmatch.");
+  }
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace overload
+
+#endif
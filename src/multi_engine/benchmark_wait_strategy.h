@@ -0,0 +1,164 @@
+#ifndef _BENCHMARK_WAIT_STRATEGY_H_
+#define _BENCHMARK_WAIT_STRATEGY_H_
+
+#include <cstdarg>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+#include "qpl_parallel.h"
+
+namespace wait_strategies {
+
+#define _PARSE_ARGS_WAIT_                                                      \
+  _PARSE_IN                                                                    \
+  auto wait = static_cast<WaitStrategy>(Inputs);                               \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto job_n = _PARSE_ARG(int);                                                \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+/// Compress with one job through the single engine path, or with @param job_n
+/// jobs through the multi-engine path.
+static int compress(WaitStrategy wait, int job_n, const uint8_t *src,
+                    size_t src_size, multi_engine::CompressedFormat *chunks) {
+  if (job_n == 1) {
+    auto &[dst, size] = chunks->front();
+    size_t compressed_size = dst.size();
+    if (single_engine::compress(qpl_path_hardware, qpl_default_level,
+                                single_engine::kModeFixed, nullptr, nullptr,
+                                src, src_size, dst.data(), &compressed_size,
+                                wait))
+      return -1;
+    dst.resize(compressed_size);
+    return 0;
+  }
+  return multi_engine::compress(multi_engine::kParallelFixed, src, src_size,
+                                chunks, wait);
+}
+
+static int decompress(WaitStrategy wait, int job_n,
+                      multi_engine::CompressedFormat &chunks, uint8_t *dst,
+                      size_t *dst_actual_size) {
+  if (job_n == 1) {
+    auto &[src, size] = chunks.front();
+    return single_engine::decompress(
+        qpl_path_hardware, single_engine::kModeFixed, nullptr, 0, src.data(),
+        src.size(), dst, size, dst_actual_size, wait);
+  }
+  return multi_engine::decompress(chunks, dst, dst_actual_size, wait);
+}
+
+static multi_engine::CompressedFormat make_chunks(size_t mem_size, int job_n) {
+  size_t chunk_size = mem_size / static_cast<unsigned int>(job_n);
+  size_t chunk_size_rem = mem_size % static_cast<unsigned int>(job_n);
+  multi_engine::CompressedFormat chunks;
+  for (int i = 0; i < job_n; ++i) {
+    if (chunk_size_rem && i == job_n - 1)
+      chunk_size += chunk_size_rem;
+    chunks.push_back(std::make_tuple(
+        std::vector<uint8_t>(2 * chunk_size, _PAGE_PREFAULT_),
+        chunk_size)); // x2 space here to allow increase in compressed data
+  }
+  return chunks;
+}
+
+/// CPU time of the waiting thread relative to the wall time of the loop.
+static void set_cpu_counters(benchmark::State &state, double cpu_time,
+                             double wall_time, size_t mem_size) {
+  state.counters["CPU Utilization"] = wall_time ? cpu_time / wall_time : 0;
+  state.counters["CPU Time per Op"] =
+      state.iterations() ? cpu_time / static_cast<double>(state.iterations())
+                         : 0;
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
+}
+
+auto BM_WaitStrategy_Compress = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_WAIT_
+  assert(source_buff != nullptr);
+
+  auto chunks = make_chunks(mem_size, job_n);
+
+  zero_initialize_counters(state);
+
+  // Benchmark compress.
+  TimeScope wall_time;
+  double cpu_time = thread_cpu_time();
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    if (compress(wait, job_n, source_buff, mem_size, &chunks))
+      state.SkipWithMessage("Failed to compress.");
+  }
+  cpu_time = thread_cpu_time() - cpu_time;
+  set_cpu_counters(state, cpu_time,
+                   wall_time.GetTimeStamp<std::chrono::nanoseconds>() / 1e9,
+                   mem_size);
+
+  size_t compressed_size = 0;
+  for (auto &chunk : chunks)
+    compressed_size += std::get<0>(chunk).size();
+  state.counters["Compression Ratio"] = 1.0 * mem_size / compressed_size;
+
+  // Verify with decompress.
+  auto decompressed_buff = mmap_allocate(mem_size);
+  size_t decompression_size = 0;
+  if (decompress(wait, job_n, chunks, decompressed_buff.get(),
+                 &decompression_size))
+    state.SkipWithMessage("Failed to decompress.");
+  if (decompression_size != mem_size ||
+      memcmp(source_buff, decompressed_buff.get(), decompression_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+auto BM_WaitStrategy_DeCompress = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_WAIT_
+  assert(source_buff != nullptr);
+
+  auto chunks = make_chunks(mem_size, job_n);
+
+  zero_initialize_counters(state);
+
+  // Compress.
+  if (compress(wait, job_n, source_buff, mem_size, &chunks))
+    state.SkipWithMessage("Failed to compress.");
+  size_t compressed_size = 0;
+  for (auto &chunk : chunks)
+    compressed_size += std::get<0>(chunk).size();
+  state.counters["Compression Ratio"] = 1.0 * mem_size / compressed_size;
+
+  // Benchmark decompress.
+  auto decompressed_buff = mmap_allocate(mem_size);
+  memset(decompressed_buff.get(), _PAGE_PREFAULT_, mem_size);
+  size_t decompression_size = 0;
+  TimeScope wall_time;
+  double cpu_time = thread_cpu_time();
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    if (decompress(wait, job_n, chunks, decompressed_buff.get(),
+                   &decompression_size))
+      state.SkipWithMessage("Failed to decompress.");
+  }
+  cpu_time = thread_cpu_time() - cpu_time;
+  set_cpu_counters(state, cpu_time,
+                   wall_time.GetTimeStamp<std::chrono::nanoseconds>() / 1e9,
+                   mem_size);
+
+  // Verify.
+  if (decompression_size != mem_size ||
+      memcmp(source_buff, decompressed_buff.get(), decompression_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace wait_strategies
+
+#endif
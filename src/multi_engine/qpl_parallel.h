@@ -1,13 +1,18 @@
 #ifndef _QPL_PARALLEL_H_
 #define _QPL_PARALLEL_H_
 
+#include <algorithm>
 #include <memory>
+#include <numeric>
 #include <unistd.h>
 #include <vector>
 
 #include <glog/logging.h>
 
+#include "../fault_recovery.h"
+#include "../job_submitter.h"
 #include "../util.h"
+#include "../wait_strategy.h"
 
 #include "qpl/qpl.h"
 
@@ -19,7 +24,7 @@ enum CompressionMode { kParallelFixed, kParallelDynamic, kParallelCanned };
 typedef std::vector<std::tuple<std::vector<uint8_t>, size_t>> CompressedFormat;
 typedef std::vector<std::unique_ptr<uint8_t[]>> MultiChunkJob;
 
-MultiChunkJob init_qpl(qpl_path_t e_path, uint8_t threads) {
+MultiChunkJob init_qpl(qpl_path_t e_path, size_t threads) {
   // Job initialization.
   uint32_t job_size = 0;
   qpl_status status = qpl_get_job_size(e_path, &job_size);
@@ -29,7 +34,7 @@ MultiChunkJob init_qpl(qpl_path_t e_path, uint8_t threads) {
   }
 
   MultiChunkJob job_buffers;
-  for (uint8_t i = 0; i < threads; ++i) {
+  for (size_t i = 0; i < threads; ++i) {
     std::unique_ptr<uint8_t[]> job_buffer;
     job_buffer = std::make_unique<uint8_t[]>(job_size);
     auto job = reinterpret_cast<qpl_job *>(job_buffer.get());
@@ -58,8 +63,38 @@ int free_qpl(MultiChunkJob &job_buffers) {
   return 0;
 }
 
+/// Wait for the first @param submitted jobs, so that their buffers can be
+/// released after a failure.
+static void wait_submitted(JobSubmitter &submitter, MultiChunkJob &job_buffers,
+                           size_t submitted) {
+  for (size_t i = 0; i < submitted; ++i) {
+    auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+    while (submitter.check(job) == QPL_STS_BEING_PROCESSED)
+      _mm_pause();
+  }
+}
+
+/// Wait for the jobs of a work queue still in flight after a failure.
+static void drain_queued(JobSubmitter &submitter, MultiChunkJob &job_buffers,
+                         const std::vector<size_t> &job_chunk,
+                         size_t no_chunk) {
+  for (size_t i = 0; i < job_chunk.size(); ++i) {
+    if (job_chunk[i] == no_chunk)
+      continue;
+    auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+    while (submitter.check(job) == QPL_STS_BEING_PROCESSED)
+      _mm_pause();
+  }
+}
+
+/// @param wait - how to wait between completion polls.
+/// @param policy - how to handle submissions rejected by busy queues.
+/// @param recovery - what to do with a job failed on a page fault.
 int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
-             CompressedFormat *compressed_buff) {
+             CompressedFormat *compressed_buff,
+             WaitStrategy wait = kWaitBusyPoll,
+             const SubmitPolicy &policy = SubmitPolicy(),
+             const FaultRecoveryPolicy &recovery = FaultRecoveryPolicy()) {
   size_t thread_count = compressed_buff->size();
   auto job_buffers = init_qpl(qpl_path_hardware, thread_count);
   if (job_buffers.empty()) {
@@ -77,6 +112,8 @@ int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
   }
 
   // Submit compress.
+  JobSubmitter submitter(policy);
+  std::vector<JobBuffers> job_ranges(thread_count);
   size_t src_offst = 0;
   size_t chunk_cnt = 0;
   for (auto &job_buffer : job_buffers) {
@@ -99,10 +136,12 @@ int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
       job->flags |= QPL_FLAG_DYNAMIC_HUFFMAN;
     }
 
-    qpl_status status = qpl_submit_job(job);
+    job_ranges[chunk_cnt] = JobBuffers(job);
+    qpl_status status = submitter.submit(job);
     if (status != QPL_STS_OK) {
       LOG(WARNING) << "An error " << status
                    << " acquired during compression job submission.";
+      wait_submitted(submitter, job_buffers, chunk_cnt);
       return -1;
     }
 
@@ -111,13 +150,17 @@ int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
   }
 
   // Wait for compression and gather.
+  CompletionWaiter waiter(wait);
   std::vector<uint8_t> cmpl(thread_count, 0);
   while (std::reduce(cmpl.begin(), cmpl.end()) != thread_count) {
+    bool progress = false;
     for (size_t i = 0; i < job_buffers.size(); ++i) {
       if (cmpl[i] == 0) {
         qpl_job *job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
-        auto status = qpl_check_job(job);
+        auto status = submitter.check(job);
         if (status != QPL_STS_BEING_PROCESSED) {
+          status = recover_faulted_job(job, job_ranges[i], status, wait,
+                                       recovery);
           if (status != QPL_STS_OK) {
             LOG(WARNING) << "An error " << status
                          << " acquired during awaiting for completion";
@@ -125,9 +168,14 @@ int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
           }
           std::get<0>(compressed_buff->at(i)).resize(job->total_out);
           cmpl[i] = 1;
+          progress = true;
         }
       }
     }
+    if (progress)
+      waiter.reset();
+    else
+      waiter.wait();
   }
 
   if (free_qpl(job_buffers)) {
@@ -138,7 +186,9 @@ int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
 }
 
 int decompress(CompressedFormat &compressed_buff, uint8_t *dst,
-               size_t *dst_actual_size) {
+               size_t *dst_actual_size, WaitStrategy wait = kWaitBusyPoll,
+               const SubmitPolicy &policy = SubmitPolicy(),
+               const FaultRecoveryPolicy &recovery = FaultRecoveryPolicy()) {
   size_t thread_count = compressed_buff.size();
   auto job_buffers = init_qpl(qpl_path_hardware, thread_count);
   if (job_buffers.empty()) {
@@ -147,6 +197,8 @@ int decompress(CompressedFormat &compressed_buff, uint8_t *dst,
   }
 
   // Submit decompress.
+  JobSubmitter submitter(policy);
+  std::vector<JobBuffers> job_ranges(thread_count);
   size_t dst_offst = 0;
   size_t chunk_cnt = 0;
   for (auto &job_buffer : job_buffers) {
@@ -160,10 +212,12 @@ int decompress(CompressedFormat &compressed_buff, uint8_t *dst,
     job->available_out = decompress_chunk_size;
     job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST;
 
-    qpl_status status = qpl_submit_job(job);
+    job_ranges[chunk_cnt] = JobBuffers(job);
+    qpl_status status = submitter.submit(job);
     if (status != QPL_STS_OK) {
       LOG(WARNING) << "An error " << status
                    << " acquired during compression job submission.";
+      wait_submitted(submitter, job_buffers, chunk_cnt);
       return -1;
     }
 
@@ -172,14 +226,18 @@ int decompress(CompressedFormat &compressed_buff, uint8_t *dst,
   }
 
   // Wait for decompression.
+  CompletionWaiter waiter(wait);
   size_t decompress_size = 0;
   std::vector<uint8_t> cmpl(thread_count, 0);
   while (std::reduce(cmpl.begin(), cmpl.end()) != thread_count) {
+    bool progress = false;
     for (size_t i = 0; i < job_buffers.size(); ++i) {
       if (cmpl[i] == 0) {
         qpl_job *job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
-        auto status = qpl_check_job(job);
+        auto status = submitter.check(job);
         if (status != QPL_STS_BEING_PROCESSED) {
+          status = recover_faulted_job(job, job_ranges[i], status, wait,
+                                       recovery);
           if (status != QPL_STS_OK) {
             LOG(WARNING) << "An error " << status
                          << " acquired during awaiting for completion";
@@ -187,15 +245,487 @@ int decompress(CompressedFormat &compressed_buff, uint8_t *dst,
           }
           decompress_size += job->total_out;
           cmpl[i] = 1;
+          progress = true;
         }
       }
     }
+    if (progress)
+      waiter.reset();
+    else
+      waiter.wait();
   }
 
   *dst_actual_size = decompress_size;
   return 0;
 }
 
+static void prepare_compress_job(qpl_job *job, CompressionMode mode,
+                                 qpl_huffman_table_t huffman_table,
+                                 const uint8_t *src, size_t src_size,
+                                 uint8_t *dst, size_t dst_size) {
+  job->op = qpl_op_compress;
+  job->level = qpl_default_level;
+  job->next_in_ptr = const_cast<uint8_t *>(src);
+  job->available_in = src_size;
+  job->next_out_ptr = dst;
+  job->available_out = dst_size;
+  job->flags = QPL_FLAG_FIRST | QPL_FLAG_OMIT_VERIFY | QPL_FLAG_LAST;
+
+  if (mode == kParallelCanned) {
+    job->huffman_table = huffman_table;
+  } else if (mode == kParallelDynamic) {
+    job->flags |= QPL_FLAG_DYNAMIC_HUFFMAN;
+  }
+}
+
+//
+/// Output space of a compressed chunk: dst with capacity bytes reserved; size
+/// is set on completion, or overflowed if the chunk did not fit.
+//
+struct ChunkOutput {
+  uint8_t *dst = nullptr;
+  size_t capacity = 0;
+  size_t size = 0;
+  bool overflowed = false;
+};
+
+/// Compress the chunks of @param src listed in @param chunks (chunk i holds
+/// @param src_sizes [i] bytes at @param src_offsets [i]) into
+/// @param outputs with a work queue of at most @param inflight_jobs jobs: a
+/// new chunk is submitted as soon as any job completes, which balances the
+/// load across engines. Unless @param allow_overflow, a chunk not fitting its
+/// output space is an error.
+static int compress_queued_outputs(
+    CompressionMode mode, const uint8_t *src, size_t src_size,
+    const std::vector<size_t> &src_offsets,
+    const std::vector<size_t> &src_sizes, const std::vector<size_t> &chunks,
+    size_t inflight_jobs, std::vector<ChunkOutput> *outputs,
+    bool allow_overflow, WaitStrategy wait, const SubmitPolicy &policy,
+    const FaultRecoveryPolicy &recovery) {
+  const size_t chunk_count = chunks.size();
+  if (chunk_count == 0)
+    return 0;
+  inflight_jobs = std::min(inflight_jobs, chunk_count);
+  auto job_buffers = init_qpl(qpl_path_hardware, inflight_jobs);
+  if (job_buffers.empty()) {
+    LOG(WARNING) << "Failed to init qpl.";
+    return -1;
+  }
+
+  qpl_huffman_table_t huffman_table = nullptr;
+  if (mode == kParallelCanned) {
+    if (create_static_huffman_tables(qpl_path_hardware, &huffman_table, src,
+                                     src_size)) {
+      LOG(WARNING) << "Failed to create huffman tables.";
+      return -1;
+    }
+  }
+
+  JobSubmitter submitter(policy);
+  constexpr size_t kNoChunk = static_cast<size_t>(-1);
+  std::vector<size_t> job_chunk(inflight_jobs, kNoChunk);
+  std::vector<JobBuffers> job_ranges(inflight_jobs);
+  size_t next_chunk = 0;
+  auto submit_next = [&](size_t job_i) {
+    const size_t chunk = chunks[next_chunk];
+    auto &output = outputs->at(chunk);
+    auto job = reinterpret_cast<qpl_job *>(job_buffers[job_i].get());
+    prepare_compress_job(job, mode, huffman_table, src + src_offsets[chunk],
+                         src_sizes[chunk], output.dst, output.capacity);
+    job_ranges[job_i] = JobBuffers(job);
+    qpl_status status = submitter.submit(job);
+    if (status != QPL_STS_OK) {
+      LOG(WARNING) << "An error " << status
+                   << " acquired during compression job submission.";
+      return -1;
+    }
+    job_chunk[job_i] = chunk;
+    ++next_chunk;
+    return 0;
+  };
+
+  int ret = 0;
+  for (size_t i = 0; i < inflight_jobs && ret == 0; ++i)
+    ret = submit_next(i);
+
+  // Wait for completions and refill the queue.
+  CompletionWaiter waiter(wait);
+  size_t completed = 0;
+  while (ret == 0 && completed != chunk_count) {
+    size_t completed_before = completed;
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+      if (job_chunk[i] == kNoChunk)
+        continue;
+      qpl_job *job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+      auto status = submitter.check(job);
+      if (status == QPL_STS_BEING_PROCESSED)
+        continue;
+      status = recover_faulted_job(job, job_ranges[i], status, wait,
+                                       recovery);
+      auto &output = outputs->at(job_chunk[i]);
+      if (allow_overflow && (status == QPL_STS_MORE_OUTPUT_NEEDED ||
+                             status == QPL_STS_DST_IS_SHORT_ERR)) {
+        output.overflowed = true;
+      } else if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status
+                     << " acquired during awaiting for completion";
+        job_chunk[i] = kNoChunk;
+        ret = -1;
+        break;
+      } else {
+        output.size = job->total_out;
+      }
+      job_chunk[i] = kNoChunk;
+      ++completed;
+      if (next_chunk < chunk_count)
+        ret = submit_next(i);
+    }
+    if (completed != completed_before)
+      waiter.reset();
+    else
+      waiter.wait();
+  }
+  drain_queued(submitter, job_buffers, job_chunk, kNoChunk);
+
+  if (huffman_table != nullptr)
+    qpl_huffman_table_destroy(huffman_table);
+  if (free_qpl(job_buffers)) {
+    LOG(WARNING) << "Failed to free resources.";
+    return -1;
+  }
+  return ret;
+}
+
+/// Cut @param mem_size into fixed-size chunks of @param chunk_size (the last
+/// one might be shorter).
+static CompressedFormat make_fixed_chunks(size_t mem_size, size_t chunk_size) {
+  CompressedFormat compressed_buff;
+  for (size_t offset = 0; offset < mem_size; offset += chunk_size) {
+    size_t size = std::min(chunk_size, mem_size - offset);
+    compressed_buff.push_back(std::make_tuple(
+        std::vector<uint8_t>(2 * size, _PAGE_PREFAULT_),
+        size)); // x2 space here to allow increase in compressed data
+  }
+  return compressed_buff;
+}
+
+/// Compress the chunks of @param compressed_buff (any number of them, each
+/// holding its reserved output space and original size) with
+/// compress_queued_outputs(). Only the chunks listed in @param chunks are
+/// (re)compressed.
+int compress_queued_chunks(CompressionMode mode, const uint8_t *src,
+                           size_t src_size, const std::vector<size_t> &chunks,
+                           size_t inflight_jobs,
+                           CompressedFormat *compressed_buff,
+                           WaitStrategy wait = kWaitBusyPoll,
+                           const SubmitPolicy &policy = SubmitPolicy(),
+                           const FaultRecoveryPolicy &recovery =
+                               FaultRecoveryPolicy()) {
+  // Chunk offsets in the source.
+  const size_t chunk_count = compressed_buff->size();
+  std::vector<size_t> src_offsets(chunk_count, 0), src_sizes(chunk_count);
+  std::vector<ChunkOutput> outputs(chunk_count);
+  for (size_t i = 0; i < chunk_count; ++i) {
+    auto &[chunk_buff, chunk_size] = compressed_buff->at(i);
+    if (i != 0)
+      src_offsets[i] = src_offsets[i - 1] + src_sizes[i - 1];
+    src_sizes[i] = chunk_size;
+    outputs[i].dst = chunk_buff.data();
+    outputs[i].capacity = chunk_buff.size();
+  }
+
+  int ret = compress_queued_outputs(mode, src, src_size, src_offsets,
+                                    src_sizes, chunks, inflight_jobs, &outputs,
+                                    false, wait, policy, recovery);
+  if (ret == 0)
+    for (auto chunk : chunks)
+      std::get<0>(compressed_buff->at(chunk)).resize(outputs[chunk].size);
+  return ret;
+}
+
+/// compress_queued_chunks() of all the chunks.
+int compress_queued(CompressionMode mode, const uint8_t *src, size_t src_size,
+                    size_t inflight_jobs, CompressedFormat *compressed_buff,
+                    WaitStrategy wait = kWaitBusyPoll,
+                    const SubmitPolicy &policy = SubmitPolicy(),
+                    const FaultRecoveryPolicy &recovery =
+                        FaultRecoveryPolicy()) {
+  std::vector<size_t> chunks(compressed_buff->size());
+  std::iota(chunks.begin(), chunks.end(), 0);
+  return compress_queued_chunks(mode, src, src_size, chunks, inflight_jobs,
+                                compressed_buff, wait, policy, recovery);
+}
+
+typedef std::vector<std::pair<const uint8_t *, size_t>> CompressedChunks;
+
+/// Offsets of chunks of @param sizes stored back to back.
+static std::vector<size_t> back_to_back_offsets(
+    const std::vector<size_t> &sizes) {
+  std::vector<size_t> offsets(sizes.size(), 0);
+  for (size_t i = 1; i < sizes.size(); ++i)
+    offsets[i] = offsets[i - 1] + sizes[i - 1];
+  return offsets;
+}
+
+/// Decompress @param inputs (compressed chunks) into @param dst, chunk i to
+/// @param original_sizes [i] bytes at @param dst_offsets [i], with a work
+/// queue of at most @param inflight_jobs jobs.
+static int decompress_queued_inputs(const CompressedChunks &inputs,
+                                    const std::vector<size_t> &original_sizes,
+                                    const std::vector<size_t> &dst_offsets,
+                                    uint8_t *dst, size_t inflight_jobs,
+                                    size_t *dst_actual_size, WaitStrategy wait,
+                                    const SubmitPolicy &policy,
+                                    const FaultRecoveryPolicy &recovery) {
+  const size_t chunk_count = inputs.size();
+  inflight_jobs = std::min(inflight_jobs, chunk_count);
+  auto job_buffers = init_qpl(qpl_path_hardware, inflight_jobs);
+  if (job_buffers.empty()) {
+    LOG(WARNING) << "Failed to init qpl.";
+    return -1;
+  }
+
+  JobSubmitter submitter(policy);
+  constexpr size_t kNoChunk = static_cast<size_t>(-1);
+  std::vector<size_t> job_chunk(inflight_jobs, kNoChunk);
+  std::vector<JobBuffers> job_ranges(inflight_jobs);
+  size_t next_chunk = 0;
+  auto submit_next = [&](size_t job_i) {
+    auto job = reinterpret_cast<qpl_job *>(job_buffers[job_i].get());
+    job->op = qpl_op_decompress;
+    job->next_in_ptr = const_cast<uint8_t *>(inputs[next_chunk].first);
+    job->available_in = inputs[next_chunk].second;
+    job->next_out_ptr = dst + dst_offsets[next_chunk];
+    job->available_out = original_sizes[next_chunk];
+    job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST;
+    job_ranges[job_i] = JobBuffers(job);
+    qpl_status status = submitter.submit(job);
+    if (status != QPL_STS_OK) {
+      LOG(WARNING) << "An error " << status
+                   << " acquired during decompression job submission.";
+      return -1;
+    }
+    job_chunk[job_i] = next_chunk++;
+    return 0;
+  };
+  int ret = 0;
+  for (size_t i = 0; i < inflight_jobs && ret == 0; ++i)
+    ret = submit_next(i);
+
+  // Wait for completions and refill the queue.
+  CompletionWaiter waiter(wait);
+  size_t completed = 0;
+  size_t decompress_size = 0;
+  while (ret == 0 && completed != chunk_count) {
+    size_t completed_before = completed;
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+      if (job_chunk[i] == kNoChunk)
+        continue;
+      qpl_job *job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+      auto status = submitter.check(job);
+      if (status == QPL_STS_BEING_PROCESSED)
+        continue;
+      status = recover_faulted_job(job, job_ranges[i], status, wait,
+                                       recovery);
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status
+                     << " acquired during awaiting for completion";
+        job_chunk[i] = kNoChunk;
+        ret = -1;
+        break;
+      }
+      decompress_size += job->total_out;
+      job_chunk[i] = kNoChunk;
+      ++completed;
+      if (next_chunk < chunk_count)
+        ret = submit_next(i);
+    }
+    if (completed != completed_before)
+      waiter.reset();
+    else
+      waiter.wait();
+  }
+  drain_queued(submitter, job_buffers, job_chunk, kNoChunk);
+
+  if (free_qpl(job_buffers)) {
+    LOG(WARNING) << "Failed to free resources.";
+    return -1;
+  }
+  *dst_actual_size = decompress_size;
+  return ret;
+}
+
+/// Work queue counterpart of decompress(), see compress_queued().
+int decompress_queued(CompressedFormat &compressed_buff, uint8_t *dst,
+                      size_t inflight_jobs, size_t *dst_actual_size,
+                      WaitStrategy wait = kWaitBusyPoll,
+                      const SubmitPolicy &policy = SubmitPolicy(),
+                      const FaultRecoveryPolicy &recovery =
+                          FaultRecoveryPolicy()) {
+  CompressedChunks inputs;
+  std::vector<size_t> original_sizes;
+  for (auto &[chunk_buff, chunk_size] : compressed_buff) {
+    inputs.emplace_back(chunk_buff.data(), chunk_buff.size());
+    original_sizes.push_back(chunk_size);
+  }
+  return decompress_queued_inputs(inputs, original_sizes,
+                                  back_to_back_offsets(original_sizes), dst,
+                                  inflight_jobs, dst_actual_size, wait, policy,
+                                  recovery);
+}
+
+/// decompress_queued() of chunk i of @param compressed_buff to
+/// @param dst + @param dst_offsets [i] rather than back to back.
+int decompress_queued_scattered(CompressedFormat &compressed_buff,
+                                const std::vector<size_t> &dst_offsets,
+                                uint8_t *dst, size_t inflight_jobs,
+                                size_t *dst_actual_size,
+                                WaitStrategy wait = kWaitBusyPoll,
+                                const SubmitPolicy &policy = SubmitPolicy()) {
+  CompressedChunks inputs;
+  std::vector<size_t> original_sizes;
+  for (auto &[chunk_buff, chunk_size] : compressed_buff) {
+    inputs.emplace_back(chunk_buff.data(), chunk_buff.size());
+    original_sizes.push_back(chunk_size);
+  }
+  return decompress_queued_inputs(inputs, original_sizes, dst_offsets, dst,
+                                  inflight_jobs, dst_actual_size, wait, policy,
+                                  FaultRecoveryPolicy());
+}
+
+static constexpr size_t kCompressBoundSlack = 1 * kkB;
+
+/// Output space reserved for compressing @param size bytes: 9 bits per byte
+/// (the longest fixed Huffman literal code; dynamic codes are shorter on
+/// average, stored blocks smaller) plus block headers. Canned tables built
+/// from other data may exceed it, hence the overflow retry of
+/// compress_arena().
+static constexpr size_t compress_bound(size_t size) {
+  return size + size / 8 + kCompressBoundSlack;
+}
+
+//
+/// Compressed chunks of a buffer back to back in one contiguous mapping, in
+/// place of one vector of twice the chunk size per chunk.
+//
+struct CompressedArena {
+  std::unique_ptr<uint8_t, MMapDeleter> buff;
+  size_t capacity = 0;
+  // Original size of every chunk.
+  std::vector<size_t> original_sizes;
+  // Offset and compressed size of every chunk in buff.
+  std::vector<size_t> offsets;
+  std::vector<size_t> sizes;
+  // Chunks that overflowed their reserved space in the last compression.
+  size_t overflows = 0;
+
+  size_t compressed_size() const {
+    return std::accumulate(sizes.begin(), sizes.end(), size_t(0));
+  }
+};
+
+/// Arena for @param mem_size bytes cut into fixed-size chunks of
+/// @param chunk_size (the last one might be shorter), each reserving
+/// compress_bound() of its size; prefaulted as the per-chunk vectors are.
+static CompressedArena make_arena(size_t mem_size, size_t chunk_size) {
+  CompressedArena arena;
+  for (size_t offset = 0; offset < mem_size; offset += chunk_size) {
+    size_t size = std::min(chunk_size, mem_size - offset);
+    arena.original_sizes.push_back(size);
+    arena.capacity += compress_bound(size);
+  }
+  arena.offsets.assign(arena.original_sizes.size(), 0);
+  arena.sizes.assign(arena.original_sizes.size(), 0);
+  arena.buff = mmap_allocate(arena.capacity);
+  memset(arena.buff.get(), _PAGE_PREFAULT_, arena.capacity);
+  return arena;
+}
+
+/// compress_queued() into @param arena: every chunk is compressed at its
+/// reserved offset, then the chunks are compacted to the front of the arena.
+/// Chunks overflowing their reserved space are recompressed into buffers of
+/// twice their size and copied in; the arena grows if they do not fit.
+int compress_arena(CompressionMode mode, const uint8_t *src, size_t src_size,
+                   size_t inflight_jobs, CompressedArena *arena,
+                   WaitStrategy wait = kWaitBusyPoll,
+                   const SubmitPolicy &policy = SubmitPolicy()) {
+  const size_t chunk_count = arena->original_sizes.size();
+  std::vector<size_t> src_offsets(chunk_count, 0);
+  std::vector<ChunkOutput> outputs(chunk_count);
+  size_t reserved_offset = 0;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    if (i != 0)
+      src_offsets[i] = src_offsets[i - 1] + arena->original_sizes[i - 1];
+    outputs[i].dst = arena->buff.get() + reserved_offset;
+    outputs[i].capacity = compress_bound(arena->original_sizes[i]);
+    reserved_offset += outputs[i].capacity;
+  }
+  std::vector<size_t> chunks(chunk_count);
+  std::iota(chunks.begin(), chunks.end(), 0);
+  if (compress_queued_outputs(mode, src, src_size, src_offsets,
+                              arena->original_sizes, chunks, inflight_jobs,
+                              &outputs, true, wait, policy,
+                              FaultRecoveryPolicy()))
+    return -1;
+
+  // Retry the overflowed chunks with more space.
+  std::vector<std::vector<uint8_t>> overflow_buffs(chunk_count);
+  std::vector<size_t> overflowed;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    if (!outputs[i].overflowed)
+      continue;
+    overflow_buffs[i].assign(2 * arena->original_sizes[i] + kCompressBoundSlack,
+                             _PAGE_PREFAULT_);
+    outputs[i] = ChunkOutput{overflow_buffs[i].data(),
+                             overflow_buffs[i].size(), 0, false};
+    overflowed.push_back(i);
+  }
+  arena->overflows = overflowed.size();
+  if (compress_queued_outputs(mode, src, src_size, src_offsets,
+                              arena->original_sizes, overflowed, inflight_jobs,
+                              &outputs, false, wait, policy,
+                              FaultRecoveryPolicy()))
+    return -1;
+
+  // Compact. Without overflows every chunk moves towards the front, so it can
+  // be done in place; otherwise into a new mapping.
+  size_t total = 0;
+  for (const auto &output : outputs)
+    total += output.size;
+  std::unique_ptr<uint8_t, MMapDeleter> compacted;
+  if (!overflowed.empty()) {
+    arena->capacity = std::max(arena->capacity, total);
+    compacted = mmap_allocate(arena->capacity);
+    // Prefaulted as make_arena() does, so that the copies below do not take
+    // the page faults.
+    memset(compacted.get(), _PAGE_PREFAULT_, arena->capacity);
+  }
+  uint8_t *dst = compacted != nullptr ? compacted.get() : arena->buff.get();
+  size_t offset = 0;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    memmove(dst + offset, outputs[i].dst, outputs[i].size);
+    arena->offsets[i] = offset;
+    arena->sizes[i] = outputs[i].size;
+    offset += outputs[i].size;
+  }
+  if (compacted != nullptr)
+    arena->buff = std::move(compacted);
+  return 0;
+}
+
+/// decompress_queued() counterpart for an arena filled by compress_arena().
+int decompress_arena(const CompressedArena &arena, uint8_t *dst,
+                     size_t inflight_jobs, size_t *dst_actual_size,
+                     WaitStrategy wait = kWaitBusyPoll,
+                     const SubmitPolicy &policy = SubmitPolicy()) {
+  CompressedChunks inputs;
+  for (size_t i = 0; i < arena.sizes.size(); ++i)
+    inputs.emplace_back(arena.buff.get() + arena.offsets[i], arena.sizes[i]);
+  return decompress_queued_inputs(
+      inputs, arena.original_sizes, back_to_back_offsets(arena.original_sizes),
+      dst, inflight_jobs, dst_actual_size, wait, policy, FaultRecoveryPolicy());
+}
+
 } // namespace multi_engine
 
 #endif
@@ -0,0 +1,234 @@
+#ifndef _TRANSLATION_WARMER_H_
+#define _TRANSLATION_WARMER_H_
+
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../job_submitter.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+#include "qpl_parallel.h"
+
+#include "qpl/qpl.h"
+
+namespace multi_engine {
+
+enum WarmMethod {
+  // One crc64 job over the whole buffer, as
+  // single_engine::iaa_translation_fetch().
+  kWarmSerialScan,
+  // crc64 jobs over equal parts of the buffer on several engines.
+  kWarmParallelScan,
+  // One kWarmProbeSize crc64 probe per translation stride (4 kB page or 2 MB
+  // huge page) on a queue of jobs.
+  kWarmSparseProbe
+};
+
+static constexpr size_t kWarmProbeSize = 64;
+
+typedef std::vector<std::pair<const uint8_t *, size_t>> WarmRanges;
+
+/// Ranges read by @param method to warm the translations of @param buff.
+static WarmRanges warm_ranges(WarmMethod method, const uint8_t *buff,
+                              size_t size, size_t stride,
+                              size_t inflight_jobs) {
+  WarmRanges ranges;
+  if (size == 0)
+    return ranges;
+  if (method == kWarmSerialScan) {
+    ranges.emplace_back(buff, size);
+  } else if (method == kWarmParallelScan) {
+    const size_t part = (size + inflight_jobs - 1) / inflight_jobs;
+    for (size_t offset = 0; offset < size; offset += part)
+      ranges.emplace_back(buff + offset, std::min(part, size - offset));
+  } else {
+    // The first probe may start mid-stride; the others start at stride
+    // boundaries, so that no probe crosses one.
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(buff);
+    const uintptr_t end = begin + size;
+    for (uintptr_t probe = begin; probe < end;
+         probe = (probe / stride + 1) * stride)
+      ranges.emplace_back(reinterpret_cast<const uint8_t *>(probe),
+                          std::min<size_t>(kWarmProbeSize, end - probe));
+  }
+  return ranges;
+}
+
+//
+/// crc64 jobs reading ranges of memory, at most as many in flight as jobs.
+/// The jobs are initialized once, ahead of run(), so that run() costs only
+/// the reads.
+//
+class Crc64Jobs {
+public:
+  explicit Crc64Jobs(size_t inflight_jobs) {
+    if (inflight_jobs == 0)
+      return;
+    job_buffers_ = init_qpl(qpl_path_hardware, inflight_jobs);
+    if (job_buffers_.empty())
+      LOG(WARNING) << "Failed to init qpl.";
+    busy_.assign(job_buffers_.size(), 0);
+  }
+
+  ~Crc64Jobs() {
+    if (free_qpl(job_buffers_))
+      LOG(WARNING) << "Failed to free resources.";
+  }
+
+  Crc64Jobs(const Crc64Jobs &) = delete;
+  Crc64Jobs &operator=(const Crc64Jobs &) = delete;
+
+  /// Run a crc64 job over every range of @param ranges.
+  int run(const WarmRanges &ranges, WaitStrategy wait) {
+    if (ranges.empty())
+      return 0;
+    if (job_buffers_.empty())
+      return -1;
+    const size_t inflight_jobs = std::min(job_buffers_.size(), ranges.size());
+    size_t next_range = 0;
+    auto submit_next = [&](size_t job_i) {
+      auto job = this->job(job_i);
+      job->op = qpl_op_crc64;
+      job->next_in_ptr = const_cast<uint8_t *>(ranges[next_range].first);
+      job->available_in = ranges[next_range].second;
+      job->crc64_poly = kPoly;
+      qpl_status status = submitter_.submit(job);
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status
+                     << " acquired during crc job submission.";
+        return -1;
+      }
+      busy_[job_i] = 1;
+      ++next_range;
+      return 0;
+    };
+
+    int ret = 0;
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i)
+      ret = submit_next(i);
+
+    CompletionWaiter waiter(wait);
+    size_t completed = 0;
+    while (ret == 0 && completed != ranges.size()) {
+      size_t completed_before = completed;
+      for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+        if (!busy_[i])
+          continue;
+        auto status = submitter_.check(job(i));
+        if (status == QPL_STS_BEING_PROCESSED)
+          continue;
+        busy_[i] = 0;
+        if (status != QPL_STS_OK) {
+          LOG(WARNING) << "An error " << status << " acquired during crc";
+          ret = -1;
+          break;
+        }
+        ++completed;
+        if (next_range < ranges.size())
+          ret = submit_next(i);
+      }
+      if (completed != completed_before)
+        waiter.reset();
+      else
+        waiter.wait();
+    }
+    drain();
+    return ret;
+  }
+
+private:
+  static constexpr uint64_t kPoly = 0x04C11DB700000000;
+
+  qpl_job *job(size_t i) {
+    return reinterpret_cast<qpl_job *>(job_buffers_[i].get());
+  }
+
+  /// Wait for the jobs still in flight after a failure.
+  void drain() {
+    for (size_t i = 0; i < busy_.size(); ++i) {
+      while (busy_[i] && submitter_.check(job(i)) == QPL_STS_BEING_PROCESSED)
+        _mm_pause();
+      busy_[i] = 0;
+    }
+  }
+
+  MultiChunkJob job_buffers_;
+  std::vector<uint8_t> busy_;
+  JobSubmitter submitter_;
+};
+
+/// Jobs @param method keeps in flight over @param ranges.
+static size_t warm_jobs(WarmMethod method, const WarmRanges &ranges,
+                        size_t inflight_jobs) {
+  return std::min(method == kWarmSerialScan ? 1 : inflight_jobs,
+                  ranges.size());
+}
+
+/// Make the engines cache the address translations of @param buff of
+/// @param size bytes by reading it with crc64 jobs: the whole buffer
+/// (kWarmSerialScan, kWarmParallelScan) or one probe per @param stride bytes
+/// (kWarmSparseProbe: 4 kB, or 2 MB for buffers backed by huge pages).
+int warm_translations(WarmMethod method, const uint8_t *buff, size_t size,
+                      size_t stride, size_t inflight_jobs,
+                      WaitStrategy wait = kWaitBusyPoll) {
+  const auto ranges = warm_ranges(method, buff, size, stride, inflight_jobs);
+  Crc64Jobs jobs(warm_jobs(method, ranges, inflight_jobs));
+  return jobs.run(ranges, wait);
+}
+
+//
+/// warm_translations() on a thread of its own: the ranges, jobs and thread
+/// are set up at construction, start() releases the warming ahead of the job
+/// that needs the translations; wait() before submitting that job.
+//
+class TranslationWarmer {
+public:
+  TranslationWarmer(WarmMethod method, const uint8_t *buff, size_t size,
+                    size_t stride, size_t inflight_jobs,
+                    WaitStrategy wait = kWaitBusyPoll)
+      : ranges_(warm_ranges(method, buff, size, stride, inflight_jobs)),
+        jobs_(warm_jobs(method, ranges_, inflight_jobs)),
+        started_(start_.get_future()), thread_([this, wait] {
+          started_.wait();
+          status_ = jobs_.run(ranges_, wait);
+        }) {}
+
+  ~TranslationWarmer() { wait(); }
+
+  TranslationWarmer(const TranslationWarmer &) = delete;
+  TranslationWarmer &operator=(const TranslationWarmer &) = delete;
+
+  /// Start the warming.
+  void start() {
+    if (!start_called_) {
+      start_called_ = true;
+      start_.set_value();
+    }
+  }
+
+  /// Wait for the warming, started if it was not; 0 if it succeeded.
+  int wait() {
+    start();
+    if (thread_.joinable())
+      thread_.join();
+    return status_;
+  }
+
+private:
+  WarmRanges ranges_;
+  Crc64Jobs jobs_;
+  std::promise<void> start_;
+  std::future<void> started_;
+  bool start_called_ = false;
+  int status_ = 0;
+  std::thread thread_;
+};
+
+} // namespace multi_engine
+
+#endif
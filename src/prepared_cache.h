@@ -0,0 +1,293 @@
+#ifndef _PREPARED_CACHE_H_
+#define _PREPARED_CACHE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "util.h"
+
+DEFINE_string(prepared_cache_dir, ".iaa_cache",
+              "Directory of the on-disk cache of prepared benchmark inputs "
+              "(compressed files, page fault scenario files); empty disables "
+              "the cache.");
+DEFINE_uint64(prepared_cache_max_mb, 16384,
+              "Maximum size of the prepared inputs cache; least recently used "
+              "entries are evicted above it.");
+DEFINE_bool(prepared_cache_verify, false,
+            "Re-hash cached files on every hit in addition to the size and "
+            "metadata validation.");
+
+namespace prepared_cache {
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+/// Fast non-cryptographic 64-bit content hash (4 independent lanes).
+uint64_t content_hash(const uint8_t *mem, size_t size) {
+  constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+  constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+  constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+
+  uint64_t lanes[4] = {kPrime1 + kPrime2, kPrime2, 0, ~kPrime1};
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (size_t l = 0; l < 4; ++l) {
+      uint64_t word;
+      memcpy(&word, mem + i + 8 * l, sizeof(word));
+      lanes[l] = rotl64(lanes[l] + word * kPrime2, 31) * kPrime1;
+    }
+  }
+
+  uint64_t h = static_cast<uint64_t>(size) * kPrime3;
+  for (size_t l = 0; l < 4; ++l)
+    h = (h ^ rotl64(lanes[l], static_cast<int>(7 * l + 1))) * kPrime1;
+  for (; i < size; ++i)
+    h = rotl64(h ^ (mem[i] * kPrime3), 11) * kPrime1;
+
+  // Final avalanche.
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+/// Hash the content of file @param path; returns 0 on success.
+int file_content_hash(const std::string &path, size_t size, uint64_t *hash) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return -1;
+  if (size == 0) {
+    close(fd);
+    *hash = content_hash(nullptr, 0);
+    return 0;
+  }
+  auto mem = reinterpret_cast<uint8_t *>(
+      mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+  close(fd);
+  if (mem == MAP_FAILED)
+    return -1;
+  *hash = content_hash(mem, size);
+  munmap(mem, size);
+  return 0;
+}
+
+//
+/// Content-addressed on-disk cache of prepared benchmark inputs.
+///
+/// Entries are keyed by the hash of the source content, the codec and the mode
+/// used to produce them, and live as <key>.dat + <key>.meta in the cache
+/// directory. The metadata records the payload size and hash, a
+/// producer-defined value (e.g. the compressed size) and the time it took to
+/// produce the entry, which is accounted as saved on every hit.
+//
+class PreparedFileCache {
+public:
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t invalid = 0;
+    size_t evicted = 0;
+    uint64_t produce_us = 0;
+    int64_t saved_us = 0;
+  };
+
+  /// Writes the artifact to the given path, sets the producer-defined value
+  /// and returns 0 on success.
+  typedef std::function<int(const std::string &path, size_t *value)> Producer;
+
+  static PreparedFileCache &instance() {
+    static PreparedFileCache cache(FLAGS_prepared_cache_dir,
+                                   FLAGS_prepared_cache_max_mb * kMB,
+                                   FLAGS_prepared_cache_verify);
+    return cache;
+  }
+
+  PreparedFileCache(std::string dir, uint64_t max_size, bool verify)
+      : dir_(std::move(dir)), max_size_(max_size), verify_(verify) {
+    if (dir_.empty())
+      return;
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) {
+      LOG(WARNING) << "Failed to create cache directory " << dir_
+                   << ", caching disabled: " << ec.message();
+      dir_.clear();
+    }
+  }
+
+  static std::string make_key(const uint8_t *src, size_t src_size,
+                              const std::string &codec,
+                              const std::string &mode) {
+    std::stringstream ss;
+    ss << std::hex << content_hash(src, src_size) << std::dec << "_"
+       << src_size << "_" << codec << "_" << mode;
+    return ss.str();
+  }
+
+  /// Return the cached artifact for @param key in @param path (and its
+  /// producer-defined @param value), producing it with @param produce on a
+  /// miss. With the cache disabled, the artifact is produced at
+  /// @param fallback_path every time.
+  int get_or_create(const std::string &key, const Producer &produce,
+                    const std::string &fallback_path, std::string *path,
+                    size_t *value) {
+    TimeScope lookup_time;
+    if (dir_.empty()) {
+      *path = fallback_path;
+      return produce(fallback_path, value);
+    }
+
+    const std::string data_path = dir_ + "/" + key + ".dat";
+    const std::string meta_path = dir_ + "/" + key + ".meta";
+    Meta meta;
+    if (lookup(data_path, meta_path, &meta)) {
+      // Touch for LRU.
+      std::error_code ec;
+      std::filesystem::last_write_time(
+          data_path, std::filesystem::file_time_type::clock::now(), ec);
+      ++stats_.hits;
+      stats_.saved_us +=
+          static_cast<int64_t>(meta.produce_us) -
+          static_cast<int64_t>(
+              lookup_time.GetTimeStamp<std::chrono::microseconds>());
+      *path = data_path;
+      *value = meta.value;
+      return 0;
+    }
+
+    // Miss: produce into a temporary file and publish atomically.
+    ++stats_.misses;
+    const std::string tmp_path = data_path + ".tmp";
+    TimeScope produce_time;
+    std::error_code ec;
+    if (produce(tmp_path, &meta.value)) {
+      std::filesystem::remove(tmp_path, ec);
+      return -1;
+    }
+    meta.produce_us = static_cast<uint64_t>(
+        produce_time.GetTimeStamp<std::chrono::microseconds>());
+    stats_.produce_us += meta.produce_us;
+
+    meta.payload_size =
+        static_cast<size_t>(std::filesystem::file_size(tmp_path, ec));
+    if (ec || file_content_hash(tmp_path, meta.payload_size,
+                                &meta.payload_hash)) {
+      LOG(WARNING) << "Failed to hash prepared file " << tmp_path;
+      return -1;
+    }
+    std::filesystem::rename(tmp_path, data_path, ec);
+    if (ec || write_meta(meta_path, meta)) {
+      LOG(WARNING) << "Failed to publish cache entry " << key;
+      return -1;
+    }
+
+    evict(data_path);
+
+    *path = data_path;
+    *value = meta.value;
+    return 0;
+  }
+
+  const Stats &stats() const { return stats_; }
+
+private:
+  struct Meta {
+    size_t payload_size = 0;
+    uint64_t payload_hash = 0;
+    size_t value = 0;
+    uint64_t produce_us = 0;
+  };
+
+  int write_meta(const std::string &meta_path, const Meta &meta) {
+    std::ofstream out(meta_path, std::ios::trunc);
+    out << meta.payload_size << " " << meta.payload_hash << " " << meta.value
+        << " " << meta.produce_us << "\n";
+    return out.good() ? 0 : -1;
+  }
+
+  bool lookup(const std::string &data_path, const std::string &meta_path,
+              Meta *meta) {
+    std::ifstream in(meta_path);
+    if (!in.good())
+      return false;
+
+    std::error_code ec;
+    in >> meta->payload_size >> meta->payload_hash >> meta->value >>
+        meta->produce_us;
+    bool valid = !in.fail();
+    valid = valid && std::filesystem::file_size(data_path, ec) ==
+                         meta->payload_size &&
+            !ec;
+    if (valid && verify_) {
+      uint64_t hash = 0;
+      valid = file_content_hash(data_path, meta->payload_size, &hash) == 0 &&
+              hash == meta->payload_hash;
+    }
+
+    if (!valid) {
+      LOG(WARNING) << "Dropping invalid cache entry " << data_path;
+      ++stats_.invalid;
+      std::filesystem::remove(data_path, ec);
+      std::filesystem::remove(meta_path, ec);
+    }
+    return valid;
+  }
+
+  /// Evict least recently used entries until the cache fits into max_size_;
+  /// @param keep_path (the entry just inserted) is never evicted.
+  void evict(const std::string &keep_path) {
+    std::vector<std::tuple<std::filesystem::file_time_type, uint64_t,
+                           std::filesystem::path>>
+        entries;
+    uint64_t total_size = 0;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir_, ec)) {
+      if (entry.path().extension() != ".dat")
+        continue;
+      auto size = entry.file_size(ec);
+      total_size += size;
+      if (entry.path() != keep_path)
+        entries.push_back(
+            std::make_tuple(entry.last_write_time(ec), size, entry.path()));
+    }
+
+    std::sort(entries.begin(), entries.end());
+    for (const auto &[mtime, size, data_path] : entries) {
+      if (total_size <= max_size_)
+        break;
+      auto meta_path = data_path;
+      meta_path.replace_extension(".meta");
+      std::filesystem::remove(data_path, ec);
+      std::filesystem::remove(meta_path, ec);
+      total_size -= size;
+      ++stats_.evicted;
+    }
+  }
+
+  std::string dir_;
+  uint64_t max_size_;
+  bool verify_;
+  Stats stats_;
+};
+
+} // namespace prepared_cache
+
+#endif
@@ -10,6 +10,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include "../cache_state.h"
+#include "../cpu_counters.h"
 #include "../util.h"
 #include "qpl_canned.h"
 #include "qpl_compress_decompress.h"
@@ -24,6 +26,7 @@ auto BM_SingleEngineBlocking_Compress = [](benchmark::State &state,
   auto source_size = _PARSE_ARG(size_t);
   auto source_buff = _PARSE_ARG(uint8_t *);
   auto huffman_table = _PARSE_ARG(qpl_huffman_table_t);
+  auto cache_state = _PARSE_ARG(int);
   _PARSE_OUT
 
   assert(source_buff != nullptr);
@@ -34,15 +37,20 @@ auto BM_SingleEngineBlocking_Compress = [](benchmark::State &state,
   size_t compressed_size =
       2 * source_size; // allocate initial space to fit even
                        // when compression increases data
-  auto compressed_buff = malloc_allocate(compressed_size);
-  memset(compressed_buff.get(), _PAGE_PREFAULT_, compressed_size);
+  CacheStateBuffers buffers(
+      static_cast<CacheState>(cache_state),
+      cache_state_sets(static_cast<CacheState>(cache_state),
+                       source_size + compressed_size),
+      source_buff, source_size, compressed_size);
   uint32_t last_bit_offset;
-  for (auto _ : state) {
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    buffers.next(state, loop);
     if (single_engine::compress(
             execution_path, qpl_default_level,
             static_cast<single_engine::CompressionMode>(compression_mode),
-            &huffman_table, &last_bit_offset, source_buff, source_size,
-            compressed_buff.get(), &compressed_size))
+            &huffman_table, &last_bit_offset, buffers.src(), source_size,
+            buffers.dst(), &compressed_size))
       state.SkipWithMessage("Failed to compress.");
   }
   state.counters["Compression Ratio"] = 1.0 * source_size / compressed_size;
@@ -53,9 +61,8 @@ auto BM_SingleEngineBlocking_Compress = [](benchmark::State &state,
   if (single_engine::decompress(
           execution_path,
           static_cast<single_engine::CompressionMode>(compression_mode),
-          huffman_table, last_bit_offset, compressed_buff.get(),
-          compressed_size, decompressed_buff.get(), source_size,
-          &decompression_size))
+          huffman_table, last_bit_offset, buffers.dst(), compressed_size,
+          decompressed_buff.get(), source_size, &decompression_size))
     state.SkipWithMessage("Failed to decompress.");
 
   if (decompression_size != source_size ||
@@ -73,6 +80,7 @@ auto BM_SingleEngineBlocking_DeCompress = [](benchmark::State &state,
   auto source_size = _PARSE_ARG(size_t);
   auto source_buff = _PARSE_ARG(uint8_t *);
   auto huffman_table = _PARSE_ARG(qpl_huffman_table_t);
+  auto cache_state = _PARSE_ARG(int);
   _PARSE_OUT
 
   assert(source_buff != nullptr);
@@ -95,24 +103,28 @@ auto BM_SingleEngineBlocking_DeCompress = [](benchmark::State &state,
 
   state.counters["Compression Ratio"] = 1.0 * source_size / compressed_size;
 
-  auto decompressed_buff = malloc_allocate(source_size);
-  memset(decompressed_buff.get(), _PAGE_PREFAULT_, source_size);
+  CacheStateBuffers buffers(
+      static_cast<CacheState>(cache_state),
+      cache_state_sets(static_cast<CacheState>(cache_state),
+                       compressed_size + source_size),
+      compressed_buff.get(), compressed_size, source_size);
 
   // Benchmark decompress.
   size_t decompression_size = 0;
-  for (auto _ : state) {
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    buffers.next(state, loop);
     if (single_engine::decompress(
             execution_path,
             static_cast<single_engine::CompressionMode>(compression_mode),
-            huffman_table, last_bit_offset, compressed_buff.get(),
-            compressed_size, decompressed_buff.get(), source_size,
-            &decompression_size))
+            huffman_table, last_bit_offset, buffers.src(), compressed_size,
+            buffers.dst(), source_size, &decompression_size))
       state.SkipWithMessage("Failed to decompress.");
   }
 
   // Verify.
   if (decompression_size != source_size ||
-      memcmp(source_buff, decompressed_buff.get(), decompression_size) != 0)
+      memcmp(source_buff, buffers.dst(), decompression_size) != 0)
     state.SkipWithMessage("Data missmatch.");
 
   state.counters["Status"] = 0;
@@ -124,6 +136,7 @@ auto BM_SingleEngineBlocking_CompressCanned = [](benchmark::State &state,
   auto compression_mode = Inputs;
   auto source_size = _PARSE_ARG(size_t);
   auto source_buff = _PARSE_ARG(uint8_t *);
+  auto cache_state = _PARSE_ARG(int);
   _PARSE_OUT
 
   assert(source_buff != nullptr);
@@ -136,15 +149,20 @@ auto BM_SingleEngineBlocking_CompressCanned = [](benchmark::State &state,
   size_t compressed_size =
       2 * source_size; // allocate initial space to fit even
                        // when compression increases data
-  auto compressed_buff = malloc_allocate(compressed_size);
-  memset(compressed_buff.get(), _PAGE_PREFAULT_, compressed_size);
-  qpl_huffman_table_t huffman_tables;
-  for (auto _ : state) {
+  CacheStateBuffers buffers(
+      static_cast<CacheState>(cache_state),
+      cache_state_sets(static_cast<CacheState>(cache_state),
+                       source_size + compressed_size),
+      source_buff, source_size, compressed_size);
+  single_engine::HuffmanTable huffman_tables;
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    buffers.next(state, loop);
     if (single_engine_canned::compress(
             static_cast<single_engine_canned::CompressionMode>(
                 compression_mode),
-            source_buff, source_size, compressed_buff.get(), &compressed_size,
-            chunk_size, &huffman_tables))
+            buffers.src(), source_size, buffers.dst(), &compressed_size,
+            chunk_size, huffman_tables.get()))
       state.SkipWithMessage("Failed to compress.");
   }
   state.counters["Compression Ratio"] = 1.0 * source_size / compressed_size;
@@ -152,9 +170,9 @@ auto BM_SingleEngineBlocking_CompressCanned = [](benchmark::State &state,
   // Verify with decompress.
   auto decompressed_buff = malloc_allocate(source_size);
   size_t decompression_size = 0;
-  if (single_engine_canned::decompress(compressed_buff.get(), compressed_size,
+  if (single_engine_canned::decompress(buffers.dst(), compressed_size,
                                        decompressed_buff.get(), source_size,
-                                       &decompression_size, huffman_tables))
+                                       &decompression_size, *huffman_tables))
     state.SkipWithMessage("Failed to decompress.");
 
   if (decompression_size != source_size ||
@@ -170,6 +188,7 @@ auto BM_SingleEngineBlocking_DeCompressCanned = [](benchmark::State &state,
   auto compression_mode = Inputs;
   auto source_size = _PARSE_ARG(size_t);
   auto source_buff = _PARSE_ARG(uint8_t *);
+  auto cache_state = _PARSE_ARG(int);
   _PARSE_OUT
 
   assert(source_buff != nullptr);
@@ -184,30 +203,35 @@ auto BM_SingleEngineBlocking_DeCompressCanned = [](benchmark::State &state,
                        // when compression increases data
   auto compressed_buff = malloc_allocate(compressed_size);
   memset(compressed_buff.get(), _PAGE_PREFAULT_, compressed_size);
-  qpl_huffman_table_t huffman_tables;
+  single_engine::HuffmanTable huffman_tables;
   if (single_engine_canned::compress(
           static_cast<single_engine_canned::CompressionMode>(compression_mode),
           source_buff, source_size, compressed_buff.get(), &compressed_size,
-          chunk_size, &huffman_tables))
+          chunk_size, huffman_tables.get()))
     state.SkipWithMessage("Failed to compress.");
 
   state.counters["Compression Ratio"] = 1.0 * source_size / compressed_size;
 
-  auto decompressed_buff = malloc_allocate(source_size);
-  memset(decompressed_buff.get(), _PAGE_PREFAULT_, source_size);
+  CacheStateBuffers buffers(
+      static_cast<CacheState>(cache_state),
+      cache_state_sets(static_cast<CacheState>(cache_state),
+                       compressed_size + source_size),
+      compressed_buff.get(), compressed_size, source_size);
 
   // Benchmark decompress.
   size_t decompression_size = 0;
-  for (auto _ : state) {
-    if (single_engine_canned::decompress(compressed_buff.get(), compressed_size,
-                                         decompressed_buff.get(), source_size,
-                                         &decompression_size, huffman_tables))
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    buffers.next(state, loop);
+    if (single_engine_canned::decompress(buffers.src(), compressed_size,
+                                         buffers.dst(), source_size,
+                                         &decompression_size, *huffman_tables))
       state.SkipWithMessage("Failed to decompress.");
   }
 
   // Verify.
   if (decompression_size != source_size ||
-      memcmp(source_buff, decompressed_buff.get(), decompression_size) != 0)
+      memcmp(source_buff, buffers.dst(), decompression_size) != 0)
     state.SkipWithMessage("Data missmatch.");
 
   state.counters["Status"] = 0;
@@ -0,0 +1,311 @@
+#ifndef _BENCHMARK_FAULT_DENSITY_H_
+#define _BENCHMARK_FAULT_DENSITY_H_
+
+#include <algorithm>
+#include <cstdarg>
+#include <numeric>
+#include <random>
+#include <sys/mman.h>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../job_submitter.h"
+#include "../multi_engine/qpl_parallel.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+#include "benchmark_page_faults.h"
+#include "qpl_compress_decompress.h"
+
+namespace page_faults {
+
+enum FaultOperation { kFaultCompress, kFaultDecompress };
+
+enum FaultEngine {
+  // CPU reference: qpl_path_software.
+  kFaultSoftware,
+  // One hardware job over the whole buffer.
+  kFaultSingleEngine,
+  // kFaultDensityJobs hardware jobs over equal parts of the buffer.
+  kFaultMultiEngine
+};
+
+enum FaultPattern {
+  // Faulting pages evenly spread.
+  kFaultStride,
+  // Faulting pages picked at random.
+  kFaultRandom
+};
+
+static constexpr size_t kFaultPageSize = 4 * kkB;
+static constexpr size_t kFaultDensityJobs = 8;
+static constexpr uint64_t kFaultPatternSeed = 42;
+
+#define _PARSE_ARGS_FAULT_DENSITY_                                             \
+  _PARSE_IN                                                                    \
+  auto fault_op = Inputs;                                                      \
+  auto fault_engine = _PARSE_ARG(int);                                         \
+  auto fault_pattern = _PARSE_ARG(int);                                        \
+  auto fault_percent = _PARSE_ARG(int);                                        \
+  auto source_size = _PARSE_ARG(size_t);                                       \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+/// Which of @param page_count pages fault: @param fault_percent % of them.
+static std::vector<uint8_t> faulting_pages(size_t page_count, int fault_percent,
+                                           FaultPattern pattern) {
+  std::vector<uint8_t> faulting(page_count, 0);
+  const size_t count = page_count * static_cast<size_t>(fault_percent) / 100;
+  if (pattern == kFaultStride) {
+    // Page p faults if the running share crosses an integer at p.
+    for (size_t page = 0; page < page_count; ++page)
+      faulting[page] =
+          (page + 1) * count / page_count != page * count / page_count;
+    return faulting;
+  }
+  std::vector<size_t> pages(page_count);
+  std::iota(pages.begin(), pages.end(), 0);
+  std::shuffle(pages.begin(), pages.end(),
+               std::mt19937_64(kFaultPatternSeed));
+  for (size_t i = 0; i < count; ++i)
+    faulting[pages[i]] = 1;
+  return faulting;
+}
+
+/// Drop the mappings of @param buff so that all its pages fault again, then
+/// populate and pre-translate the pages not marked in @param faulting.
+/// Source pages are populated by reading, destination ones by writing.
+static int prepare_pages(uint8_t *buff, size_t size,
+                         const std::vector<uint8_t> &faulting, bool write,
+                         bool translate) {
+  if (madvise(buff, size, MADV_DONTNEED)) {
+    LOG(WARNING) << "Failed to drop the pages.";
+    return -1;
+  }
+  size_t run_start = 0, run_size = 0;
+  for (size_t page = 0; page < faulting.size(); ++page) {
+    size_t offset = page * kFaultPageSize;
+    if (!faulting[page] && offset < size) {
+      if (write)
+        buff[offset] = _PAGE_PREFAULT_;
+      else
+        *reinterpret_cast<volatile uint8_t *>(buff + offset);
+      if (run_size == 0)
+        run_start = offset;
+      run_size = std::min(offset + kFaultPageSize, size) - run_start;
+      continue;
+    }
+    // Pre-translate contiguous runs with one job each.
+    if (translate && run_size != 0 &&
+        single_engine::iaa_translation_fetch(buff + run_start, run_size))
+      return -1;
+    run_size = 0;
+  }
+  if (translate && run_size != 0 &&
+      single_engine::iaa_translation_fetch(buff + run_start, run_size))
+    return -1;
+  return 0;
+}
+
+/// Run @param op with every job of @param job_buffers on one part of the
+/// source at once: part i reads @param src_sizes [i] bytes at
+/// @param src_offsets [i] and writes to @param dst + i * dst_part_size.
+/// Reports the output size of every part in @param out_sizes.
+static int run_parts(qpl_path_t path, qpl_operation op,
+                     multi_engine::MultiChunkJob &job_buffers,
+                     const uint8_t *src,
+                     const std::vector<size_t> &src_offsets,
+                     const std::vector<size_t> &src_sizes, uint8_t *dst,
+                     size_t dst_part_size, std::vector<size_t> *out_sizes) {
+  JobSubmitter submitter;
+  size_t submitted = 0;
+  int ret = 0;
+  out_sizes->assign(job_buffers.size(), 0);
+  for (; submitted < job_buffers.size() && ret == 0; ++submitted) {
+    // Sources smaller than the job count leave trailing parts empty.
+    const size_t i = submitted;
+    if (src_sizes[i] == 0)
+      continue;
+    auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+    job->op = op;
+    job->level = qpl_default_level;
+    job->next_in_ptr = const_cast<uint8_t *>(src) + src_offsets[i];
+    job->available_in = src_sizes[i];
+    job->next_out_ptr = dst + i * dst_part_size;
+    job->available_out = dst_part_size;
+    job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST;
+    if (op == qpl_op_compress)
+      job->flags |= QPL_FLAG_OMIT_VERIFY;
+    if (path == qpl_path_software) {
+      if (qpl_execute_job(job) != QPL_STS_OK)
+        ret = -1;
+      (*out_sizes)[i] = job->total_out;
+      continue;
+    }
+    if (submitter.submit(job) != QPL_STS_OK) {
+      LOG(WARNING) << "Failed to submit job " << i;
+      ret = -1;
+      break;
+    }
+  }
+  if (path == qpl_path_software)
+    return ret;
+
+  CompletionWaiter waiter(kWaitBusyPoll);
+  for (size_t i = 0; i < submitted; ++i) {
+    if (src_sizes[i] == 0)
+      continue;
+    auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+    qpl_status status;
+    while ((status = submitter.check(job)) == QPL_STS_BEING_PROCESSED)
+      waiter.wait();
+    waiter.reset();
+    if (status != QPL_STS_OK) {
+      LOG(WARNING) << "An error " << status
+                   << " acquired during awaiting for completion";
+      ret = -1;
+    }
+    (*out_sizes)[i] = job->total_out;
+  }
+  return ret;
+}
+
+//
+/// Latency of compressing or decompressing the source when
+/// @param fault_percent % of the source and destination pages fault (minor
+/// faults, no translation cached) and the others are populated and
+/// pre-translated.
+//
+auto BM_PageFaultDensity = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_FAULT_DENSITY_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  const auto engine = static_cast<FaultEngine>(fault_engine);
+  const auto path =
+      engine == kFaultSoftware ? qpl_path_software : qpl_path_hardware;
+  const size_t jobs = engine == kFaultMultiEngine ? kFaultDensityJobs : 1;
+  auto job_buffers = multi_engine::init_qpl(path, jobs);
+  auto reference_jobs = multi_engine::init_qpl(qpl_path_software, jobs);
+  if (job_buffers.empty() || reference_jobs.empty()) {
+    state.SkipWithMessage("Failed to init qpl.");
+    return;
+  }
+
+  // Equal page-aligned parts of the source, each with twice its size of
+  // output space.
+  const size_t part_size = std::max(
+      kFaultPageSize, (source_size / jobs + kFaultPageSize - 1) /
+                          kFaultPageSize * kFaultPageSize);
+  std::vector<size_t> part_offsets, part_sizes;
+  for (size_t offset = 0; part_offsets.size() < jobs; offset += part_size) {
+    part_offsets.push_back(std::min(offset, source_size));
+    part_sizes.push_back(offset < source_size
+                             ? std::min(part_size, source_size - offset)
+                             : 0);
+  }
+  const size_t slot_size = 2 * part_size;
+  std::vector<size_t> compressed_sizes;
+  auto compressed_buff = mmap_allocate(jobs * slot_size);
+  memset(compressed_buff.get(), _PAGE_PREFAULT_, jobs * slot_size);
+
+  // The source is file-backed (minor faults from the page cache); the
+  // destination is anonymous memory.
+  std::unique_ptr<uint8_t, MMapDeleter> src, dst;
+  size_t src_size = source_size, dst_size = jobs * slot_size;
+  std::vector<size_t> src_offsets = part_offsets, src_sizes = part_sizes;
+  size_t dst_part_size = slot_size;
+  if (static_cast<FaultOperation>(fault_op) == kFaultCompress) {
+    src = remmap_memory_through_file(source_buff, source_size,
+                                     "fault_density_src.dat", false, false);
+  } else {
+    if (run_parts(qpl_path_software, qpl_op_compress, reference_jobs,
+                  source_buff, part_offsets, part_sizes, compressed_buff.get(),
+                  slot_size, &compressed_sizes)) {
+      state.SkipWithMessage("Failed to compress.");
+      return;
+    }
+    src_size = jobs * slot_size;
+    src = remmap_memory_through_file(compressed_buff.get(), src_size,
+                                     "fault_density_compressed.dat", false,
+                                     false);
+    src_offsets.clear();
+    for (size_t i = 0; i < jobs; ++i)
+      src_offsets.push_back(i * slot_size);
+    src_sizes = compressed_sizes;
+    dst_size = jobs * part_size;
+    dst_part_size = part_size;
+  }
+  dst = mmap_allocate(dst_size);
+  if (src == nullptr || dst == nullptr) {
+    state.SkipWithMessage("Failed to map buffers.");
+    return;
+  }
+
+  const auto pattern = static_cast<FaultPattern>(fault_pattern);
+  const auto src_faulting = faulting_pages(
+      (src_size + kFaultPageSize - 1) / kFaultPageSize, fault_percent,
+      pattern);
+  const auto dst_faulting = faulting_pages(
+      (dst_size + kFaultPageSize - 1) / kFaultPageSize, fault_percent,
+      pattern);
+
+  // Benchmark.
+  std::vector<size_t> out_sizes;
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    state.PauseTiming();
+    loop.pause();
+    const bool translate = path == qpl_path_hardware;
+    if (prepare_pages(src.get(), src_size, src_faulting, false, translate) ||
+        prepare_pages(dst.get(), dst_size, dst_faulting, true, translate))
+      state.SkipWithMessage("Failed to prepare pages.");
+    loop.resume();
+    state.ResumeTiming();
+
+    if (run_parts(path,
+                  static_cast<FaultOperation>(fault_op) == kFaultCompress
+                      ? qpl_op_compress
+                      : qpl_op_decompress,
+                  job_buffers, src.get(), src_offsets, src_sizes, dst.get(),
+                  dst_part_size, &out_sizes))
+      state.SkipWithMessage("Failed to run the jobs.");
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(source_size));
+  state.counters["Faulting Pages"] =
+      std::count(src_faulting.begin(), src_faulting.end(), 1) +
+      std::count(dst_faulting.begin(), dst_faulting.end(), 1);
+
+  // Verify.
+  auto decompressed_buff = mmap_allocate(jobs * part_size);
+  const uint8_t *restored = dst.get();
+  if (static_cast<FaultOperation>(fault_op) == kFaultCompress) {
+    std::vector<size_t> offsets, sizes;
+    for (size_t i = 0; i < jobs; ++i)
+      offsets.push_back(i * slot_size);
+    if (run_parts(qpl_path_software, qpl_op_decompress, reference_jobs,
+                  dst.get(), offsets, out_sizes, decompressed_buff.get(),
+                  part_size, &sizes))
+      state.SkipWithMessage("Failed to decompress.");
+    restored = decompressed_buff.get();
+  }
+  for (size_t i = 0; i < jobs; ++i)
+    if (memcmp(source_buff + part_offsets[i], restored + i * part_size,
+               part_sizes[i]) != 0) {
+      state.SkipWithMessage("Data missmatch.");
+      break;
+    }
+
+  if (multi_engine::free_qpl(job_buffers) ||
+      multi_engine::free_qpl(reference_jobs))
+    state.SkipWithMessage("Failed to free resources.");
+  state.counters["Status"] = 0;
+};
+
+} // namespace page_faults
+
+#endif
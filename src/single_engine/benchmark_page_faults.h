@@ -3,6 +3,7 @@
 
 #include <cmath>
 #include <cstdarg>
+#include <functional>
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -11,6 +12,10 @@
 
 #include <benchmark/benchmark.h>
 
+#include "../cpu_counters.h"
+#include "../fault_recovery.h"
+#include "../multi_engine/translation_warmer.h"
+#include "../prepared_cache.h"
 #include "../util.h"
 #include "qpl_compress_decompress.h"
 
@@ -20,9 +25,23 @@ enum PageFaultScenario {
   kMajorPageFaults,
   kMinorPageFaults,
   kAtsMiss,
-  kNoFaults
+  kNoFaults,
+  // Every iteration faults on all the pages and relies on the touch-and-
+  // resubmit recovery of the wrappers (kRecoveryPolicy).
+  kFaultRecovery,
+  // Every iteration faults in all the pages from the CPU before the job.
+  kPrefaultAll
 };
 
+// Recovery of kFaultRecovery: resubmissions only, so that every iteration
+// is a hardware one.
+static const FaultRecoveryPolicy kRecoveryPolicy = {2, false};
+
+/// FaultRecoveryPolicy of @param scenario: none but for kFaultRecovery.
+static FaultRecoveryPolicy recovery_policy(PageFaultScenario scenario) {
+  return scenario == kFaultRecovery ? kRecoveryPolicy : FaultRecoveryPolicy();
+}
+
 #define _PARSE_ARGS__                                                          \
   _PARSE_IN                                                                    \
   auto pf_scenario = Inputs;                                                   \
@@ -30,24 +49,71 @@ enum PageFaultScenario {
   auto source_buff = _PARSE_ARG(uint8_t *);                                    \
   _PARSE_OUT
 
-/// Re-mmap memory @param buff from a file to allow major page faults later (if
-/// @param prefault = false).
-static std::unique_ptr<uint8_t, MMapDeleter>
-remmap_memory_through_file(uint8_t *buff, size_t size, const char *filename,
-                           bool drop_cache, bool prefault) {
-  // Dump source buffer to file for major page faults.
+/// Dump memory @param buff to file @param filename.
+static int dump_memory_to_file(uint8_t *buff, size_t size,
+                               const char *filename) {
   int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0x666);
   if (fd == -1) {
     LOG(WARNING) << "Failed to open file.";
-    return std::unique_ptr<uint8_t, MMapDeleter>(nullptr);
+    return -1;
   }
   ssize_t s = write(fd, buff, size);
   if (s == -1 || static_cast<size_t>(s) != size) {
     LOG(WARNING) << "Failed to write pf file.";
-    return std::unique_ptr<uint8_t, MMapDeleter>(nullptr);
+    close(fd);
+    return -1;
   }
   fsync(fd);
   close(fd);
+  return 0;
+}
+
+// Version of the layout of the pf files in the prepared inputs cache; bump it
+// whenever the dumped content changes so that stale entries are not reused.
+static constexpr int kPfFileVersion = 2;
+static constexpr size_t kPageCacheReadSize = 1 * kMB;
+
+/// Read @param size bytes of @param fd so that they are in the page cache and
+/// mapping them faults minor only.
+static int read_into_page_cache(int fd, size_t size) {
+  std::vector<uint8_t> buff(std::min(size, kPageCacheReadSize));
+  for (size_t offset = 0; offset < size;) {
+    ssize_t s = pread(fd, buff.data(), std::min(buff.size(), size - offset),
+                      static_cast<off_t>(offset));
+    if (s <= 0) {
+      LOG(WARNING) << "Failed to read pf file.";
+      return -1;
+    }
+    offset += static_cast<size_t>(s);
+  }
+  return 0;
+}
+
+/// Re-mmap memory @param buff from a file to allow major page faults later
+/// (if @param drop_cache) or minor ones (the file is read into the page cache
+/// otherwise), unless @param prefault. The file is taken from the prepared
+/// inputs cache, so benchmark instances over the same content do not rewrite
+/// it; the mapping is private and read-only, so the cache entry is never
+/// modified through it.
+static std::unique_ptr<uint8_t, MMapDeleter>
+remmap_memory_through_file(uint8_t *buff, size_t size, const char *filename,
+                           bool drop_cache, bool prefault) {
+  // Dump source buffer to file for major page faults.
+  using prepared_cache::PreparedFileCache;
+  std::string cached_path;
+  size_t unused;
+  if (PreparedFileCache::instance().get_or_create(
+          PreparedFileCache::make_key(
+              buff, size, "raw",
+              "pf_scenario_v" + std::to_string(kPfFileVersion)),
+          [&](const std::string &path, size_t *) {
+            return dump_memory_to_file(buff, size, path.c_str());
+          },
+          filename, &cached_path, &unused)) {
+    LOG(WARNING) << "Failed to prepare pf file.";
+    return std::unique_ptr<uint8_t, MMapDeleter>(nullptr);
+  }
+  filename = cached_path.c_str();
 
   // Drop caches.
   if (drop_cache) {
@@ -60,24 +126,173 @@ remmap_memory_through_file(uint8_t *buff, size_t size, const char *filename,
   }
 
   // Map the file to do major page faults.
-  fd = open(filename, O_RDWR);
+  int fd = open(filename, O_RDONLY);
   if (fd == -1) {
     LOG(WARNING) << "Failed to open file.";
     return std::unique_ptr<uint8_t, MMapDeleter>(nullptr);
   }
-  uint8_t *ptr = reinterpret_cast<uint8_t *>(
-      mmap(nullptr, size, PROT_READ | PROT_WRITE,
-           prefault ? (MAP_SHARED | MAP_POPULATE) : MAP_SHARED, fd, 0));
-  if (ptr == nullptr) {
+  // A cache hit is not necessarily in the page cache.
+  if (!drop_cache && read_into_page_cache(fd, size)) {
+    close(fd);
+    return std::unique_ptr<uint8_t, MMapDeleter>(nullptr);
+  }
+  void *ptr = mmap(nullptr, size, PROT_READ,
+                   prefault ? (MAP_PRIVATE | MAP_POPULATE) : MAP_PRIVATE, fd,
+                   0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
     LOG(WARNING) << "Failed to map file.";
     return std::unique_ptr<uint8_t, MMapDeleter>(nullptr);
   }
 
-  std::unique_ptr<uint8_t, MMapDeleter> unique_ptr(ptr);
+  std::unique_ptr<uint8_t, MMapDeleter> unique_ptr(
+      reinterpret_cast<uint8_t *>(ptr));
   unique_ptr.get_deleter().set_size(size);
   return unique_ptr;
 }
 
+/// Drop the page table entries of @param buff so that the next accesses
+/// fault again; file-backed content stays in the page cache.
+static int drop_mappings(uint8_t *buff, size_t size) {
+  if (madvise(buff, size, MADV_DONTNEED)) {
+    LOG(WARNING) << "Failed to drop the mappings.";
+    return -1;
+  }
+  return 0;
+}
+
+//
+/// FaultRecoveryStats at the start of a benchmark.
+//
+struct RecoveryCounters {
+  uint64_t faulted = 0;
+  uint64_t resubmitted = 0;
+  uint64_t recovered = 0;
+  uint64_t fallbacks = 0;
+  uint64_t touched_pages = 0;
+
+  RecoveryCounters() {
+    auto &stats = FaultRecoveryStats::instance();
+    faulted = stats.faulted;
+    resubmitted = stats.resubmitted;
+    recovered = stats.recovered;
+    fallbacks = stats.fallbacks;
+    touched_pages = stats.touched_pages;
+  }
+
+  /// Report the recoveries since construction in @param state.
+  void report(benchmark::State &state) const {
+    auto &stats = FaultRecoveryStats::instance();
+    state.counters["Faulted Jobs"] = stats.faulted - faulted;
+    state.counters["Resubmitted Jobs"] = stats.resubmitted - resubmitted;
+    state.counters["Recovered Jobs"] = stats.recovered - recovered;
+    state.counters["Software Fallbacks"] = stats.fallbacks - fallbacks;
+    state.counters["Touched Pages"] = stats.touched_pages - touched_pages;
+  }
+};
+
+/// Per-iteration part of kFaultRecovery and kPrefaultAll: drop the mappings
+/// of the buffers (neither timed nor counted by @param cpu_counters), then
+/// fault them in from the CPU for kPrefaultAll.
+static void refault_buffers(benchmark::State &state, CpuCounters &cpu_counters,
+                            PageFaultScenario scenario, uint8_t *src,
+                            size_t src_size, uint8_t *dst, size_t dst_size) {
+  if (scenario != kFaultRecovery && scenario != kPrefaultAll)
+    return;
+  state.PauseTiming();
+  cpu_counters.pause();
+  if (drop_mappings(src, src_size) || drop_mappings(dst, dst_size))
+    state.SkipWithMessage("Failed to drop the mappings.");
+  cpu_counters.resume();
+  state.ResumeTiming();
+  if (scenario == kPrefaultAll) {
+    touch_pages(src, src_size, false);
+    touch_pages(dst, dst_size, true);
+  }
+}
+
+static constexpr size_t kWarmInflightJobs = 16;
+static constexpr size_t kWarmRepeats = 5;
+
+/// Drop the translations of @param buff cached by the engines: lowering the
+/// protection of a range invalidates them along with the CPU TLB entries.
+/// @param prot - the protection of the mapping, restored afterwards.
+static int invalidate_translations(uint8_t *buff, size_t size, int prot) {
+  if (mprotect(buff, size, PROT_NONE) || mprotect(buff, size, prot)) {
+    LOG(WARNING) << "Failed to invalidate translations.";
+    return -1;
+  }
+  return 0;
+}
+
+/// Report the latency of @param run_job with cold translations of
+/// @param src (a read-only file mapping) and @param dst (read-write), and
+/// for every warming method its cost and the latency of @param run_job after
+/// it, to tell whether pre-warming pays off.
+/// The warmers' jobs and threads are set up before the warming is timed;
+/// every latency is the mean of kWarmRepeats runs.
+static void report_warming(benchmark::State &state, uint8_t *src,
+                           size_t src_size, uint8_t *dst, size_t dst_size,
+                           const std::function<int()> &run_job) {
+  struct Warming {
+    const char *name;
+    multi_engine::WarmMethod method;
+    size_t stride;
+  };
+  const Warming warmings[] = {
+      {"Serial", multi_engine::kWarmSerialScan, 4 * kkB},
+      {"Parallel", multi_engine::kWarmParallelScan, 4 * kkB},
+      {"Sparse 4kB", multi_engine::kWarmSparseProbe, 4 * kkB},
+      {"Sparse 2MB", multi_engine::kWarmSparseProbe, 2 * kMB}};
+  const auto invalidate = [&]() {
+    if (invalidate_translations(src, src_size, PROT_READ) ||
+        invalidate_translations(dst, dst_size, PROT_READ | PROT_WRITE)) {
+      state.SkipWithMessage("Failed to invalidate translations.");
+      return -1;
+    }
+    return 0;
+  };
+  const auto timed_job = [&](const char *message) {
+    TimeScope job_time;
+    if (run_job())
+      state.SkipWithMessage(message);
+    return job_time.GetTimeStamp<std::chrono::microseconds>() / 1000.0;
+  };
+
+  double cold_ms = 0;
+  for (size_t repeat = 0; repeat < kWarmRepeats; ++repeat) {
+    if (invalidate())
+      return;
+    cold_ms += timed_job("Failed to run the cold job.");
+  }
+  state.counters["Cold Job, ms"] = cold_ms / kWarmRepeats;
+
+  for (const auto &warming : warmings) {
+    double warm_ms = 0;
+    double job_ms = 0;
+    for (size_t repeat = 0; repeat < kWarmRepeats; ++repeat) {
+      // Both buffers at once, as ahead of a restore.
+      multi_engine::TranslationWarmer src_warmer(
+          warming.method, src, src_size, warming.stride, kWarmInflightJobs);
+      multi_engine::TranslationWarmer dst_warmer(
+          warming.method, dst, dst_size, warming.stride, kWarmInflightJobs);
+      if (invalidate())
+        return;
+      TimeScope warm_time;
+      src_warmer.start();
+      dst_warmer.start();
+      if (src_warmer.wait() || dst_warmer.wait())
+        state.SkipWithMessage("Failed to warm translations.");
+      warm_ms += warm_time.GetTimeStamp<std::chrono::microseconds>() / 1000.0;
+      job_ms += timed_job("Failed to run the warmed job.");
+    }
+    state.counters[std::string("Warm ") + warming.name + ", ms"] =
+        warm_ms / kWarmRepeats;
+    state.counters[std::string("Warmed Job ") + warming.name + ", ms"] =
+        job_ms / kWarmRepeats;
+  }
+}
+
 auto BM_SingleEngineMinorPageFault_Compress = [](benchmark::State &state,
                                                  auto Inputs...) {
   // Parse input.
@@ -93,7 +308,9 @@ auto BM_SingleEngineMinorPageFault_Compress = [](benchmark::State &state,
     new_source_buff = remmap_memory_through_file(
         source_buff, source_size, "compress_src.dat", true, false);
 
-  if (static_cast<PageFaultScenario>(pf_scenario) == kMinorPageFaults)
+  if (static_cast<PageFaultScenario>(pf_scenario) == kMinorPageFaults ||
+      static_cast<PageFaultScenario>(pf_scenario) == kFaultRecovery ||
+      static_cast<PageFaultScenario>(pf_scenario) == kPrefaultAll)
     new_source_buff = remmap_memory_through_file(
         source_buff, source_size, "compress_src.dat", false, false);
 
@@ -124,16 +341,34 @@ auto BM_SingleEngineMinorPageFault_Compress = [](benchmark::State &state,
       state.SkipWithMessage("Failed to prefetch ats translations.");
   }
 
+  if (static_cast<PageFaultScenario>(pf_scenario) == kNoFaults)
+    report_warming(state, new_source_buff.get(), source_size,
+                   compressed_buff.get(), compressed_size, [&] {
+                     size_t warm_compressed_size = 2 * source_size;
+                     return single_engine::compress(
+                         qpl_path_hardware, qpl_default_level,
+                         single_engine::kModeFixed, nullptr, nullptr,
+                         new_source_buff.get(), source_size,
+                         compressed_buff.get(), &warm_compressed_size);
+                   });
+
   // Run benchmark.
-  for (auto _ : state) {
-    if (single_engine::compress(qpl_path_hardware, qpl_default_level,
-                                single_engine::kModeFixed, nullptr, nullptr,
-                                new_source_buff.get(), source_size,
-                                compressed_buff.get(), &compressed_size)) {
+  const RecoveryCounters recovery;
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    refault_buffers(state, loop, static_cast<PageFaultScenario>(pf_scenario),
+                    new_source_buff.get(), source_size, compressed_buff.get(),
+                    2 * source_size);
+    if (single_engine::compress(
+            qpl_path_hardware, qpl_default_level, single_engine::kModeFixed,
+            nullptr, nullptr, new_source_buff.get(), source_size,
+            compressed_buff.get(), &compressed_size, kWaitBlocking,
+            recovery_policy(static_cast<PageFaultScenario>(pf_scenario)))) {
       state.SkipWithMessage("Failed to compress.");
     }
   }
   state.counters["Compression Ratio"] = 1.0 * source_size / compressed_size;
+  recovery.report(state);
 
   // Verify with decompress.
   auto decompressed_buff = malloc_allocate(source_size);
@@ -177,7 +412,9 @@ auto BM_SingleEngineMinorPageFault_DeCompress = [](benchmark::State &state,
         remmap_memory_through_file(compressed_buff.get(), compressed_size,
                                    "decompress_src.dat", true, false);
 
-  if (static_cast<PageFaultScenario>(pf_scenario) == kMinorPageFaults)
+  if (static_cast<PageFaultScenario>(pf_scenario) == kMinorPageFaults ||
+      static_cast<PageFaultScenario>(pf_scenario) == kFaultRecovery ||
+      static_cast<PageFaultScenario>(pf_scenario) == kPrefaultAll)
     new_compressed_buff =
         remmap_memory_through_file(compressed_buff.get(), compressed_size,
                                    "decompress_src.dat", false, false);
@@ -211,15 +448,33 @@ auto BM_SingleEngineMinorPageFault_DeCompress = [](benchmark::State &state,
       state.SkipWithMessage("Failed to prefetch ats translations.");
   }
 
+  if (static_cast<PageFaultScenario>(pf_scenario) == kNoFaults)
+    report_warming(state, new_compressed_buff.get(), compressed_size,
+                   decompressed_buff.get(), source_size, [&] {
+                     size_t warm_decompression_size = 0;
+                     return single_engine::decompress(
+                         qpl_path_hardware, single_engine::kModeFixed, nullptr,
+                         0, new_compressed_buff.get(), compressed_size,
+                         decompressed_buff.get(), source_size,
+                         &warm_decompression_size);
+                   });
+
   // Benchmark decompress.
   size_t decompression_size = 0;
-  for (auto _ : state) {
-    if (single_engine::decompress(qpl_path_hardware, single_engine::kModeFixed,
-                                  nullptr, 0, new_compressed_buff.get(),
-                                  compressed_size, decompressed_buff.get(),
-                                  source_size, &decompression_size))
+  const RecoveryCounters recovery;
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    refault_buffers(state, loop, static_cast<PageFaultScenario>(pf_scenario),
+                    new_compressed_buff.get(), compressed_size,
+                    decompressed_buff.get(), source_size);
+    if (single_engine::decompress(
+            qpl_path_hardware, single_engine::kModeFixed, nullptr, 0,
+            new_compressed_buff.get(), compressed_size, decompressed_buff.get(),
+            source_size, &decompression_size, kWaitBlocking,
+            recovery_policy(static_cast<PageFaultScenario>(pf_scenario))))
       state.SkipWithMessage("Failed to decompress.");
   }
+  recovery.report(state);
 
   // Verify.
   if (decompression_size != source_size ||
@@ -0,0 +1,131 @@
+#ifndef _BENCHMARK_PARETO_H_
+#define _BENCHMARK_PARETO_H_
+
+#include <cstdarg>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../util.h"
+#include "qpl_compress_decompress.h"
+
+namespace single_engine {
+
+enum ParetoOperation { kParetoCompress, kParetoDecompress };
+
+#define _PARSE_ARGS_PARETO_                                                    \
+  _PARSE_IN                                                                    \
+  auto operation = Inputs;                                                     \
+  auto execution_path = _PARSE_ARG(qpl_path_t);                                \
+  auto compression_mode = _PARSE_ARG(int);                                     \
+  auto compression_level = _PARSE_ARG(int);                                    \
+  auto source_size = _PARSE_ARG(size_t);                                       \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+/// Whether @param path compresses at @param level in @param mode: the
+/// hardware path only has qpl_default_level and Huffman-only streams have no
+/// matching to tune.
+static bool pareto_level_supported(qpl_path_t path, CompressionMode mode,
+                                   qpl_compression_levels level) {
+  if (level == qpl_default_level)
+    return true;
+  return path == qpl_path_software && mode != kModeHuffmanOnly;
+}
+
+/// Create the table @param mode compresses @param src with into @param table
+/// (none for kModeFixed and kModeDynamic), as a tier would once per dataset.
+static int create_pareto_table(qpl_path_t path, CompressionMode mode,
+                               qpl_compression_levels level,
+                               const uint8_t *src, size_t src_size,
+                               HuffmanTable &table) {
+  if (mode == kModeHuffmanOnly)
+    return create_huffman_only_table(path, table.get());
+  if (mode == kModeStatic)
+    return create_static_huffman_tables(path, table.get(), src, src_size,
+                                        level);
+  return 0;
+}
+
+//
+/// One point of the ratio vs throughput trade-off: compression or
+/// decompression of source_size bytes in a CompressionMode at a
+/// qpl_compression_levels on one path. Huffman tables live for the whole
+/// benchmark; building them is reported, not timed.
+//
+auto BM_CompressionPareto = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_PARETO_
+  assert(source_buff != nullptr);
+
+  const auto mode = static_cast<CompressionMode>(compression_mode);
+  const auto level = static_cast<qpl_compression_levels>(compression_level);
+
+  zero_initialize_counters(state);
+  if (!pareto_level_supported(execution_path, mode, level)) {
+    state.SkipWithMessage("Unsupported compression level.");
+    return;
+  }
+
+  HuffmanTable huffman_table;
+  TimeScope table_time;
+  if (create_pareto_table(execution_path, mode, level, source_buff,
+                          source_size, huffman_table)) {
+    state.SkipWithMessage("Failed to create huffman tables.");
+    return;
+  }
+  state.counters["Table Setup, us"] =
+      table_time.GetTimeStamp<std::chrono::microseconds>();
+
+  size_t compressed_size =
+      2 * source_size; // allocate initial space to fit even
+                       // when compression increases data
+  std::vector<uint8_t> compressed_buff(compressed_size, _PAGE_PREFAULT_);
+  std::vector<uint8_t> decompressed_buff(source_size, _PAGE_PREFAULT_);
+  uint32_t last_bit_offset = 0;
+  const auto compress = [&]() {
+    compressed_size = compressed_buff.size();
+    return single_engine::compress(execution_path, level, mode,
+                                   huffman_table.get(), &last_bit_offset,
+                                   source_buff, source_size,
+                                   compressed_buff.data(), &compressed_size);
+  };
+  size_t decompression_size = 0;
+  const auto decompress = [&]() {
+    return single_engine::decompress(
+        execution_path, mode, *huffman_table, last_bit_offset,
+        compressed_buff.data(), compressed_size, decompressed_buff.data(),
+        source_size, &decompression_size);
+  };
+
+  // Benchmark.
+  if (operation == kParetoDecompress && compress()) {
+    state.SkipWithMessage("Failed to compress.");
+    return;
+  }
+  CountedLoop loop(state, source_size);
+  for (auto _ : loop) {
+    if (operation == kParetoCompress ? compress() : decompress())
+      state.SkipWithMessage(operation == kParetoCompress
+                                ? "Failed to compress."
+                                : "Failed to decompress.");
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(source_size));
+  state.counters["Compression Ratio"] = 1.0 * source_size / compressed_size;
+
+  // Verify.
+  if (operation == kParetoCompress && decompress())
+    state.SkipWithMessage("Failed to decompress.");
+  if (decompression_size != source_size ||
+      memcmp(source_buff, decompressed_buff.data(), decompression_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace single_engine
+
+#endif
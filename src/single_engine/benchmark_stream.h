@@ -0,0 +1,172 @@
+#ifndef _BENCHMARK_STREAM_H_
+#define _BENCHMARK_STREAM_H_
+
+#include <cstdarg>
+#include <memory>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../util.h"
+#include "qpl_stream.h"
+
+namespace single_engine_stream {
+
+enum StreamOperation { kStreamCompress, kStreamDecompress };
+
+#define _PARSE_ARGS_STREAM_                                                    \
+  _PARSE_IN                                                                    \
+  auto operation = Inputs;                                                     \
+  auto execution_path = _PARSE_ARG(qpl_path_t);                                \
+  auto window_size = _PARSE_ARG(size_t);                                       \
+  auto stream_size = _PARSE_ARG(size_t);                                       \
+  auto source_size = _PARSE_ARG(size_t);                                       \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+/// Write @param stream_size bytes of @param src of @param src_size bytes,
+/// repeated, to @param stream and finish it.
+static int write_repeated(StreamJob &stream, const uint8_t *src,
+                          size_t src_size, size_t stream_size) {
+  for (size_t offset = 0; offset < stream_size; offset += src_size)
+    if (stream.write(src, std::min(src_size, stream_size - offset)))
+      return -1;
+  return stream.finish();
+}
+
+//
+/// Compares the output of a stream with a source repeated, without holding
+/// the stream.
+//
+class RepeatedSourceCheck {
+public:
+  RepeatedSourceCheck(const uint8_t *src, size_t src_size)
+      : src_(src), src_size_(src_size) {}
+
+  int compare(const uint8_t *data, size_t size) {
+    while (size > 0) {
+      const size_t offset = checked_ % src_size_;
+      const size_t n = std::min(size, src_size_ - offset);
+      if (memcmp(src_ + offset, data, n) != 0)
+        return -1;
+      checked_ += n;
+      data += n;
+      size -= n;
+    }
+    return 0;
+  }
+
+  uint64_t checked() const { return checked_; }
+
+private:
+  const uint8_t *src_;
+  size_t src_size_;
+  uint64_t checked_ = 0;
+};
+
+//
+/// Throughput and peak memory of compressing or decompressing a stream of
+/// stream_size bytes (the source repeated) through window_size windows and
+/// output buffers. Only the stream's window, output buffer and job grow the
+/// peak RSS, whatever stream_size. The output of the last iteration is
+/// checked against the source as it is produced (decompressed first for
+/// kStreamCompress), outside the timed and counted region.
+//
+auto BM_Stream = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_STREAM_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  if (stream_size > kMaxStreamSize) {
+    state.SkipWithMessage("The stream is larger than one job supports.");
+    return;
+  }
+
+  // The compressed stream the decompressions read and the check of the last
+  // iteration, before the peak RSS is measured.
+  std::vector<uint8_t> compressed;
+  if (operation == kStreamDecompress) {
+    StreamCompressor compressor(
+        execution_path, single_engine::kModeDynamic, qpl_default_level,
+        window_size, [&compressed](const uint8_t *data, size_t size) {
+          compressed.insert(compressed.end(), data, data + size);
+          return 0;
+        });
+    if (write_repeated(compressor, source_buff, source_size, stream_size)) {
+      state.SkipWithMessage("Failed to compress.");
+      return;
+    }
+  }
+  RepeatedSourceCheck check(source_buff, source_size);
+  bool check_failed = false;
+  std::unique_ptr<StreamJob> check_decompressor;
+  if (operation == kStreamCompress)
+    check_decompressor = std::make_unique<StreamDecompressor>(
+        execution_path, window_size, window_size,
+        [&check](const uint8_t *data, size_t size) {
+          return check.compare(data, size);
+        });
+
+  // Benchmark.
+  const size_t rss_before = start_rss_measurement();
+  CountedLoop loop(state, stream_size);
+  uint64_t output_size = 0;
+  bool last_iteration = false;
+  const StreamSink sink = [&](const uint8_t *data, size_t size) {
+    output_size += size;
+    if (!last_iteration || check_failed)
+      return 0;
+    state.PauseTiming();
+    loop.pause();
+    check_failed = check_decompressor != nullptr
+                       ? check_decompressor->write(data, size) != 0
+                       : check.compare(data, size) != 0;
+    loop.resume();
+    state.ResumeTiming();
+    return 0;
+  };
+  std::unique_ptr<StreamJob> stream;
+  if (operation == kStreamCompress)
+    stream = std::make_unique<StreamCompressor>(
+        execution_path, single_engine::kModeDynamic, qpl_default_level,
+        window_size, sink);
+  else
+    stream = std::make_unique<StreamDecompressor>(execution_path, window_size,
+                                                  window_size, sink);
+  benchmark::IterationCount iteration = 0;
+  for (auto _ : loop) {
+    output_size = 0;
+    last_iteration = ++iteration == state.max_iterations;
+    if (operation == kStreamCompress
+            ? write_repeated(*stream, source_buff, source_size, stream_size)
+            : stream->write(compressed.data(), compressed.size()) ||
+                  stream->finish())
+      state.SkipWithMessage(operation == kStreamCompress
+                                ? "Failed to compress."
+                                : "Failed to decompress.");
+  }
+  state.counters["Peak RSS Growth, MB"] = peak_rss_growth_mb(rss_before);
+  state.counters["Stream Memory, MB"] =
+      1.0 * static_cast<double>(stream->memory()) / kMB;
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(stream_size));
+  const size_t compressed_size =
+      operation == kStreamCompress ? output_size : compressed.size();
+  state.counters["Compression Ratio"] =
+      compressed_size ? 1.0 * stream_size / compressed_size : 0;
+
+  // Verify.
+  if (check_decompressor != nullptr && !check_failed)
+    check_failed = check_decompressor->finish() != 0;
+  if (check_failed || check.checked() != stream_size)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace single_engine_stream
+
+#endif
@@ -55,6 +55,11 @@ int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
   }
 
   if (mode == kCanned) {
+    // Tables are rebuilt from every source; drop the previous ones.
+    if (*huffman_table != nullptr) {
+      qpl_huffman_table_destroy(*huffman_table);
+      *huffman_table = nullptr;
+    }
     if (create_static_huffman_tables(qpl_path_hardware, huffman_table, src,
                                      src_size)) {
       LOG(WARNING) << "Failed to create huffman tables.";
@@ -123,7 +128,7 @@ int compress(CompressionMode mode, const uint8_t *src, size_t src_size,
   return 0;
 }
 
-int decompress(uint8_t *src, size_t src_size, uint8_t *dst,
+int decompress(const uint8_t *src, size_t src_size, uint8_t *dst,
                size_t dst_reserved_size, size_t *dst_actual_size,
                qpl_huffman_table_t huffman_table) {
   auto job_buffer = init_qpl(qpl_path_hardware);
@@ -135,7 +140,7 @@ int decompress(uint8_t *src, size_t src_size, uint8_t *dst,
   // Decompress.
   auto job = reinterpret_cast<qpl_job *>(job_buffer.get());
   job->op = qpl_op_decompress;
-  job->next_in_ptr = src;
+  job->next_in_ptr = const_cast<uint8_t *>(src);
   job->available_in = src_size;
   job->next_out_ptr = dst;
   job->available_out = dst_reserved_size;
@@ -6,6 +6,9 @@
 
 #include <glog/logging.h>
 
+#include "../fault_recovery.h"
+#include "../wait_strategy.h"
+
 #include "qpl/qpl.h"
 
 namespace single_engine {
@@ -76,27 +79,66 @@ int iaa_translation_fetch(uint8_t *src, size_t src_size) {
   return 0;
 }
 
+/// Create the table kModeHuffmanOnly compressions fill in for @param e_path.
+int create_huffman_only_table(qpl_path_t e_path,
+                              qpl_huffman_table_t *c_huffman_table) {
+  allocator_t default_allocator_c = {malloc, free};
+  qpl_status status = qpl_huffman_only_table_create(
+      compression_table_type, e_path, default_allocator_c, c_huffman_table);
+  if (status != QPL_STS_OK) {
+    LOG(WARNING) << "Failed to allocate Huffman tables";
+    return -1;
+  }
+  return 0;
+}
+
+//
+/// Owns a Huffman table for compress(): kModeHuffmanOnly creates it on the
+/// first call if it is empty and refills it on every call, kModeStatic needs
+/// one populated by create_static_huffman_tables(). Decompressions of
+/// kModeHuffmanOnly streams need it until they are done.
+//
+class HuffmanTable {
+public:
+  HuffmanTable() = default;
+  ~HuffmanTable() {
+    if (table_ != nullptr)
+      qpl_huffman_table_destroy(table_);
+  }
+
+  HuffmanTable(const HuffmanTable &) = delete;
+  HuffmanTable &operator=(const HuffmanTable &) = delete;
+
+  qpl_huffman_table_t *get() { return &table_; }
+  qpl_huffman_table_t operator*() const { return table_; }
+
+private:
+  qpl_huffman_table_t table_ = nullptr;
+};
+
 /// @param dst_size must contain the reserved size of the destination; the
 /// function re-writes it later with the actual size after compression.
+/// @param c_huffman_table is owned by the caller (see HuffmanTable).
+/// @param wait - how to wait for the job completion.
+/// @param recovery - what to do with a hardware job failed on a page fault.
 int compress(qpl_path_t e_path, qpl_compression_levels level,
              CompressionMode mode, qpl_huffman_table_t *c_huffman_table,
              uint32_t *last_bit_offset, const uint8_t *src, size_t src_size,
-             uint8_t *dst, size_t *dst_size) {
+             uint8_t *dst, size_t *dst_size, WaitStrategy wait = kWaitBlocking,
+             const FaultRecoveryPolicy &recovery = FaultRecoveryPolicy()) {
   auto job_buffer = init_qpl(e_path);
   if (job_buffer == nullptr) {
     LOG(WARNING) << "Failed to init qpl.";
     return -1;
   }
 
-  if (mode == kModeHuffmanOnly) {
-    // Create Huffman tables.
-    allocator_t default_allocator_c = {malloc, free};
-    qpl_status status = qpl_huffman_only_table_create(
-        compression_table_type, e_path, default_allocator_c, c_huffman_table);
-    if (status != QPL_STS_OK) {
-      LOG(WARNING) << "Failed to allocate Huffman tables";
+  if (mode == kModeHuffmanOnly && *c_huffman_table == nullptr) {
+    // Create Huffman tables once, later calls refill them.
+    if (create_huffman_only_table(e_path, c_huffman_table))
       return -1;
-    }
+  } else if (mode == kModeStatic && *c_huffman_table == nullptr) {
+    LOG(WARNING) << "kModeStatic needs populated Huffman tables.";
+    return -1;
   }
 
   // Compress.
@@ -122,7 +164,10 @@ int compress(qpl_path_t e_path, qpl_compression_levels level,
     return -1;
   }
 
-  qpl_status status = qpl_execute_job(job);
+  const JobBuffers buffers(job);
+  qpl_status status = execute_job(job, wait);
+  if (e_path == qpl_path_hardware)
+    status = recover_faulted_job(job, buffers, status, wait, recovery);
   if (status != QPL_STS_OK) {
     LOG(WARNING) << "An error " << status << " acquired during compression.";
     return -1;
@@ -141,14 +186,16 @@ int compress(qpl_path_t e_path, qpl_compression_levels level,
 int decompress(qpl_path_t e_path, CompressionMode mode,
                qpl_huffman_table_t c_huffman_table, uint32_t last_bit_offset,
                const uint8_t *src, size_t src_size, uint8_t *dst,
-               size_t dst_reserved_size, size_t *dst_actual_size) {
+               size_t dst_reserved_size, size_t *dst_actual_size,
+               WaitStrategy wait = kWaitBlocking,
+               const FaultRecoveryPolicy &recovery = FaultRecoveryPolicy()) {
   auto job_buffer = init_qpl(e_path);
   if (job_buffer == nullptr) {
     LOG(WARNING) << "Failed to init qpl.";
     return -1;
   }
 
-  qpl_huffman_table_t d_huffman_table;
+  qpl_huffman_table_t d_huffman_table = nullptr;
   if (mode == kModeHuffmanOnly) {
     // Create Huffman tables.
     allocator_t default_allocator_c = {malloc, free};
@@ -164,6 +211,7 @@ int decompress(qpl_path_t e_path, CompressionMode mode,
         qpl_huffman_table_init_with_other(d_huffman_table, c_huffman_table);
     if (status != QPL_STS_OK) {
       LOG(WARNING) << "Failed to populate Huffman tables";
+      qpl_huffman_table_destroy(d_huffman_table);
       return -1;
     }
   }
@@ -182,7 +230,12 @@ int decompress(qpl_path_t e_path, CompressionMode mode,
     job->huffman_table = d_huffman_table;
   }
 
-  qpl_status status = qpl_execute_job(job);
+  const JobBuffers buffers(job);
+  qpl_status status = execute_job(job, wait);
+  if (e_path == qpl_path_hardware)
+    status = recover_faulted_job(job, buffers, status, wait, recovery);
+  if (mode == kModeHuffmanOnly)
+    qpl_huffman_table_destroy(d_huffman_table);
   if (status != QPL_STS_OK) {
     LOG(WARNING) << "An error " << status << " acquired during decompression.";
     return -1;
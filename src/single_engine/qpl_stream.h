@@ -0,0 +1,222 @@
+#ifndef _QPL_STREAM_H_
+#define _QPL_STREAM_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../fault_recovery.h"
+#include "../multi_engine/qpl_parallel.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+#include "qpl_compress_decompress.h"
+
+#include "qpl/qpl.h"
+
+namespace single_engine_stream {
+
+/// Consumer of the output of a stream, in pieces of at most the output
+/// buffer size; returns non-zero to abort the stream.
+typedef std::function<int(const uint8_t *data, size_t size)> StreamSink;
+
+// qpl_job::total_in and total_out are 32-bit: the input and the output of one
+// stream (FIRST to LAST) must stay within this many bytes.
+static constexpr uint64_t kMaxStreamSize = UINT32_MAX;
+
+//
+/// One multi-call job over a stream of any length: the input is cut into
+/// windows of window_size bytes, every window is one call (QPL_FLAG_FIRST on
+/// the first, QPL_FLAG_LAST on the last) and the output goes through one
+/// buffer of output_size bytes, handed to the sink whenever a call returns.
+/// The memory used is the window, the output buffer and the job, whatever
+/// the length of the stream. The input and output of one stream are limited to
+/// kMaxStreamSize bytes; longer data must be cut into several streams.
+//
+class StreamJob {
+public:
+  StreamJob(qpl_path_t path, qpl_operation op, uint32_t flags,
+            size_t window_size, size_t output_size, StreamSink sink,
+            WaitStrategy wait)
+      : path_(path), flags_(flags), window_(window_size, _PAGE_PREFAULT_),
+        output_(output_size, _PAGE_PREFAULT_), sink_(std::move(sink)),
+        wait_(wait), job_buffer_(single_engine::init_qpl(path)) {
+    assert(window_size > 0 && output_size > 0);
+    if (job_buffer_ == nullptr) {
+      LOG(WARNING) << "Failed to init qpl.";
+      return;
+    }
+    job()->op = op;
+    uint32_t job_size = 0;
+    if (qpl_get_job_size(path, &job_size) == QPL_STS_OK)
+      job_size_ = job_size;
+  }
+
+  virtual ~StreamJob() {
+    if (job_buffer_ != nullptr)
+      single_engine::free_qpl(job());
+  }
+
+  StreamJob(const StreamJob &) = delete;
+  StreamJob &operator=(const StreamJob &) = delete;
+
+  /// Append @param size bytes at @param data to the stream. Whole windows of
+  /// the caller's data are processed in place, the rest is copied into the
+  /// window; the last window is held back for finish().
+  int write(const uint8_t *data, size_t size) {
+    while (size > 0) {
+      if (pending_ == window_.size()) {
+        if (submit(window_.data(), pending_, false))
+          return -1;
+        pending_ = 0;
+      }
+      if (pending_ == 0 && size > window_.size()) {
+        if (submit(data, window_.size(), false))
+          return -1;
+        data += window_.size();
+        size -= window_.size();
+        continue;
+      }
+      const size_t n = std::min(size, window_.size() - pending_);
+      memcpy(window_.data() + pending_, data, n);
+      pending_ += n;
+      data += n;
+      size -= n;
+    }
+    return 0;
+  }
+
+  /// Process the last window and end the stream; the next write() starts a
+  /// new one.
+  int finish() {
+    int ret = submit(window_.data(), pending_, true);
+    pending_ = 0;
+    first_ = true;
+    stream_in_ = 0;
+    stream_out_ = 0;
+    return ret;
+  }
+
+  /// Bytes of input and output of the streams so far.
+  uint64_t total_in() const { return total_in_; }
+  uint64_t total_out() const { return total_out_; }
+
+  /// Memory held by the stream, in bytes.
+  size_t memory() const {
+    return window_.size() + output_.size() + job_size_;
+  }
+
+protected:
+  qpl_job *job() { return reinterpret_cast<qpl_job *>(job_buffer_.get()); }
+
+private:
+  int submit(const uint8_t *src, size_t size, bool last) {
+    if (job_buffer_ == nullptr)
+      return -1;
+    if (stream_in_ + size > kMaxStreamSize) {
+      LOG(WARNING) << "The stream input exceeds " << kMaxStreamSize
+                   << " bytes.";
+      return -1;
+    }
+    // The engine cannot resume a multi-call job from a page fault, so the
+    // caller's pages are faulted in first (the window and output are
+    // prefaulted).
+    if (path_ == qpl_path_hardware)
+      touch_pages(const_cast<uint8_t *>(src), size, false);
+
+    auto job = this->job();
+    job->next_in_ptr = const_cast<uint8_t *>(src);
+    job->available_in = static_cast<uint32_t>(size);
+    job->flags = flags_ | (first_ ? QPL_FLAG_FIRST : 0) |
+                 (last ? QPL_FLAG_LAST : 0);
+    first_ = false;
+    total_in_ += size;
+    stream_in_ += size;
+    for (;;) {
+      job->next_out_ptr = output_.data();
+      job->available_out = static_cast<uint32_t>(output_.size());
+      qpl_status status = execute_job(job, wait_);
+      job->flags &= ~QPL_FLAG_FIRST;
+      const size_t produced = output_.size() - job->available_out;
+      total_out_ += produced;
+      stream_out_ += produced;
+      if (stream_out_ > kMaxStreamSize) {
+        LOG(WARNING) << "The stream output exceeds " << kMaxStreamSize
+                     << " bytes.";
+        return -1;
+      }
+      if (produced > 0 && sink_(output_.data(), produced)) {
+        LOG(WARNING) << "The stream sink failed.";
+        return -1;
+      }
+      if (status == QPL_STS_OK)
+        return 0;
+      // The output buffer is full: drained above, continue.
+      if (status != QPL_STS_MORE_OUTPUT_NEEDED) {
+        LOG(WARNING) << "An error " << status << " acquired during streaming.";
+        return -1;
+      }
+    }
+  }
+
+  qpl_path_t path_;
+  uint32_t flags_;
+  std::vector<uint8_t> window_;
+  std::vector<uint8_t> output_;
+  StreamSink sink_;
+  WaitStrategy wait_;
+  std::unique_ptr<uint8_t[]> job_buffer_;
+  size_t job_size_ = 0;
+  size_t pending_ = 0;
+  bool first_ = true;
+  uint64_t total_in_ = 0;
+  uint64_t total_out_ = 0;
+  uint64_t stream_in_ = 0;
+  uint64_t stream_out_ = 0;
+};
+
+//
+/// DEFLATE stream compressed window by window in kModeFixed or kModeDynamic
+/// (one block per window). The output buffer holds the compress bound of a
+/// window, so that every call drains in one piece.
+//
+class StreamCompressor : public StreamJob {
+public:
+  StreamCompressor(qpl_path_t path, single_engine::CompressionMode mode,
+                   qpl_compression_levels level, size_t window_size,
+                   StreamSink sink, WaitStrategy wait = kWaitBlocking)
+      : StreamJob(path, qpl_op_compress,
+                  QPL_FLAG_OMIT_VERIFY |
+                      (mode == single_engine::kModeDynamic
+                           ? QPL_FLAG_DYNAMIC_HUFFMAN
+                           : 0),
+                  window_size, multi_engine::compress_bound(window_size),
+                  std::move(sink), wait) {
+    if (mode != single_engine::kModeFixed &&
+        mode != single_engine::kModeDynamic)
+      LOG(WARNING) << "Streams are compressed in kModeFixed or kModeDynamic.";
+    if (job() != nullptr)
+      job()->level = level;
+  }
+};
+
+//
+/// DEFLATE stream decompressed from windows of its compressed bytes into an
+/// output buffer of output_size bytes, drained as often as it fills.
+//
+class StreamDecompressor : public StreamJob {
+public:
+  StreamDecompressor(qpl_path_t path, size_t window_size, size_t output_size,
+                     StreamSink sink, WaitStrategy wait = kWaitBlocking)
+      : StreamJob(path, qpl_op_decompress, 0, window_size, output_size,
+                  std::move(sink), wait) {}
+};
+
+} // namespace single_engine_stream
+
+#endif
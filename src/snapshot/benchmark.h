@@ -0,0 +1,266 @@
+#ifndef _SNAPSHOT_BENCHMARK_H_
+#define _SNAPSHOT_BENCHMARK_H_
+
+#include <atomic>
+#include <cstdarg>
+#include <latch>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../util.h"
+#include "snapshot_format.h"
+#include "snapshot_reader.h"
+#include "snapshot_writer.h"
+
+namespace snapshot {
+
+enum SnapshotWriteMode {
+  // Write the uncompressed image.
+  kSnapshotRawWrite,
+  // Compress the whole image with one job, then write it.
+  kSnapshotSerialCompressWrite,
+  // write_snapshot(): chunked compression overlapped with io_uring writes.
+  kSnapshotOverlapped
+};
+
+#define _PARSE_ARGS_SNAPSHOT_WRITE_                                            \
+  _PARSE_IN                                                                    \
+  auto write_mode = Inputs;                                                    \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto chunk_size = _PARSE_ARG(size_t);                                        \
+  auto inflight_jobs = _PARSE_ARG(int);                                        \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+/// Write @param size bytes of the page-aligned @param buff to a new
+/// @param filename with O_DIRECT and wait till they hit the disk.
+static int write_direct(const uint8_t *buff, size_t size,
+                        const char *filename) {
+  int fd = open_direct(filename);
+  if (fd == -1)
+    return -1;
+  int ret = write_exact(fd, buff, align_up(size), 0) || fdatasync(fd);
+  close(fd);
+  return ret ? -1 : 0;
+}
+
+/// Read back the @param compressed_size bytes of @param filename written by
+/// kSnapshotSerialCompressWrite and decompress them into @param dst of
+/// @param dst_size bytes.
+static int restore_serial_snapshot(const char *filename,
+                                   size_t compressed_size, uint8_t *dst,
+                                   size_t dst_size) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    LOG(WARNING) << "Failed to open file: " << filename;
+    return -1;
+  }
+  std::vector<uint8_t> compressed_buff(compressed_size);
+  size_t decompressed_size = 0;
+  int ret = 0;
+  if (read_exact(fd, compressed_buff.data(), compressed_size, 0) ||
+      single_engine::decompress(qpl_path_hardware, single_engine::kModeDynamic,
+                                nullptr, 0, compressed_buff.data(),
+                                compressed_size, dst, dst_size,
+                                &decompressed_size) ||
+      decompressed_size != dst_size)
+    ret = -1;
+  close(fd);
+  return ret;
+}
+
+auto BM_SnapshotWrite = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_SNAPSHOT_WRITE_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  const std::string filename = "snapshot_" + std::to_string(mem_size) + ".dat";
+
+  // O_DIRECT needs page-aligned buffers.
+  auto src = mmap_allocate(align_up(mem_size));
+  memset(src.get(), 0, align_up(mem_size));
+  memcpy(src.get(), source_buff, mem_size);
+  size_t compressed_reserved_size = align_up(2 * mem_size);
+  auto compressed_buff = mmap_allocate(
+      static_cast<SnapshotWriteMode>(write_mode) == kSnapshotSerialCompressWrite
+          ? compressed_reserved_size
+          : kBlockSize);
+  if (static_cast<SnapshotWriteMode>(write_mode) ==
+      kSnapshotSerialCompressWrite)
+    memset(compressed_buff.get(), _PAGE_PREFAULT_, compressed_reserved_size);
+
+  // Benchmark.
+  size_t compressed_size = mem_size;
+  size_t file_size = align_up(mem_size);
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    switch (static_cast<SnapshotWriteMode>(write_mode)) {
+    case kSnapshotRawWrite:
+      if (write_direct(src.get(), mem_size, filename.c_str()))
+        state.SkipWithMessage("Failed to write.");
+      break;
+    case kSnapshotSerialCompressWrite:
+      compressed_size = compressed_reserved_size;
+      if (single_engine::compress(qpl_path_hardware, qpl_default_level,
+                                  single_engine::kModeDynamic, nullptr,
+                                  nullptr, src.get(), mem_size,
+                                  compressed_buff.get(), &compressed_size)) {
+        state.SkipWithMessage("Failed to compress.");
+        break;
+      }
+      file_size = align_up(compressed_size);
+      memset(compressed_buff.get() + compressed_size, 0,
+             file_size - compressed_size);
+      if (write_direct(compressed_buff.get(), compressed_size,
+                       filename.c_str()))
+        state.SkipWithMessage("Failed to write.");
+      break;
+    case kSnapshotOverlapped: {
+      SnapshotWriteStats stats;
+      if (write_snapshot(src.get(), mem_size, chunk_size,
+                         static_cast<size_t>(inflight_jobs), filename.c_str(),
+                         &stats))
+        state.SkipWithMessage("Failed to write snapshot.");
+      compressed_size = stats.compressed_size;
+      file_size = stats.file_size;
+      break;
+    }
+    }
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
+  state.counters["Compression Ratio"] = 1.0 * mem_size / compressed_size;
+  state.counters["File Size"] = file_size;
+
+  // Verify the compressed snapshots.
+  if (static_cast<SnapshotWriteMode>(write_mode) != kSnapshotRawWrite) {
+    auto decompressed_buff = mmap_allocate(mem_size);
+    memset(decompressed_buff.get(), _PAGE_PREFAULT_, mem_size);
+    if ((static_cast<SnapshotWriteMode>(write_mode) == kSnapshotOverlapped
+             ? restore_snapshot(filename.c_str(), decompressed_buff.get(),
+                                mem_size)
+             : restore_serial_snapshot(filename.c_str(), compressed_size,
+                                       decompressed_buff.get(), mem_size)) ||
+        memcmp(source_buff, decompressed_buff.get(), mem_size) != 0)
+      state.SkipWithMessage("Data missmatch.");
+  }
+  unlink(filename.c_str());
+
+  state.counters["Status"] = 0;
+};
+
+#define _PARSE_ARGS_SNAPSHOT_RESTORE_                                          \
+  _PARSE_IN                                                                    \
+  auto snapshot_n = Inputs;                                                    \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto chunk_size = _PARSE_ARG(size_t);                                        \
+  auto readahead_chunks = _PARSE_ARG(int);                                     \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+// Jobs used to write the snapshots restored by BM_SnapshotRestore.
+static constexpr size_t kRestoreSetupJobs = 8;
+
+/// Jain's fairness index of @param values: 1 if all equal, 1/n if one value
+/// dominates.
+static double jain_fairness(const std::vector<double> &values) {
+  double sum = 0, sum_sq = 0;
+  for (auto v : values) {
+    sum += v;
+    sum_sq += v * v;
+  }
+  return sum_sq > 0 ? sum * sum / (static_cast<double>(values.size()) * sum_sq)
+                    : 0;
+}
+
+auto BM_SnapshotRestore = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_SNAPSHOT_RESTORE_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  const size_t restores = static_cast<size_t>(snapshot_n);
+
+  // A separate snapshot file and destination per concurrent restore.
+  std::vector<std::string> filenames;
+  std::vector<std::unique_ptr<uint8_t, MMapDeleter>> decompressed_buffs;
+  SnapshotWriteStats stats;
+  for (size_t i = 0; i < restores; ++i) {
+    filenames.push_back("snapshot_restore_" + std::to_string(i) + ".dat");
+    if (write_snapshot(source_buff, mem_size, chunk_size, kRestoreSetupJobs,
+                       filenames.back().c_str(), &stats)) {
+      state.SkipWithMessage("Failed to write snapshot.");
+      break;
+    }
+    decompressed_buffs.push_back(mmap_allocate(mem_size));
+    memset(decompressed_buffs.back().get(), _PAGE_PREFAULT_, mem_size);
+  }
+  state.counters["Compression Ratio"] =
+      1.0 * mem_size / stats.compressed_size;
+  state.counters["File Size"] = stats.file_size;
+
+  // Benchmark.
+  std::vector<double> completion_ms;
+  double fairness = 0;
+  std::atomic<bool> failed{false};
+  CountedLoop loop(state, restores * mem_size);
+  for (auto _ : loop) {
+    std::vector<double> restore_ms(restores, 0);
+    std::latch start(static_cast<std::ptrdiff_t>(restores + 1));
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < restores; ++i) {
+      workers.emplace_back([&, i]() {
+        start.arrive_and_wait();
+        TimeScope time;
+        if (restore_snapshot_overlapped(
+                filenames[i].c_str(), decompressed_buffs[i].get(), mem_size,
+                static_cast<size_t>(readahead_chunks)))
+          failed = true;
+        restore_ms[i] = time.GetTimeStamp<std::chrono::microseconds>() / 1000.0;
+      });
+    }
+    start.arrive_and_wait();
+    for (auto &worker : workers)
+      worker.join();
+    if (failed)
+      state.SkipWithMessage("Failed to restore snapshot.");
+
+    // Per-restore throughput is inversely proportional to its time.
+    std::vector<double> speed;
+    for (auto ms : restore_ms)
+      speed.push_back(ms > 0 ? 1.0 / ms : 0);
+    fairness += jain_fairness(speed);
+    completion_ms.insert(completion_ms.end(), restore_ms.begin(),
+                         restore_ms.end());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(restores * mem_size));
+  state.counters["Restores/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * static_cast<double>(restores),
+      benchmark::Counter::kIsRate);
+  state.counters["Completion p50, ms"] = percentile(completion_ms, 50);
+  state.counters["Completion p99, ms"] = percentile(completion_ms, 99);
+  state.counters["Completion max, ms"] = percentile(completion_ms, 100);
+  state.counters["Fairness"] =
+      state.iterations() ? fairness / static_cast<double>(state.iterations())
+                         : 0;
+
+  // Verify.
+  for (auto &decompressed_buff : decompressed_buffs)
+    if (!failed && memcmp(source_buff, decompressed_buff.get(), mem_size) != 0)
+      state.SkipWithMessage("Data missmatch.");
+  for (const auto &filename : filenames)
+    unlink(filename.c_str());
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace snapshot
+
+#endif
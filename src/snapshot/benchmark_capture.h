@@ -0,0 +1,99 @@
+#ifndef _BENCHMARK_CAPTURE_H_
+#define _BENCHMARK_CAPTURE_H_
+
+#include <cstdarg>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../synthetic_dataset.h"
+#include "../util.h"
+#include "process_capture.h"
+
+namespace capture {
+
+#define _PARSE_ARGS_CAPTURE_                                                   \
+  _PARSE_IN                                                                    \
+  auto capture_mode = Inputs;                                                  \
+  auto target_size_mb = _PARSE_ARG(size_t);                                    \
+  auto chunk_size = _PARSE_ARG(size_t);                                        \
+  auto batch_size = _PARSE_ARG(size_t);                                        \
+  auto inflight_jobs = _PARSE_ARG(int);                                        \
+  _PARSE_OUT
+
+//
+/// Capture the whole memory of a child process holding a synthetic image of
+/// @param target_size_mb MB.
+//
+auto BM_ProcessCapture = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_CAPTURE_
+
+  zero_initialize_counters(state);
+  if (chunk_size == 0 || batch_size < chunk_size ||
+      batch_size % chunk_size != 0) {
+    state.SkipWithMessage("Batch size is not a multiple of the chunk size.");
+    return;
+  }
+  TargetProcess target(target_size_mb);
+  if (!target.ok()) {
+    state.SkipWithMessage("Failed to start the capture target.");
+    return;
+  }
+
+  // Benchmark.
+  ProcessImage image;
+  std::vector<double> pause_ms;
+  size_t captured = 0;
+  CpuCounters cpu_counters;
+  for (auto _ : state) {
+    double pause_us = 0;
+    if (capture_process(static_cast<CaptureMode>(capture_mode), target.pid(),
+                        chunk_size, batch_size,
+                        static_cast<size_t>(inflight_jobs), &image,
+                        &pause_us))
+      state.SkipWithMessage("Failed to capture.");
+    pause_ms.push_back(pause_us / 1000);
+    captured += image.size;
+  }
+  cpu_counters.report(state, static_cast<double>(captured));
+  state.SetBytesProcessed(static_cast<int64_t>(captured));
+  state.counters["Captured Size"] = image.size;
+  state.counters["Regions"] = image.regions.size();
+  state.counters["Unreadable Bytes"] = image.unreadable;
+  state.counters["Compression Ratio"] =
+      image.compressed_size() ? 1.0 * image.size / image.compressed_size() : 0;
+  state.counters["Pause p50, ms"] = percentile(pause_ms, 50);
+  state.counters["Pause max, ms"] = percentile(pause_ms, 100);
+
+  // Verify the synthetic image in the captured memory.
+  size_t offset = 0;
+  const MemoryRegion *region = nullptr;
+  for (const auto &r : image.regions) {
+    if (r.start <= target.address() &&
+        target.address() + target.size() <= r.end) {
+      region = &r;
+      break;
+    }
+    offset += r.size();
+  }
+  auto decompressed_buff = mmap_allocate(image.size);
+  auto expected_buff = mmap_allocate(target.size());
+  synthetic::generate_snapshot(target_profile(target.size()),
+                               expected_buff.get());
+  if (region == nullptr ||
+      restore_image(image, static_cast<size_t>(inflight_jobs),
+                    decompressed_buff.get()) ||
+      memcmp(decompressed_buff.get() + offset +
+                 (target.address() - region->start),
+             expected_buff.get(), target.size()) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace capture
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _BENCHMARK_DEDUP_H_
+#define _BENCHMARK_DEDUP_H_
+
+#include <cstdarg>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../multi_engine/qpl_parallel.h"
+#include "../util.h"
+#include "dedup.h"
+
+namespace dedup {
+
+enum DedupMode {
+  // Hash and deduplicate the pages (no compression).
+  kDedupHashSoftware,
+  kDedupHashCrc64,
+  // Restore a deduplicated image.
+  kDedupRestore,
+  // Restore the same pages compressed without deduplication.
+  kRestoreWithoutDedup
+};
+
+static constexpr size_t kDedupInflightJobs = 16;
+
+#define _PARSE_ARGS_DEDUP_                                                     \
+  _PARSE_IN                                                                    \
+  auto dedup_mode = Inputs;                                                    \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+auto BM_Dedup = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_DEDUP_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  auto mode = static_cast<DedupMode>(dedup_mode);
+
+  // Benchmark hashing.
+  if (mode == kDedupHashSoftware || mode == kDedupHashCrc64) {
+    std::vector<uint32_t> page_map;
+    std::vector<size_t> unique_pages;
+    CountedLoop loop(state, mem_size);
+    for (auto _ : loop) {
+      if (find_unique_pages(mode == kDedupHashCrc64 ? kHashCrc64
+                                                    : kHashSoftware,
+                            source_buff, mem_size, kDedupInflightJobs,
+                            &page_map, &unique_pages))
+        state.SkipWithMessage("Failed to hash pages.");
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(mem_size));
+    state.counters["Unique Pages"] = unique_pages.size();
+    state.counters["Dedup Ratio"] =
+        unique_pages.empty() ? 0 : 1.0 * page_map.size() / unique_pages.size();
+
+    // Verify the map.
+    for (size_t page = 0; page < page_map.size(); ++page) {
+      size_t offset = page * kDedupPageSize;
+      if (memcmp(source_buff + offset,
+                 source_buff + unique_pages[page_map[page]] * kDedupPageSize,
+                 std::min(kDedupPageSize, mem_size - offset)) != 0) {
+        state.SkipWithMessage("Data missmatch.");
+        break;
+      }
+    }
+    state.counters["Status"] = 0;
+    return;
+  }
+
+  // Compress.
+  DedupImage image;
+  multi_engine::CompressedFormat pages;
+  size_t compressed_size = 0;
+  if (mode == kDedupRestore) {
+    if (dedup_compress(kHashSoftware, source_buff, mem_size,
+                       kDedupInflightJobs, &image)) {
+      state.SkipWithMessage("Failed to compress.");
+      return;
+    }
+    compressed_size = image.compressed_size();
+    state.counters["Unique Pages"] = image.unique_pages.size();
+    state.counters["Dedup Ratio"] =
+        1.0 * image.page_map.size() / image.unique_pages.size();
+  } else {
+    pages = multi_engine::make_fixed_chunks(mem_size, kDedupPageSize);
+    if (multi_engine::compress_queued(multi_engine::kParallelDynamic,
+                                      source_buff, mem_size,
+                                      kDedupInflightJobs, &pages)) {
+      state.SkipWithMessage("Failed to compress.");
+      return;
+    }
+    for (const auto &[page, size] : pages)
+      compressed_size += page.size();
+  }
+  state.counters["Compression Ratio"] = 1.0 * mem_size / compressed_size;
+
+  auto decompressed_buff = mmap_allocate(mem_size);
+  memset(decompressed_buff.get(), _PAGE_PREFAULT_, mem_size);
+
+  // Benchmark restore.
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    size_t decompressed_size = mem_size;
+    if (mode == kDedupRestore
+            ? dedup_restore(image, kDedupInflightJobs, decompressed_buff.get())
+            : multi_engine::decompress_queued(pages, decompressed_buff.get(),
+                                              kDedupInflightJobs,
+                                              &decompressed_size))
+      state.SkipWithMessage("Failed to decompress.");
+    if (decompressed_size != mem_size)
+      state.SkipWithMessage("Data missmatch.");
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
+
+  // Verify.
+  if (memcmp(source_buff, decompressed_buff.get(), mem_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace dedup
+
+#endif
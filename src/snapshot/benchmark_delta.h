@@ -0,0 +1,112 @@
+#ifndef _BENCHMARK_DELTA_H_
+#define _BENCHMARK_DELTA_H_
+
+#include <cstdarg>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../multi_engine/qpl_parallel.h"
+#include "../synthetic_dataset.h"
+#include "../util.h"
+#include "delta.h"
+
+namespace delta {
+
+enum DeltaMode {
+  // Restore the derived image from its delta to the base.
+  kDeltaRestore,
+  // Restore the derived image compressed on its own.
+  kFullRestore
+};
+
+static constexpr size_t kDeltaInflightJobs = 16;
+static constexpr uint64_t kDeltaMutationSeed = 42;
+
+#define _PARSE_ARGS_DELTA_                                                     \
+  _PARSE_IN                                                                    \
+  auto delta_mode = Inputs;                                                    \
+  auto mutated_percent = _PARSE_ARG(int);                                      \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+//
+/// The source is the base image; the derived image has
+/// @param mutated_percent % of its pages mutated.
+//
+auto BM_Delta = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_DELTA_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  auto mode = static_cast<DeltaMode>(delta_mode);
+  auto derived_buff = mmap_allocate(mem_size);
+  size_t mutated = synthetic::mutate_pages(source_buff, mem_size,
+                                           mutated_percent / 100.0,
+                                           kDeltaMutationSeed,
+                                           derived_buff.get());
+  state.counters["Mutated Pages"] = mutated;
+
+  // Compress.
+  DeltaImage image;
+  multi_engine::CompressedFormat pages;
+  size_t compressed_size = 0;
+  TimeScope compress_time;
+  if (mode == kDeltaRestore) {
+    if (delta_compress(source_buff, derived_buff.get(), mem_size,
+                       kDeltaInflightJobs, &image)) {
+      state.SkipWithMessage("Failed to compress.");
+      return;
+    }
+    compressed_size = image.compressed_size();
+  } else {
+    pages = multi_engine::make_fixed_chunks(mem_size, kDeltaPageSize);
+    if (multi_engine::compress_queued(multi_engine::kParallelDynamic,
+                                      derived_buff.get(), mem_size,
+                                      kDeltaInflightJobs, &pages)) {
+      state.SkipWithMessage("Failed to compress.");
+      return;
+    }
+    for (const auto &[page, size] : pages)
+      compressed_size += page.size();
+  }
+  double compress_us = compress_time.GetTimeStamp<std::chrono::microseconds>();
+  state.counters["Compression Ratio"] = 1.0 * mem_size / compressed_size;
+  state.counters["Compression Throughput, GB/s"] =
+      compress_us > 0 ? mem_size / compress_us / 1e3 : 0;
+
+  auto decompressed_buff = mmap_allocate(mem_size);
+  memset(decompressed_buff.get(), _PAGE_PREFAULT_, mem_size);
+  std::vector<uint8_t> delta_buff;
+
+  // Benchmark restore.
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    size_t decompressed_size = mem_size;
+    if (mode == kDeltaRestore
+            ? delta_restore(image, source_buff, kDeltaInflightJobs,
+                            decompressed_buff.get(), delta_buff)
+            : multi_engine::decompress_queued(pages, decompressed_buff.get(),
+                                              kDeltaInflightJobs,
+                                              &decompressed_size))
+      state.SkipWithMessage("Failed to decompress.");
+    if (decompressed_size != mem_size)
+      state.SkipWithMessage("Data missmatch.");
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
+
+  // Verify.
+  if (memcmp(derived_buff.get(), decompressed_buff.get(), mem_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace delta
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef _BENCHMARK_INCREMENTAL_H_
+#define _BENCHMARK_INCREMENTAL_H_
+
+#include <atomic>
+#include <cstdarg>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../synthetic_dataset.h"
+#include "../util.h"
+#include "soft_dirty.h"
+
+namespace incremental {
+
+enum SnapshotMode {
+  // Recompress the chunks with soft-dirty pages.
+  kIncrementalSnapshot,
+  // Recompress the whole region.
+  kFullSnapshot
+};
+
+static constexpr size_t kIncrementalInflightJobs = 16;
+
+#define _PARSE_ARGS_INCREMENTAL_                                               \
+  _PARSE_IN                                                                    \
+  auto snapshot_mode = Inputs;                                                 \
+  auto dirty_percent = _PARSE_ARG(int);                                        \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto chunk_size = _PARSE_ARG(size_t);                                        \
+  auto source_size = _PARSE_ARG(size_t);                                       \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+//
+/// A mutator thread writes one word in @param dirty_percent % of the pages of
+/// a mem_size region (the source tiled) between snapshots, while the
+/// snapshots are paused as a VMM pauses its vCPUs; the snapshots recompress
+/// either the dirty chunks only or the whole region.
+//
+auto BM_IncrementalSnapshot = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_INCREMENTAL_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  auto mode = static_cast<SnapshotMode>(snapshot_mode);
+  if (mode == kIncrementalSnapshot && !soft_dirty_supported()) {
+    state.SkipWithMessage("Soft-dirty page tracking is not supported.");
+    return;
+  }
+  if (chunk_size % kSoftDirtyPageSize != 0) {
+    state.SkipWithMessage("Chunk size is not a multiple of the page size.");
+    return;
+  }
+
+  auto region = mmap_allocate(mem_size);
+  for (size_t offset = 0; offset < mem_size; offset += source_size)
+    memcpy(region.get() + offset, source_buff,
+           std::min(source_size, mem_size - offset));
+  IncrementalSnapshot snapshot(region.get(), mem_size, chunk_size,
+                               kIncrementalInflightJobs);
+  if (snapshot.full()) {
+    state.SkipWithMessage("Failed to snapshot.");
+    return;
+  }
+
+  // Mutator: dirties the region once per requested round.
+  std::atomic<uint64_t> requested{0}, done{0};
+  std::atomic<bool> stop{false};
+  std::thread mutator([&]() {
+    const size_t page_count = mem_size / kSoftDirtyPageSize;
+    uint64_t round = 0;
+    while (true) {
+      requested.wait(round);
+      if (stop)
+        break;
+      round = requested;
+      synthetic::SplitMix64 rng(round);
+      for (size_t page = 0; page < page_count; ++page) {
+        if (rng.uniform() * 100 >= dirty_percent)
+          continue;
+        uint64_t value = rng();
+        memcpy(region.get() + page * kSoftDirtyPageSize +
+                   (value % (kSoftDirtyPageSize / sizeof(value))) *
+                       sizeof(value),
+               &value, sizeof(value));
+      }
+      done = round;
+      done.notify_one();
+    }
+  });
+
+  // Benchmark.
+  size_t dirty_pages = 0, recompressed_chunks = 0;
+  CountedLoop loop(state, mem_size);
+  for (auto _ : loop) {
+    state.PauseTiming();
+    loop.pause();
+    uint64_t round = ++requested;
+    requested.notify_one();
+    for (uint64_t seen = done; seen != round; seen = done)
+      done.wait(seen);
+    loop.resume();
+    state.ResumeTiming();
+
+    size_t pages = 0, chunks = 0;
+    if (mode == kIncrementalSnapshot
+            ? snapshot.incremental(&pages, &chunks)
+            : snapshot.full())
+      state.SkipWithMessage("Failed to snapshot.");
+    dirty_pages += pages;
+    recompressed_chunks += chunks;
+  }
+  stop = true;
+  ++requested;
+  requested.notify_one();
+  mutator.join();
+
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(mem_size));
+  const double iterations =
+      state.iterations() ? static_cast<double>(state.iterations()) : 1;
+  state.counters["Dirty Pages"] = dirty_pages / iterations;
+  state.counters["Recompressed Chunks"] =
+      mode == kIncrementalSnapshot
+          ? recompressed_chunks / iterations
+          : static_cast<double>((mem_size + chunk_size - 1) / chunk_size);
+  state.counters["Compression Ratio"] =
+      1.0 * mem_size / snapshot.compressed_size();
+
+  // Verify that the store matches the region after the last round.
+  auto decompressed_buff = mmap_allocate(mem_size);
+  memset(decompressed_buff.get(), _PAGE_PREFAULT_, mem_size);
+  if (snapshot.restore(decompressed_buff.get()) ||
+      memcmp(region.get(), decompressed_buff.get(), mem_size) != 0)
+    state.SkipWithMessage("Data missmatch.");
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace incremental
+
+#endif
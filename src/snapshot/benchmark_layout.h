@@ -0,0 +1,126 @@
+#ifndef _BENCHMARK_LAYOUT_H_
+#define _BENCHMARK_LAYOUT_H_
+
+#include <cstdarg>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../cpu_counters.h"
+#include "../util.h"
+#include "layout.h"
+#include "snapshot_format.h"
+#include "snapshot_writer.h"
+
+namespace snapshot {
+
+enum LayoutMode {
+  // Pages in address order (write_snapshot()).
+  kLayoutAddressOrder,
+  // Working set first (write_reordered_snapshot()).
+  kLayoutAccessOrder
+};
+
+static constexpr size_t kLayoutSetupJobs = 8;
+static constexpr uint64_t kLayoutTraceSeed = 42;
+
+#define _PARSE_ARGS_LAYOUT_                                                    \
+  _PARSE_IN                                                                    \
+  auto layout_mode = Inputs;                                                   \
+  auto working_set_percent = _PARSE_ARG(int);                                  \
+  auto mem_size = _PARSE_ARG(size_t);                                          \
+  auto chunk_size = _PARSE_ARG(size_t);                                        \
+  auto trace_file = _PARSE_ARG(char *);                                        \
+  auto source_buff = _PARSE_ARG(uint8_t *);                                    \
+  _PARSE_OUT
+
+//
+/// Time to working set: restore the pages of an access trace (recorded in
+/// @param trace_file, or a synthetic one of working_set_percent % of the
+/// pages) from a snapshot file out of the page cache, with the pages in
+/// address or access order.
+//
+auto BM_WorkingSetRestore = [](benchmark::State &state, auto Inputs...) {
+  _PARSE_ARGS_LAYOUT_
+  assert(source_buff != nullptr);
+
+  zero_initialize_counters(state);
+  std::vector<uint64_t> trace;
+  if (trace_file != nullptr && trace_file[0] != '\0') {
+    if (load_access_trace(trace_file, &trace)) {
+      state.SkipWithMessage("Failed to load the access trace.");
+      return;
+    }
+  } else {
+    trace = synthetic_access_trace(mem_size, working_set_percent / 100.0,
+                                   kLayoutTraceSeed);
+  }
+
+  const std::string filename =
+      "snapshot_layout_" + std::to_string(mem_size) + ".dat";
+  SnapshotWriteStats stats;
+  size_t working_set_pages = 0;
+  auto layout = access_order_layout(trace, mem_size, &working_set_pages);
+  if (static_cast<LayoutMode>(layout_mode) == kLayoutAccessOrder
+          ? write_reordered_snapshot(source_buff, layout, chunk_size,
+                                     kLayoutSetupJobs, filename.c_str(),
+                                     &stats)
+          : write_snapshot(source_buff, mem_size, chunk_size,
+                           kLayoutSetupJobs, filename.c_str(), &stats)) {
+    state.SkipWithMessage("Failed to write snapshot.");
+    return;
+  }
+
+  auto decompressed_buff = mmap_allocate(align_up(mem_size));
+  memset(decompressed_buff.get(), _PAGE_PREFAULT_, align_up(mem_size));
+
+  // Benchmark.
+  WorkingSetStats restore_stats;
+  CountedLoop loop(state, working_set_pages * kBlockSize);
+  for (auto _ : loop) {
+    // Start from the disk, as the full system benchmarks do.
+    state.PauseTiming();
+    loop.pause();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+      state.SkipWithMessage("Failed to drop caches.");
+    if (fd != -1)
+      close(fd);
+    loop.resume();
+    state.ResumeTiming();
+
+    if (restore_working_set(filename.c_str(), trace, decompressed_buff.get(),
+                            align_up(mem_size), &restore_stats))
+      state.SkipWithMessage("Failed to restore the working set.");
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(working_set_pages * kBlockSize));
+  state.counters["Working Set Pages"] = working_set_pages;
+  state.counters["Chunks Read"] = restore_stats.chunks_read;
+  state.counters["Bytes Read"] = restore_stats.bytes_read;
+  state.counters["Compression Ratio"] = 1.0 * mem_size / stats.compressed_size;
+
+  // Verify the working set.
+  for (auto page : trace) {
+    size_t offset = page * kBlockSize;
+    if (offset < mem_size &&
+        memcmp(source_buff + offset, decompressed_buff.get() + offset,
+               std::min(kBlockSize, mem_size - offset)) != 0) {
+      state.SkipWithMessage("Data missmatch.");
+      break;
+    }
+  }
+  unlink(filename.c_str());
+
+  state.counters["Status"] = 0;
+};
+
+} // namespace snapshot
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef _DEDUP_H_
+#define _DEDUP_H_
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../job_submitter.h"
+#include "../multi_engine/qpl_parallel.h"
+#include "../prepared_cache.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+
+#include "qpl/qpl.h"
+
+namespace dedup {
+
+static constexpr size_t kDedupPageSize = 4 * kkB;
+
+enum HashMethod {
+  // prepared_cache::content_hash(): 4 independent 64-bit lanes, vectorized.
+  kHashSoftware,
+  // CRC64 on the accelerator, one job per page on a work queue.
+  kHashCrc64
+};
+
+//
+/// Deduplicated image: every unique 4 kB page compressed once, plus the map
+/// of every page to its unique copy.
+//
+struct DedupImage {
+  size_t size = 0;
+  // Page -> index of its unique page.
+  std::vector<uint32_t> page_map;
+  // Unique pages compressed independently, in order of first occurrence.
+  multi_engine::CompressedFormat unique_pages;
+
+  size_t compressed_size() const {
+    size_t compressed_size = page_map.size() * sizeof(uint32_t);
+    for (const auto &[page, size] : unique_pages)
+      compressed_size += page.size();
+    return compressed_size;
+  }
+};
+
+static size_t page_count(size_t size) {
+  return (size + kDedupPageSize - 1) / kDedupPageSize;
+}
+
+/// CRC64 of every page of @param src with @param inflight_jobs hardware jobs.
+static int hash_pages_crc64(const uint8_t *src, size_t size,
+                            size_t inflight_jobs,
+                            std::vector<uint64_t> *hashes) {
+  const size_t pages = page_count(size);
+  inflight_jobs = std::max<size_t>(1, std::min(inflight_jobs, pages));
+  auto job_buffers = multi_engine::init_qpl(qpl_path_hardware, inflight_jobs);
+  if (job_buffers.empty()) {
+    LOG(WARNING) << "Failed to init qpl.";
+    return -1;
+  }
+
+  constexpr uint64_t kPoly = 0x04C11DB700000000;
+  constexpr size_t kNoPage = static_cast<size_t>(-1);
+  JobSubmitter submitter;
+  std::vector<size_t> job_page(inflight_jobs, kNoPage);
+  size_t next_page = 0, hashed = 0;
+  int ret = 0;
+  CompletionWaiter waiter(kWaitBusyPoll);
+  hashes->resize(pages);
+  while (ret == 0 && hashed != pages) {
+    bool progress = false;
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+      auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+      if (job_page[i] == kNoPage) {
+        if (next_page == pages)
+          continue;
+        size_t offset = next_page * kDedupPageSize;
+        job->op = qpl_op_crc64;
+        job->next_in_ptr = const_cast<uint8_t *>(src) + offset;
+        job->available_in = std::min(kDedupPageSize, size - offset);
+        job->crc64_poly = kPoly;
+        job->flags = 0;
+        if (submitter.submit(job) != QPL_STS_OK) {
+          ret = -1;
+          break;
+        }
+        job_page[i] = next_page++;
+        continue;
+      }
+
+      auto status = submitter.check(job);
+      if (status == QPL_STS_BEING_PROCESSED)
+        continue;
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status << " acquired during crc";
+        job_page[i] = kNoPage;
+        ret = -1;
+        break;
+      }
+      // Lengths differ only for the last page, mix them in anyway.
+      const size_t offset = job_page[i] * kDedupPageSize;
+      (*hashes)[job_page[i]] =
+          job->crc64 ^ std::min(kDedupPageSize, size - offset);
+      job_page[i] = kNoPage;
+      ++hashed;
+      progress = true;
+    }
+    if (progress)
+      waiter.reset();
+    else
+      waiter.wait();
+  }
+
+  for (size_t i = 0; i < inflight_jobs; ++i)
+    if (job_page[i] != kNoPage)
+      while (submitter.check(reinterpret_cast<qpl_job *>(
+                 job_buffers[i].get())) == QPL_STS_BEING_PROCESSED)
+        _mm_pause();
+  if (multi_engine::free_qpl(job_buffers)) {
+    LOG(WARNING) << "Failed to free resources.";
+    return -1;
+  }
+  return ret;
+}
+
+static int hash_pages(HashMethod method, const uint8_t *src, size_t size,
+                      size_t inflight_jobs, std::vector<uint64_t> *hashes) {
+  if (method == kHashCrc64)
+    return hash_pages_crc64(src, size, inflight_jobs, hashes);
+
+  hashes->resize(page_count(size));
+  for (size_t page = 0; page < hashes->size(); ++page) {
+    size_t offset = page * kDedupPageSize;
+    (*hashes)[page] = prepared_cache::content_hash(
+        src + offset, std::min(kDedupPageSize, size - offset));
+  }
+  return 0;
+}
+
+/// Map every page of @param src to the first identical page; hash matches
+/// are confirmed by comparing the pages. @param unique_pages receives the
+/// indices of the unique pages in order of first occurrence.
+static int find_unique_pages(HashMethod method, const uint8_t *src,
+                             size_t size, size_t inflight_jobs,
+                             std::vector<uint32_t> *page_map,
+                             std::vector<size_t> *unique_pages) {
+  std::vector<uint64_t> hashes;
+  if (hash_pages(method, src, size, inflight_jobs, &hashes))
+    return -1;
+
+  std::unordered_map<uint64_t, uint32_t> first_by_hash;
+  first_by_hash.reserve(hashes.size());
+  page_map->resize(hashes.size());
+  unique_pages->clear();
+  for (size_t page = 0; page < hashes.size(); ++page) {
+    size_t offset = page * kDedupPageSize;
+    size_t page_size = std::min(kDedupPageSize, size - offset);
+    auto [it, inserted] = first_by_hash.emplace(
+        hashes[page], static_cast<uint32_t>(unique_pages->size()));
+    if (!inserted) {
+      size_t first_offset = (*unique_pages)[it->second] * kDedupPageSize;
+      if (std::min(kDedupPageSize, size - first_offset) == page_size &&
+          memcmp(src + first_offset, src + offset, page_size) == 0) {
+        (*page_map)[page] = it->second;
+        continue;
+      }
+      // Hash collision: keep the page unique, it is just not indexed.
+    }
+    (*page_map)[page] = static_cast<uint32_t>(unique_pages->size());
+    unique_pages->push_back(page);
+  }
+  return 0;
+}
+
+/// Deduplicate @param src into @param image and compress its unique pages
+/// with @param inflight_jobs jobs.
+int dedup_compress(HashMethod method, const uint8_t *src, size_t size,
+                   size_t inflight_jobs, DedupImage *image) {
+  std::vector<size_t> unique_pages;
+  if (find_unique_pages(method, src, size, inflight_jobs, &image->page_map,
+                        &unique_pages))
+    return -1;
+
+  // Pack the unique pages to compress them as one work queue.
+  std::vector<uint8_t> packed(unique_pages.size() * kDedupPageSize);
+  size_t packed_size = 0;
+  for (auto page : unique_pages) {
+    size_t offset = page * kDedupPageSize;
+    size_t page_size = std::min(kDedupPageSize, size - offset);
+    memcpy(packed.data() + packed_size, src + offset, page_size);
+    packed_size += page_size;
+  }
+
+  image->size = size;
+  image->unique_pages = multi_engine::make_fixed_chunks(packed_size,
+                                                        kDedupPageSize);
+  return multi_engine::compress_queued(multi_engine::kParallelDynamic,
+                                       packed.data(), packed_size,
+                                       inflight_jobs, &image->unique_pages);
+}
+
+/// Restore @param image into @param dst: decompress every unique page
+/// straight to its first occurrence, then copy the duplicates from there.
+int dedup_restore(DedupImage &image, size_t inflight_jobs, uint8_t *dst) {
+  // Unique pages are numbered in order of first occurrence.
+  std::vector<size_t> dst_offsets;
+  dst_offsets.reserve(image.unique_pages.size());
+  for (size_t page = 0; page < image.page_map.size(); ++page)
+    if (image.page_map[page] == dst_offsets.size())
+      dst_offsets.push_back(page * kDedupPageSize);
+  if (dst_offsets.size() != image.unique_pages.size()) {
+    LOG(WARNING) << "Corrupt dedup page map.";
+    return -1;
+  }
+
+  size_t unique_size = 0;
+  for (const auto &[page, size] : image.unique_pages)
+    unique_size += size;
+  size_t decompressed_size = 0;
+  if (multi_engine::decompress_queued_scattered(image.unique_pages,
+                                                dst_offsets, dst, inflight_jobs,
+                                                &decompressed_size) ||
+      decompressed_size != unique_size)
+    return -1;
+
+  for (size_t page = 0; page < image.page_map.size(); ++page) {
+    const size_t offset = page * kDedupPageSize;
+    const size_t first_offset = dst_offsets[image.page_map[page]];
+    if (first_offset != offset)
+      memcpy(dst + offset, dst + first_offset,
+             std::min(kDedupPageSize, image.size - offset));
+  }
+  return 0;
+}
+
+} // namespace dedup
+
+#endif
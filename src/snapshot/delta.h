@@ -0,0 +1,135 @@
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../multi_engine/qpl_parallel.h"
+#include "../util.h"
+
+namespace delta {
+
+static constexpr size_t kDeltaPageSize = 4 * kkB;
+
+//
+/// Snapshot stored as the difference to a base image: every changed 4 kB page
+/// XORed with the base page (mostly zeros for sparse changes) and compressed
+/// independently; unchanged pages are not stored at all.
+//
+struct DeltaImage {
+  size_t size = 0;
+  // Indices of the changed pages, ascending.
+  std::vector<uint32_t> changed_pages;
+  // Deltas of the changed pages, in the order of changed_pages.
+  multi_engine::CompressedFormat deltas;
+
+  size_t compressed_size() const {
+    size_t compressed_size = changed_pages.size() * sizeof(uint32_t);
+    for (const auto &[page, size] : deltas)
+      compressed_size += page.size();
+    return compressed_size;
+  }
+};
+
+static size_t page_count(size_t size) {
+  return (size + kDeltaPageSize - 1) / kDeltaPageSize;
+}
+
+/// @param dst = @param a ^ @param b for @param size bytes; returns whether
+/// the result is non-zero, i.e. whether the inputs differ.
+static bool xor_page(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+                     size_t size) {
+  size_t i = 0;
+#if defined(__AVX512F__)
+  __m512i any = _mm512_setzero_si512();
+  for (; i + 64 <= size; i += 64) {
+    __m512i x = _mm512_xor_si512(_mm512_loadu_si512(a + i),
+                                 _mm512_loadu_si512(b + i));
+    _mm512_storeu_si512(dst + i, x);
+    any = _mm512_or_si512(any, x);
+  }
+  bool changed = _mm512_test_epi64_mask(any, any) != 0;
+#elif defined(__AVX2__)
+  __m256i any = _mm256_setzero_si256();
+  for (; i + 32 <= size; i += 32) {
+    __m256i x = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), x);
+    any = _mm256_or_si256(any, x);
+  }
+  bool changed = !_mm256_testz_si256(any, any);
+#else
+  bool changed = false;
+#endif
+  for (; i < size; ++i) {
+    dst[i] = a[i] ^ b[i];
+    changed |= dst[i] != 0;
+  }
+  return changed;
+}
+
+/// Encode @param derived against @param base (both of @param size bytes)
+/// into @param image, compressing the deltas with @param inflight_jobs jobs.
+int delta_compress(const uint8_t *base, const uint8_t *derived, size_t size,
+                   size_t inflight_jobs, DeltaImage *image) {
+  // Pack the deltas of the changed pages to compress them as one work queue.
+  std::vector<uint8_t> packed(size);
+  size_t packed_size = 0;
+  image->size = size;
+  image->changed_pages.clear();
+  for (size_t page = 0; page < page_count(size); ++page) {
+    size_t offset = page * kDeltaPageSize;
+    size_t page_size = std::min(kDeltaPageSize, size - offset);
+    if (!xor_page(base + offset, derived + offset,
+                  packed.data() + packed_size, page_size))
+      continue;
+    image->changed_pages.push_back(static_cast<uint32_t>(page));
+    packed_size += page_size;
+  }
+
+  image->deltas = multi_engine::make_fixed_chunks(packed_size, kDeltaPageSize);
+  if (packed_size == 0)
+    return 0;
+  return multi_engine::compress_queued(multi_engine::kParallelDynamic,
+                                       packed.data(), packed_size,
+                                       inflight_jobs, &image->deltas);
+}
+
+/// Restore @param image on top of @param base into @param dst: decompress the
+/// deltas (into the scratch @param delta_buff), apply them to the changed
+/// pages and copy the unchanged ones.
+int delta_restore(DeltaImage &image, const uint8_t *base, size_t inflight_jobs,
+                  uint8_t *dst, std::vector<uint8_t> &delta_buff) {
+  size_t delta_size = 0;
+  for (const auto &[page, size] : image.deltas)
+    delta_size += size;
+  delta_buff.resize(delta_size);
+  size_t decompressed_size = 0;
+  if (delta_size != 0 &&
+      (multi_engine::decompress_queued(image.deltas, delta_buff.data(),
+                                       inflight_jobs, &decompressed_size) ||
+       decompressed_size != delta_size))
+    return -1;
+
+  size_t copied = 0, delta_offset = 0;
+  for (auto page : image.changed_pages) {
+    size_t offset = static_cast<size_t>(page) * kDeltaPageSize;
+    size_t page_size = std::min(kDeltaPageSize, image.size - offset);
+    memcpy(dst + copied, base + copied, offset - copied);
+    xor_page(base + offset, delta_buff.data() + delta_offset, dst + offset,
+             page_size);
+    delta_offset += page_size;
+    copied = offset + page_size;
+  }
+  memcpy(dst + copied, base + copied, image.size - copied);
+  return 0;
+}
+
+} // namespace delta
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef _IO_URING_H_
+#define _IO_URING_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+namespace snapshot {
+
+//
+/// Minimal io_uring ring over the raw syscalls (no liburing dependency):
+/// queue reads/writes, submit them and reap completions.
+//
+class IoUring {
+public:
+  explicit IoUring(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd_ =
+        static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd_ < 0) {
+      LOG(WARNING) << "io_uring_setup failed: " << strerror(errno);
+      return;
+    }
+
+    sq_ring_size_ =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    single_mmap_ = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap_)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap_
+                   ? sq_ring_
+                   : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd_,
+                          IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = reinterpret_cast<io_uring_sqe *>(
+        mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED ||
+        sqes_ == MAP_FAILED) {
+      LOG(WARNING) << "Failed to map io_uring rings.";
+      close(ring_fd_);
+      ring_fd_ = -1;
+      return;
+    }
+
+    auto sq = reinterpret_cast<uint8_t *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    auto cq = reinterpret_cast<uint8_t *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  ~IoUring() {
+    if (ring_fd_ < 0)
+      return;
+    munmap(sqes_, sqes_size_);
+    if (!single_mmap_)
+      munmap(cq_ring_, cq_ring_size_);
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+  }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  bool ok() const { return ring_fd_ >= 0; }
+
+  /// Queue a write; returns -1 if the submission queue is full.
+  int queue_write(int fd, const void *buf, size_t len, uint64_t offset,
+                  uint64_t user_data) {
+    return queue(IORING_OP_WRITE, fd, buf, len, offset, user_data);
+  }
+
+  /// Queue a read; returns -1 if the submission queue is full.
+  int queue_read(int fd, void *buf, size_t len, uint64_t offset,
+                 uint64_t user_data) {
+    return queue(IORING_OP_READ, fd, buf, len, offset, user_data);
+  }
+
+  /// Submit the queued requests and wait for at least @param wait_nr
+  /// completions.
+  int submit(unsigned wait_nr = 0) {
+    int ret = static_cast<int>(
+        syscall(__NR_io_uring_enter, ring_fd_, to_submit_, wait_nr,
+                wait_nr ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    if (ret < 0) {
+      LOG(WARNING) << "io_uring_enter failed: " << strerror(errno);
+      return -1;
+    }
+    to_submit_ -= static_cast<unsigned>(ret);
+    return 0;
+  }
+
+  /// Pop one completion if any; @param res is the syscall-like result.
+  bool reap(uint64_t *user_data, int32_t *res) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail)
+      return false;
+    const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+    *user_data = cqe.user_data;
+    *res = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+private:
+  int queue(uint8_t opcode, int fd, const void *buf, size_t len,
+            uint64_t offset, uint64_t user_data) {
+    unsigned tail = *sq_tail_;
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (tail - head == sq_entries_)
+      return -1;
+
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++to_submit_;
+    return 0;
+  }
+
+  int ring_fd_ = -1;
+  bool single_mmap_ = false;
+  void *sq_ring_ = nullptr;
+  void *cq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe *sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned *sq_head_ = nullptr;
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned to_submit_ = 0;
+
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+};
+
+} // namespace snapshot
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../synthetic_dataset.h"
+#include "../util.h"
+#include "snapshot_format.h"
+#include "snapshot_writer.h"
+
+namespace snapshot {
+
+/// Access-order layout of an image of @param original_size bytes: the pages
+/// of @param trace (guest pages in first-access order, repeats ignored) come
+/// first, then the remaining pages in address order. @param working_set_pages
+/// receives the number of distinct pages of the trace.
+PageLayout access_order_layout(const std::vector<uint64_t> &trace,
+                               size_t original_size,
+                               size_t *working_set_pages) {
+  const size_t page_count = align_up(original_size) / kBlockSize;
+  std::vector<uint8_t> placed(page_count, 0);
+  PageLayout layout;
+  layout.original_size = original_size;
+  layout.guest_pages.reserve(page_count);
+  for (auto page : trace) {
+    if (page >= page_count || placed[page])
+      continue;
+    placed[page] = 1;
+    layout.guest_pages.push_back(page);
+  }
+  *working_set_pages = layout.guest_pages.size();
+  for (size_t page = 0; page < page_count; ++page)
+    if (!placed[page])
+      layout.guest_pages.push_back(page);
+  return layout;
+}
+
+/// Write @param src as a seekable snapshot with the pages in the order of
+/// @param layout; @param chunk_size must be a multiple of kBlockSize.
+int write_reordered_snapshot(const uint8_t *src, const PageLayout &layout,
+                             size_t chunk_size, size_t inflight_jobs,
+                             const char *filename, SnapshotWriteStats *stats) {
+  if (chunk_size % kBlockSize != 0) {
+    LOG(WARNING) << "Chunk size is not a multiple of the page size.";
+    return -1;
+  }
+  // Gather the pages; the last guest page is zero-padded wherever it lands.
+  const size_t stream_size = layout.guest_pages.size() * kBlockSize;
+  auto stream = mmap_allocate(stream_size);
+  memset(stream.get() + stream_size - kBlockSize, 0, kBlockSize);
+  for (size_t i = 0; i < layout.guest_pages.size(); ++i) {
+    size_t guest_offset = layout.guest_pages[i] * kBlockSize;
+    memcpy(stream.get() + i * kBlockSize, src + guest_offset,
+           std::min(kBlockSize, layout.original_size - guest_offset));
+  }
+  return write_snapshot(stream.get(), stream_size, chunk_size, inflight_jobs,
+                        filename, stats, kWaitBusyPoll, &layout);
+}
+
+/// Read an access trace recorded as one guest address (decimal or 0x hex) per
+/// line into guest pages.
+int load_access_trace(const std::string &path, std::vector<uint64_t> *trace) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG(WARNING) << "Failed to open access trace " << path;
+    return -1;
+  }
+  trace->clear();
+  std::string line;
+  while (std::getline(file, line))
+    if (!line.empty() && line[0] != '#')
+      trace->push_back(std::stoull(line, nullptr, 0) / kBlockSize);
+  return 0;
+}
+
+/// Boot-like access trace of @param working_set_fraction of the pages of an
+/// image of @param original_size bytes: runs of 1-64 consecutive pages at
+/// random addresses, touched in random order.
+std::vector<uint64_t> synthetic_access_trace(size_t original_size,
+                                             double working_set_fraction,
+                                             uint64_t seed) {
+  const size_t page_count = align_up(original_size) / kBlockSize;
+  const size_t target = static_cast<size_t>(working_set_fraction *
+                                            static_cast<double>(page_count));
+  synthetic::SplitMix64 rng(seed);
+  std::vector<uint8_t> touched(page_count, 0);
+  std::vector<uint64_t> trace;
+  while (trace.size() < target) {
+    size_t start = rng() % page_count;
+    size_t run = std::min<size_t>(1 + rng() % 64, page_count - start);
+    for (size_t page = start; page < start + run && trace.size() < target;
+         ++page)
+      if (!touched[page]) {
+        touched[page] = 1;
+        trace.push_back(page);
+      }
+  }
+  return trace;
+}
+
+struct WorkingSetStats {
+  size_t chunks_read = 0;
+  size_t bytes_read = 0;
+};
+
+/// Restore the pages of @param trace from the snapshot @param filename into
+/// @param dst in trace order: every chunk holding a page not restored yet is
+/// read and decompressed on demand, as a restore following the guest's
+/// accesses would.
+int restore_working_set(const char *filename,
+                        const std::vector<uint64_t> &trace, uint8_t *dst,
+                        size_t dst_size, WorkingSetStats *stats) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    LOG(WARNING) << "Failed to open file: " << filename;
+    return -1;
+  }
+  SnapshotHeader header;
+  std::vector<ChunkIndexEntry> index;
+  PageLayout layout;
+  if (load_snapshot_index(fd, &header, &index) ||
+      load_page_layout(fd, header, &layout) ||
+      header.original_size > dst_size) {
+    close(fd);
+    return -1;
+  }
+
+  // Guest page -> page of the stored stream.
+  const bool reordered = !layout.guest_pages.empty();
+  const size_t page_count = align_up(header.original_size) / kBlockSize;
+  std::vector<uint64_t> stream_page(page_count);
+  for (size_t i = 0; i < page_count; ++i)
+    stream_page[reordered ? layout.guest_pages[i] : i] = i;
+
+  std::vector<uint8_t> loaded(index.size(), 0);
+  std::vector<uint8_t> chunk_buff, stream_buff(header.chunk_size);
+  *stats = WorkingSetStats();
+  int ret = 0;
+  for (auto page : trace) {
+    if (page >= page_count)
+      continue;
+    size_t c = stream_page[page] * kBlockSize / header.chunk_size;
+    if (loaded[c])
+      continue;
+    const auto &chunk = index[c];
+    chunk_buff.resize(chunk.compressed_size);
+    size_t decompressed_size = 0;
+    if (read_exact(fd, chunk_buff.data(), chunk.compressed_size,
+                   chunk.file_offset) ||
+        single_engine::decompress(
+            qpl_path_hardware, single_engine::kModeDynamic, nullptr, 0,
+            chunk_buff.data(), chunk.compressed_size,
+            reordered ? stream_buff.data() : dst + chunk.original_offset,
+            chunk.original_size, &decompressed_size) ||
+        decompressed_size != chunk.original_size) {
+      LOG(WARNING) << "Failed to restore chunk " << c;
+      ret = -1;
+      break;
+    }
+    if (reordered)
+      scatter_pages(stream_buff.data(), chunk.original_offset,
+                    chunk.original_size, layout, dst);
+    loaded[c] = 1;
+    ++stats->chunks_read;
+    stats->bytes_read += chunk.compressed_size;
+  }
+  close(fd);
+  return ret;
+}
+
+} // namespace snapshot
+
+#endif
@@ -0,0 +1,459 @@
+#ifndef _PROCESS_CAPTURE_H_
+#define _PROCESS_CAPTURE_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/prctl.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../multi_engine/qpl_parallel.h"
+#include "../synthetic_dataset.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+
+#include "qpl/qpl.h"
+
+namespace capture {
+
+// Remote iovecs per process_vm_readv() call (IOV_MAX).
+static constexpr size_t kMaxIovecs = 1024;
+// Seed of the synthetic image of run_target().
+static constexpr uint64_t kCaptureTargetSeed = 42;
+// How long stop_process() waits for the target to stop.
+static constexpr auto kStopTimeout = std::chrono::seconds(1);
+
+//
+/// Readable mapping of the target process.
+//
+struct MemoryRegion {
+  uintptr_t start = 0;
+  uintptr_t end = 0;
+  std::string name;
+
+  size_t size() const { return end - start; }
+};
+
+/// Readable regions of process @param pid from /proc/<pid>/maps, except the
+/// kernel-provided ones process_vm_readv() cannot access.
+static int read_memory_maps(pid_t pid, std::vector<MemoryRegion> *regions) {
+  std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+  if (!maps) {
+    LOG(WARNING) << "Failed to open /proc/" << pid << "/maps.";
+    return -1;
+  }
+  regions->clear();
+  std::string line;
+  while (std::getline(maps, line)) {
+    std::istringstream fields(line);
+    std::string range, perms, offset, dev, inode, name;
+    fields >> range >> perms >> offset >> dev >> inode >> name;
+    if (perms.empty() || perms[0] != 'r' || name == "[vvar]" ||
+        name == "[vvar_vclock]" || name == "[vsyscall]")
+      continue;
+    MemoryRegion region;
+    region.start = std::stoull(range.substr(0, range.find('-')), nullptr, 16);
+    region.end = std::stoull(range.substr(range.find('-') + 1), nullptr, 16);
+    region.name = name;
+    regions->push_back(region);
+  }
+  return 0;
+}
+
+/// Stop process @param pid and wait till it is stopped, for at most
+/// kStopTimeout; a target that exits meanwhile is an error.
+static int stop_process(pid_t pid) {
+  if (kill(pid, SIGSTOP)) {
+    LOG(WARNING) << "Failed to stop " << pid << ".";
+    return -1;
+  }
+  const std::string stat_path = "/proc/" + std::to_string(pid) + "/stat";
+  TimeScope time;
+  while (true) {
+    std::ifstream stat(stat_path);
+    std::string stat_line;
+    if (!std::getline(stat, stat_line)) {
+      LOG(WARNING) << "Failed to read " << stat_path << ".";
+      return -1;
+    }
+    // The state follows the parenthesized command name.
+    auto state = stat_line.rfind(") ");
+    const char process_state = state != std::string::npos &&
+                                       state + 2 < stat_line.size()
+                                   ? stat_line[state + 2]
+                                   : '\0';
+    if (process_state == 'T' || process_state == 't')
+      return 0;
+    if (process_state == 'Z' || process_state == 'X') {
+      LOG(WARNING) << "Process " << pid << " exited.";
+      return -1;
+    }
+    if (time.GetTimeStamp<std::chrono::microseconds>() >
+        std::chrono::microseconds(kStopTimeout).count()) {
+      LOG(WARNING) << "Timed out stopping " << pid << ".";
+      return -1;
+    }
+    sched_yield();
+  }
+}
+
+static int resume_process(pid_t pid) { return kill(pid, SIGCONT) ? -1 : 0; }
+
+//
+/// Sequential reader of the regions of a process, as if they were one
+/// stream, with batched process_vm_readv() calls. Unreadable ranges (e.g.
+/// file mappings beyond the end of the file) read as zeros.
+//
+class RegionReader {
+public:
+  RegionReader(pid_t pid, const std::vector<MemoryRegion> &regions)
+      : pid_(pid), regions_(regions),
+        position_(regions.empty() ? 0 : regions.front().start) {}
+
+  /// Read the next @param size bytes of the stream into @param dst.
+  int read(uint8_t *dst, size_t size) {
+    size_t done = 0;
+    std::vector<iovec> remote;
+    while (done != size) {
+      // Remote iovecs from the current position on.
+      remote.clear();
+      size_t requested = 0;
+      size_t region = region_;
+      uintptr_t position = position_;
+      while (region < regions_.size() && remote.size() < kMaxIovecs &&
+             done + requested != size) {
+        size_t len = std::min(regions_[region].end - position,
+                              size - done - requested);
+        remote.push_back({reinterpret_cast<void *>(position), len});
+        requested += len;
+        if (++region < regions_.size())
+          position = regions_[region].start;
+      }
+      if (remote.empty()) {
+        LOG(WARNING) << "Read past the last region.";
+        return -1;
+      }
+
+      iovec local = {dst + done, requested};
+      ssize_t ret = process_vm_readv(pid_, &local, 1, remote.data(),
+                                     remote.size(), 0);
+      if (ret == -1 && errno != EFAULT) {
+        LOG(WARNING) << "process_vm_readv failed: " << strerror(errno);
+        return -1;
+      }
+      size_t read = ret > 0 ? static_cast<size_t>(ret) : 0;
+      advance(read);
+      done += read;
+      if (read == requested)
+        continue;
+
+      // Zero the rest of the remote iovec that faulted and skip it.
+      size_t skipped = 0;
+      for (const auto &iov : remote) {
+        if (read < skipped + iov.iov_len) {
+          skipped = skipped + iov.iov_len - read;
+          break;
+        }
+        skipped += iov.iov_len;
+      }
+      memset(dst + done, 0, skipped);
+      advance(skipped);
+      done += skipped;
+      unreadable_ += skipped;
+    }
+    return 0;
+  }
+
+  size_t unreadable() const { return unreadable_; }
+
+private:
+  void advance(size_t size) {
+    while (size != 0) {
+      size_t len = std::min<size_t>(regions_[region_].end - position_, size);
+      position_ += len;
+      size -= len;
+      if (position_ == regions_[region_].end &&
+          region_ + 1 < regions_.size())
+        position_ = regions_[++region_].start;
+    }
+  }
+
+  pid_t pid_;
+  const std::vector<MemoryRegion> &regions_;
+  size_t region_ = 0;
+  uintptr_t position_;
+  size_t unreadable_ = 0;
+};
+
+//
+/// Captured memory of a process: its regions concatenated and compressed in
+/// fixed-size chunks.
+//
+struct ProcessImage {
+  std::vector<MemoryRegion> regions;
+  size_t size = 0;
+  size_t unreadable = 0;
+  multi_engine::CompressedFormat chunks;
+
+  size_t compressed_size() const {
+    size_t compressed_size = 0;
+    for (const auto &[chunk, size] : chunks)
+      compressed_size += chunk.size();
+    return compressed_size;
+  }
+};
+
+enum CaptureMode {
+  // Read batches with process_vm_readv() while the previous batch is being
+  // compressed; the target is stopped for the whole capture.
+  kCaptureOverlapped,
+  // Copy the whole memory, resume the target, then compress the copy.
+  kCaptureCopyFirst
+};
+
+/// Map the regions of @param pid and prepare @param image for them.
+static int prepare_image(pid_t pid, size_t chunk_size, ProcessImage *image) {
+  if (read_memory_maps(pid, &image->regions))
+    return -1;
+  image->size = 0;
+  for (const auto &region : image->regions)
+    image->size += region.size();
+  image->chunks = multi_engine::make_fixed_chunks(image->size, chunk_size);
+  return 0;
+}
+
+/// Capture process @param pid into @param image, reading @param batch_size
+/// bytes (a multiple of @param chunk_size) at a time and compressing with
+/// @param inflight_jobs jobs. Reports how long the target was stopped in
+/// @param pause_us.
+int capture_process(CaptureMode mode, pid_t pid, size_t chunk_size,
+                    size_t batch_size, size_t inflight_jobs,
+                    ProcessImage *image, double *pause_us) {
+  if (chunk_size == 0 || batch_size < chunk_size ||
+      batch_size % chunk_size != 0) {
+    LOG(WARNING) << "The batch size must be a multiple of the chunk size.";
+    return -1;
+  }
+  TimeScope pause;
+  if (stop_process(pid))
+    return -1;
+  // The maps can change till the target is stopped.
+  if (prepare_image(pid, chunk_size, image)) {
+    resume_process(pid);
+    return -1;
+  }
+  RegionReader reader(pid, image->regions);
+
+  if (mode == kCaptureCopyFirst) {
+    auto copy = mmap_allocate(image->size);
+    int ret = reader.read(copy.get(), image->size);
+    resume_process(pid);
+    *pause_us = pause.GetTimeStamp<std::chrono::nanoseconds>() / 1000.0;
+    image->unreadable = reader.unreadable();
+    if (ret)
+      return -1;
+    return multi_engine::compress_queued(multi_engine::kParallelDynamic,
+                                         copy.get(), image->size,
+                                         inflight_jobs, &image->chunks);
+  }
+
+  const size_t chunk_count = image->chunks.size();
+  inflight_jobs = std::max<size_t>(1, std::min(inflight_jobs, chunk_count));
+  auto job_buffers = multi_engine::init_qpl(qpl_path_hardware, inflight_jobs);
+  if (job_buffers.empty()) {
+    resume_process(pid);
+    LOG(WARNING) << "Failed to init qpl.";
+    return -1;
+  }
+  // Double buffering: the next batch is read into the other buffer.
+  std::unique_ptr<uint8_t, MMapDeleter> staging[2] = {
+      mmap_allocate(batch_size), mmap_allocate(batch_size)};
+
+  JobSubmitter submitter;
+  constexpr size_t kNoChunk = static_cast<size_t>(-1);
+  std::vector<size_t> job_chunk(inflight_jobs, kNoChunk);
+  size_t next_chunk = 0, completed = 0, batch_end_chunk = 0;
+  const size_t chunks_per_batch = batch_size / chunk_size;
+  int ret = 0;
+
+  // Submit the pending chunks of the current batch to the free jobs.
+  auto submit_free = [&]() {
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+      if (job_chunk[i] != kNoChunk || next_chunk == batch_end_chunk)
+        continue;
+      auto &[chunk_buff, size] = image->chunks[next_chunk];
+      size_t batch = next_chunk / chunks_per_batch;
+      auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+      multi_engine::prepare_compress_job(
+          job, multi_engine::kParallelDynamic, nullptr,
+          staging[batch % 2].get() +
+              (next_chunk - batch * chunks_per_batch) * chunk_size,
+          size, chunk_buff.data(), chunk_buff.size());
+      if (submitter.submit(job) != QPL_STS_OK) {
+        ret = -1;
+        break;
+      }
+      job_chunk[i] = next_chunk++;
+    }
+  };
+  // Collect the completed jobs.
+  auto poll = [&]() {
+    bool progress = false;
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+      if (job_chunk[i] == kNoChunk)
+        continue;
+      auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+      auto status = submitter.check(job);
+      if (status == QPL_STS_BEING_PROCESSED)
+        continue;
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status
+                     << " acquired during awaiting for completion";
+        job_chunk[i] = kNoChunk;
+        ret = -1;
+        break;
+      }
+      std::get<0>(image->chunks[job_chunk[i]]).resize(job->total_out);
+      job_chunk[i] = kNoChunk;
+      ++completed;
+      progress = true;
+    }
+    return progress;
+  };
+
+  auto batch_bytes = [&](size_t batch) {
+    return std::min(batch_size, image->size - batch * batch_size);
+  };
+  const size_t batch_count = (image->size + batch_size - 1) / batch_size;
+  if (batch_count != 0)
+    ret = reader.read(staging[0].get(), batch_bytes(0));
+  CompletionWaiter waiter(kWaitBusyPoll);
+  for (size_t batch = 0; batch < batch_count && ret == 0; ++batch) {
+    batch_end_chunk = std::min(chunk_count, (batch + 1) * chunks_per_batch);
+    submit_free();
+    // Read the next batch while the engines compress this one.
+    if (ret == 0 && batch + 1 < batch_count)
+      ret = reader.read(staging[(batch + 1) % 2].get(),
+                        batch_bytes(batch + 1));
+    while (ret == 0 && completed != batch_end_chunk) {
+      if (poll())
+        waiter.reset();
+      else
+        waiter.wait();
+      submit_free();
+    }
+  }
+  resume_process(pid);
+  *pause_us = pause.GetTimeStamp<std::chrono::nanoseconds>() / 1000.0;
+  image->unreadable = reader.unreadable();
+
+  multi_engine::drain_queued(submitter, job_buffers, job_chunk, kNoChunk);
+  if (multi_engine::free_qpl(job_buffers)) {
+    LOG(WARNING) << "Failed to free resources.";
+    return -1;
+  }
+  return ret;
+}
+
+/// Decompress @param image into @param dst (of image.size bytes).
+int restore_image(ProcessImage &image, size_t inflight_jobs, uint8_t *dst) {
+  size_t decompressed_size = 0;
+  if (multi_engine::decompress_queued(image.chunks, dst, inflight_jobs,
+                                      &decompressed_size) ||
+      decompressed_size != image.size)
+    return -1;
+  return 0;
+}
+
+/// Synthetic image the capture target holds.
+static synthetic::SnapshotProfile target_profile(size_t size) {
+  synthetic::SnapshotProfile profile;
+  profile.size = size;
+  profile.seed = kCaptureTargetSeed;
+  return profile;
+}
+
+/// Body of the capture target process: hold a synthetic image of
+/// @param size bytes, report its address and size on stdout and stay alive.
+[[noreturn]] void run_target(size_t size) {
+  auto mem = mmap_allocate(size);
+  synthetic::generate_snapshot(target_profile(size), mem.get());
+  printf("%lu %zu\n", reinterpret_cast<uintptr_t>(mem.get()), size);
+  fflush(stdout);
+  volatile uint64_t heartbeat = 0;
+  while (true) {
+    heartbeat = heartbeat + 1;
+    usleep(1000);
+  }
+}
+
+//
+/// Capture target: this binary re-executed with --capture_target_mb, so that
+/// it does not inherit the memory of the benchmark process.
+//
+class TargetProcess {
+public:
+  explicit TargetProcess(size_t size_mb) {
+    int fds[2];
+    if (pipe(fds))
+      return;
+    pid_ = fork();
+    if (pid_ == 0) {
+      prctl(PR_SET_PDEATHSIG, SIGKILL);
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      const std::string flag = "--capture_target_mb=" + std::to_string(size_mb);
+      execl("/proc/self/exe", "iaa_bench", flag.c_str(), nullptr);
+      _exit(1);
+    }
+    close(fds[1]);
+    if (pid_ == -1) {
+      close(fds[0]);
+      return;
+    }
+    FILE *out = fdopen(fds[0], "r");
+    unsigned long address = 0;
+    if (fscanf(out, "%lu %zu", &address, &size_) == 2)
+      address_ = address;
+    fclose(out);
+  }
+
+  ~TargetProcess() {
+    if (pid_ > 0) {
+      kill(pid_, SIGKILL);
+      waitpid(pid_, nullptr, 0);
+    }
+  }
+
+  TargetProcess(const TargetProcess &) = delete;
+  TargetProcess &operator=(const TargetProcess &) = delete;
+
+  bool ok() const { return pid_ > 0 && address_ != 0; }
+  pid_t pid() const { return pid_; }
+  // Address and size of the synthetic image in the target.
+  uintptr_t address() const { return address_; }
+  size_t size() const { return size_; }
+
+private:
+  pid_t pid_ = -1;
+  uintptr_t address_ = 0;
+  size_t size_ = 0;
+};
+
+} // namespace capture
+
+#endif
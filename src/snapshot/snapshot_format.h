@@ -0,0 +1,267 @@
+#ifndef _SNAPSHOT_FORMAT_H_
+#define _SNAPSHOT_FORMAT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../util.h"
+
+namespace snapshot {
+
+// Alignment of every part of a snapshot file, allows O_DIRECT I/O.
+static constexpr size_t kBlockSize = 4 * kkB;
+
+// "IAASNAP1".
+static constexpr uint64_t kSnapshotMagic = 0x3150414E53414149ULL;
+static constexpr uint64_t kSnapshotVersion = 2;
+
+//
+/// Seekable snapshot file layout:
+///   [header block][chunk]...[chunk][index][page map]
+/// Every part starts at a kBlockSize boundary. Chunks are independent deflate
+/// streams stored in the order they were written; the index lists them in
+/// source order, so any chunk can be restored on its own.
+///
+/// The pages of a reordered snapshot (see layout.h) are compressed as a
+/// stream of kBlockSize pages in another order than their addresses; the
+/// optional page map gives the guest page of every page of the stream.
+//
+struct SnapshotHeader {
+  uint64_t magic;
+  uint64_t version;
+  uint64_t chunk_size;
+  uint64_t original_size;
+  uint64_t chunk_count;
+  uint64_t index_offset;
+  // 0 if the pages are stored in address order.
+  uint64_t page_map_offset;
+};
+
+struct ChunkIndexEntry {
+  uint64_t file_offset;
+  uint64_t compressed_size;
+  uint64_t original_offset;
+  uint64_t original_size;
+};
+
+//
+/// Page order of a reordered snapshot: page i of the stored stream is guest
+/// page guest_pages[i]; empty for the address order.
+//
+struct PageLayout {
+  size_t original_size = 0;
+  std::vector<uint64_t> guest_pages;
+};
+
+static inline size_t align_up(size_t size, size_t alignment = kBlockSize) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+/// pread() exactly @param size bytes.
+static int read_exact(int fd, uint8_t *buff, size_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t res = pread(fd, buff, size, static_cast<off_t>(offset));
+    if (res <= 0) {
+      LOG(WARNING) << "Failed to read snapshot: " << strerror(errno);
+      return -1;
+    }
+    buff += res;
+    size -= static_cast<size_t>(res);
+    offset += static_cast<uint64_t>(res);
+  }
+  return 0;
+}
+
+/// pwrite() exactly @param size bytes.
+static int write_exact(int fd, const uint8_t *buff, size_t size,
+                       uint64_t offset) {
+  while (size > 0) {
+    ssize_t res = pwrite(fd, buff, size, static_cast<off_t>(offset));
+    if (res <= 0) {
+      LOG(WARNING) << "Failed to write snapshot: " << strerror(errno);
+      return -1;
+    }
+    buff += res;
+    size -= static_cast<size_t>(res);
+    offset += static_cast<uint64_t>(res);
+  }
+  return 0;
+}
+
+/// Whether @param size bytes at @param offset lie within @param limit bytes.
+static inline bool within(uint64_t offset, uint64_t size, uint64_t limit) {
+  return size <= limit && offset <= limit - size;
+}
+
+/// Size of the snapshot open as @param fd in @param size.
+static int snapshot_file_size(int fd, uint64_t *size) {
+  struct stat st;
+  if (fstat(fd, &st)) {
+    LOG(WARNING) << "Failed to stat snapshot: " << strerror(errno);
+    return -1;
+  }
+  *size = static_cast<uint64_t>(st.st_size);
+  return 0;
+}
+
+/// Read the header and the chunk index of the snapshot open as @param fd
+/// (with or without O_DIRECT); an index with chunks outside the file or
+/// outside the original size is rejected.
+int load_snapshot_index(int fd, SnapshotHeader *header,
+                        std::vector<ChunkIndexEntry> *index) {
+  index->clear();
+  uint64_t file_size = 0;
+  if (snapshot_file_size(fd, &file_size))
+    return -1;
+
+  auto header_block = mmap_allocate(kBlockSize);
+  if (read_exact(fd, header_block.get(), kBlockSize, 0))
+    return -1;
+  memcpy(header, header_block.get(), sizeof(*header));
+  if (header->magic != kSnapshotMagic ||
+      header->version != kSnapshotVersion) {
+    LOG(WARNING) << "Not a snapshot file.";
+    return -1;
+  }
+  if (header->chunk_size == 0 ||
+      header->chunk_count > file_size / sizeof(ChunkIndexEntry) ||
+      !within(header->index_offset,
+              align_up(header->chunk_count * sizeof(ChunkIndexEntry)),
+              file_size)) {
+    LOG(WARNING) << "Corrupt snapshot header.";
+    return -1;
+  }
+
+  size_t index_size = header->chunk_count * sizeof(ChunkIndexEntry);
+  auto index_blocks = mmap_allocate(align_up(index_size));
+  if (read_exact(fd, index_blocks.get(), align_up(index_size),
+                 header->index_offset))
+    return -1;
+  index->resize(header->chunk_count);
+  memcpy(index->data(), index_blocks.get(), index_size);
+  // The stream of a reordered snapshot is padded to whole pages.
+  const uint64_t stream_size = header->page_map_offset != 0
+                                   ? align_up(header->original_size)
+                                   : header->original_size;
+  if (std::any_of(index->begin(), index->end(),
+                  [header, file_size,
+                   stream_size](const ChunkIndexEntry &chunk) {
+                    return chunk.original_size > header->chunk_size ||
+                           chunk.compressed_size > UINT32_MAX ||
+                           !within(chunk.original_offset, chunk.original_size,
+                                   stream_size) ||
+                           !within(chunk.file_offset, chunk.compressed_size,
+                                   file_size);
+                  })) {
+    LOG(WARNING) << "Corrupt snapshot index.";
+    index->clear();
+    return -1;
+  }
+  return 0;
+}
+
+/// Read the page map of the snapshot open as @param fd into @param layout;
+/// a map with pages outside the original size is rejected.
+int load_page_layout(int fd, const SnapshotHeader &header,
+                     PageLayout *layout) {
+  layout->original_size = header.original_size;
+  layout->guest_pages.clear();
+  if (header.page_map_offset == 0)
+    return 0;
+
+  uint64_t file_size = 0;
+  if (snapshot_file_size(fd, &file_size))
+    return -1;
+  size_t page_count = align_up(header.original_size) / kBlockSize;
+  if (page_count > file_size / sizeof(uint64_t) ||
+      !within(header.page_map_offset,
+              align_up(page_count * sizeof(uint64_t)), file_size)) {
+    LOG(WARNING) << "Corrupt snapshot header.";
+    return -1;
+  }
+  size_t map_size = page_count * sizeof(uint64_t);
+  auto map_blocks = mmap_allocate(align_up(map_size));
+  if (read_exact(fd, map_blocks.get(), align_up(map_size),
+                 header.page_map_offset))
+    return -1;
+  layout->guest_pages.resize(page_count);
+  memcpy(layout->guest_pages.data(), map_blocks.get(), map_size);
+  if (std::any_of(layout->guest_pages.begin(), layout->guest_pages.end(),
+                  [page_count](uint64_t page) { return page >= page_count; })) {
+    LOG(WARNING) << "Corrupt snapshot page map.";
+    layout->guest_pages.clear();
+    return -1;
+  }
+  return 0;
+}
+
+/// Copy the @param size bytes of the reordered page stream decompressed from
+/// @param stream_offset on to the guest pages in @param dst.
+static void scatter_pages(const uint8_t *src, uint64_t stream_offset,
+                          size_t size, const PageLayout &layout,
+                          uint8_t *dst) {
+  for (size_t offset = 0; offset < size; offset += kBlockSize) {
+    uint64_t guest_offset =
+        layout.guest_pages[(stream_offset + offset) / kBlockSize] * kBlockSize;
+    memcpy(dst + guest_offset, src + offset,
+           std::min(kBlockSize, layout.original_size - guest_offset));
+  }
+}
+
+/// Restore the whole snapshot @param filename into @param dst (of at least
+/// the original size) chunk by chunk.
+int restore_snapshot(const char *filename, uint8_t *dst, size_t dst_size) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    LOG(WARNING) << "Failed to open file: " << filename;
+    return -1;
+  }
+
+  int ret = 0;
+  SnapshotHeader header;
+  std::vector<ChunkIndexEntry> index;
+  PageLayout layout;
+  std::vector<uint8_t> chunk_buff, stream_buff;
+  if (load_snapshot_index(fd, &header, &index) ||
+      load_page_layout(fd, header, &layout) ||
+      header.original_size > dst_size)
+    ret = -1;
+  for (size_t i = 0; i < index.size() && ret == 0; ++i) {
+    const auto &chunk = index[i];
+    const bool reordered = !layout.guest_pages.empty();
+    chunk_buff.resize(chunk.compressed_size);
+    stream_buff.resize(reordered ? chunk.original_size : 0);
+    size_t decompressed_size = 0;
+    if (read_exact(fd, chunk_buff.data(), chunk.compressed_size,
+                   chunk.file_offset) ||
+        single_engine::decompress(
+            qpl_path_hardware, single_engine::kModeDynamic, nullptr, 0,
+            chunk_buff.data(), chunk.compressed_size,
+            reordered ? stream_buff.data() : dst + chunk.original_offset,
+            chunk.original_size, &decompressed_size) ||
+        decompressed_size != chunk.original_size) {
+      LOG(WARNING) << "Failed to restore chunk " << i;
+      ret = -1;
+      break;
+    }
+    if (reordered)
+      scatter_pages(stream_buff.data(), chunk.original_offset,
+                    chunk.original_size, layout, dst);
+  }
+
+  close(fd);
+  return ret;
+}
+
+} // namespace snapshot
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef _SNAPSHOT_READER_H_
+#define _SNAPSHOT_READER_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "../single_engine/qpl_compress_decompress.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+#include "io_uring.h"
+#include "snapshot_format.h"
+
+#include "qpl/qpl.h"
+
+namespace snapshot {
+
+/// Open @param filename for O_DIRECT reading; falls back to buffered I/O on
+/// file systems without O_DIRECT support (e.g. tmpfs).
+static int open_direct_read(const char *filename) {
+  int fd = open(filename, O_RDONLY | O_DIRECT);
+  if (fd == -1 && errno == EINVAL)
+    fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    LOG(WARNING) << "Failed to open file: " << filename;
+  return fd;
+}
+
+/// Restore the snapshot @param filename into @param dst with one hardware
+/// job: up to @param readahead_chunks chunks are read with io_uring ahead of
+/// the decompression, so the disk and the engine work in parallel.
+int restore_snapshot_overlapped(const char *filename, uint8_t *dst,
+                                size_t dst_size, size_t readahead_chunks,
+                                WaitStrategy wait = kWaitBusyPoll) {
+  int fd = open_direct_read(filename);
+  if (fd == -1)
+    return -1;
+
+  SnapshotHeader header;
+  std::vector<ChunkIndexEntry> index;
+  PageLayout layout;
+  if (load_snapshot_index(fd, &header, &index) ||
+      load_page_layout(fd, header, &layout) ||
+      header.original_size > dst_size) {
+    close(fd);
+    return -1;
+  }
+  // Reordered chunks are decompressed here, then scattered.
+  const bool reordered = !layout.guest_pages.empty();
+  std::vector<uint8_t> stream_buff(reordered ? header.chunk_size : 0);
+
+  const size_t slot_count =
+      std::max<size_t>(1, std::min(readahead_chunks, index.size()));
+  size_t slot_size = kBlockSize;
+  for (const auto &chunk : index)
+    slot_size = std::max(slot_size, align_up(chunk.compressed_size));
+  auto slots = mmap_allocate(slot_count * slot_size);
+  memset(slots.get(), _PAGE_PREFAULT_, slot_count * slot_size);
+
+  IoUring ring(static_cast<unsigned>(slot_count));
+  auto job_buffer = single_engine::init_qpl(qpl_path_hardware);
+  if (!ring.ok() || job_buffer == nullptr) {
+    LOG(WARNING) << "Failed to init the snapshot reader.";
+    close(fd);
+    return -1;
+  }
+  auto job = reinterpret_cast<qpl_job *>(job_buffer.get());
+
+  // Slot i reads chunk slot_chunk[i].
+  std::vector<size_t> slot_chunk(slot_count, 0);
+  size_t next_chunk = 0;
+  size_t inflight_reads = 0;
+  auto read_next = [&](size_t slot) {
+    const auto &chunk = index[next_chunk];
+    slot_chunk[slot] = next_chunk++;
+    ++inflight_reads;
+    return ring.queue_read(fd, slots.get() + slot * slot_size,
+                           align_up(chunk.compressed_size), chunk.file_offset,
+                           slot);
+  };
+
+  int ret = 0;
+  for (size_t slot = 0; slot < slot_count && ret == 0; ++slot)
+    ret = read_next(slot);
+  if (ret == 0)
+    ret = ring.submit();
+
+  size_t restored = 0;
+  while (ret == 0 && restored != index.size()) {
+    uint64_t slot;
+    int32_t res;
+    if (!ring.reap(&slot, &res)) {
+      if (ring.submit(1))
+        ret = -1;
+      continue;
+    }
+    --inflight_reads;
+    const auto &chunk = index[slot_chunk[slot]];
+    if (res < 0 || static_cast<size_t>(res) < chunk.compressed_size) {
+      LOG(WARNING) << "Failed to read chunk: "
+                   << (res < 0 ? strerror(-res) : "short read");
+      ret = -1;
+      break;
+    }
+
+    // Decompress while the other chunks are being read.
+    job->op = qpl_op_decompress;
+    job->next_in_ptr = slots.get() + slot * slot_size;
+    job->available_in = static_cast<uint32_t>(chunk.compressed_size);
+    job->next_out_ptr =
+        reordered ? stream_buff.data() : dst + chunk.original_offset;
+    job->available_out = static_cast<uint32_t>(chunk.original_size);
+    job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST;
+    qpl_status status = execute_job(job, wait);
+    if (status != QPL_STS_OK || job->total_out != chunk.original_size) {
+      LOG(WARNING) << "An error " << status
+                   << " acquired during decompression.";
+      ret = -1;
+      break;
+    }
+    if (reordered)
+      scatter_pages(stream_buff.data(), chunk.original_offset,
+                    chunk.original_size, layout, dst);
+    ++restored;
+
+    if (next_chunk < index.size() &&
+        (read_next(static_cast<size_t>(slot)) || ring.submit()))
+      ret = -1;
+  }
+
+  // Drain the reads still in flight after a failure.
+  while (inflight_reads > 0 && ring.submit(1) == 0) {
+    uint64_t slot;
+    int32_t res;
+    while (ring.reap(&slot, &res))
+      --inflight_reads;
+  }
+  if (single_engine::free_qpl(job)) {
+    LOG(WARNING) << "Failed to free resources.";
+    ret = -1;
+  }
+  close(fd);
+  return ret;
+}
+
+} // namespace snapshot
+
+#endif
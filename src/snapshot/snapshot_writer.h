@@ -0,0 +1,251 @@
+#ifndef _SNAPSHOT_WRITER_H_
+#define _SNAPSHOT_WRITER_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "../job_submitter.h"
+#include "../multi_engine/qpl_parallel.h"
+#include "../util.h"
+#include "../wait_strategy.h"
+#include "io_uring.h"
+#include "snapshot_format.h"
+
+#include "qpl/qpl.h"
+
+namespace snapshot {
+
+/// Open @param filename for O_DIRECT writing; falls back to buffered I/O on
+/// file systems without O_DIRECT support (e.g. tmpfs).
+static int open_direct(const char *filename) {
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+  if (fd == -1 && errno == EINVAL) {
+    LOG(WARNING) << "O_DIRECT is not supported for " << filename
+                 << ", using buffered I/O.";
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  }
+  if (fd == -1)
+    LOG(WARNING) << "Failed to open file: " << filename;
+  return fd;
+}
+
+struct SnapshotWriteStats {
+  size_t compressed_size = 0;
+  size_t file_size = 0;
+};
+
+/// Write @param src as a seekable snapshot (see snapshot_format.h) to
+/// @param filename: @param chunk_size chunks are compressed by up to
+/// @param inflight_jobs hardware jobs and every compressed chunk is written
+/// with io_uring as soon as its job completes, so the compression of the next
+/// chunks overlaps with the writes of the previous ones.
+int write_snapshot(const uint8_t *src, size_t src_size, size_t chunk_size,
+                   size_t inflight_jobs, const char *filename,
+                   SnapshotWriteStats *stats,
+                   WaitStrategy wait = kWaitBusyPoll,
+                   const PageLayout *layout = nullptr) {
+  const size_t chunk_count = (src_size + chunk_size - 1) / chunk_size;
+  inflight_jobs = std::max<size_t>(1, std::min(inflight_jobs, chunk_count));
+
+  // Every output slot is busy from compression start till write completion;
+  // twice as many slots as jobs keep the engines busy while writes drain.
+  const size_t slot_count = 2 * inflight_jobs;
+  const size_t slot_size = align_up(2 * chunk_size);
+  auto slots = mmap_allocate(slot_count * slot_size);
+  memset(slots.get(), _PAGE_PREFAULT_, slot_count * slot_size);
+
+  IoUring ring(static_cast<unsigned>(slot_count + 2));
+  if (!ring.ok())
+    return -1;
+  auto job_buffers = multi_engine::init_qpl(qpl_path_hardware, inflight_jobs);
+  if (job_buffers.empty()) {
+    LOG(WARNING) << "Failed to init qpl.";
+    return -1;
+  }
+  int fd = open_direct(filename);
+  if (fd == -1) {
+    multi_engine::free_qpl(job_buffers);
+    return -1;
+  }
+
+  JobSubmitter submitter;
+  std::vector<ChunkIndexEntry> index(chunk_count);
+  constexpr size_t kNoSlot = static_cast<size_t>(-1);
+  std::vector<size_t> job_slot(inflight_jobs, kNoSlot);
+  std::vector<size_t> slot_chunk(slot_count, 0);
+  std::vector<size_t> slot_write_size(slot_count, 0);
+  std::vector<size_t> free_slots;
+  for (size_t i = slot_count; i > 0; --i)
+    free_slots.push_back(i - 1);
+
+  size_t next_chunk = 0;
+  size_t written = 0;
+  size_t inflight_writes = 0;
+  size_t compressed_size = 0;
+  uint64_t file_offset = kBlockSize;
+  int ret = 0;
+  CompletionWaiter waiter(wait);
+  while (ret == 0 && written != chunk_count) {
+    bool progress = false;
+
+    // Start compressing the next chunks on idle jobs.
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+      if (job_slot[i] != kNoSlot || next_chunk == chunk_count ||
+          free_slots.empty())
+        continue;
+      size_t slot = free_slots.back();
+      free_slots.pop_back();
+      size_t offset = next_chunk * chunk_size;
+      size_t size = std::min(chunk_size, src_size - offset);
+      auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+      multi_engine::prepare_compress_job(
+          job, multi_engine::kParallelDynamic, nullptr, src + offset, size,
+          slots.get() + slot * slot_size, slot_size);
+      qpl_status status = submitter.submit(job);
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status
+                     << " acquired during compression job submission.";
+        ret = -1;
+        break;
+      }
+      index[next_chunk].original_offset = offset;
+      index[next_chunk].original_size = size;
+      slot_chunk[slot] = next_chunk++;
+      job_slot[i] = slot;
+    }
+
+    // Queue writes of the compressed chunks.
+    bool queued = false;
+    for (size_t i = 0; i < inflight_jobs && ret == 0; ++i) {
+      if (job_slot[i] == kNoSlot)
+        continue;
+      auto job = reinterpret_cast<qpl_job *>(job_buffers[i].get());
+      auto status = submitter.check(job);
+      if (status == QPL_STS_BEING_PROCESSED)
+        continue;
+      if (status != QPL_STS_OK) {
+        LOG(WARNING) << "An error " << status
+                     << " acquired during awaiting for completion";
+        job_slot[i] = kNoSlot;
+        ret = -1;
+        break;
+      }
+
+      size_t slot = job_slot[i];
+      auto &chunk = index[slot_chunk[slot]];
+      uint8_t *buff = slots.get() + slot * slot_size;
+      size_t size = job->total_out;
+      size_t size_aligned = align_up(size);
+      memset(buff + size, 0, size_aligned - size);
+      chunk.file_offset = file_offset;
+      chunk.compressed_size = size;
+      if (ring.queue_write(fd, buff, size_aligned, file_offset, slot)) {
+        LOG(WARNING) << "io_uring submission queue is full.";
+        job_slot[i] = kNoSlot;
+        ret = -1;
+        break;
+      }
+      slot_write_size[slot] = size_aligned;
+      file_offset += size_aligned;
+      compressed_size += size;
+      job_slot[i] = kNoSlot;
+      ++inflight_writes;
+      queued = progress = true;
+    }
+    if (queued && ring.submit())
+      ret = -1;
+
+    // Recycle the slots of the completed writes.
+    uint64_t slot;
+    int32_t res;
+    while (ret == 0 && ring.reap(&slot, &res)) {
+      if (res < 0 || static_cast<size_t>(res) != slot_write_size[slot]) {
+        LOG(WARNING) << "Failed to write chunk: "
+                     << (res < 0 ? strerror(-res) : "short write");
+        ret = -1;
+        break;
+      }
+      free_slots.push_back(slot);
+      --inflight_writes;
+      ++written;
+      progress = true;
+    }
+
+    if (progress) {
+      waiter.reset();
+    } else if (inflight_writes > 0 &&
+               std::all_of(job_slot.begin(), job_slot.end(),
+                           [](size_t s) { return s == kNoSlot; })) {
+      // Only waiting for the disk.
+      if (ring.submit(1))
+        ret = -1;
+    } else {
+      waiter.wait();
+    }
+  }
+
+  // Wait for the writes still in flight after a failure.
+  while (ret != 0 && inflight_writes > 0 && ring.submit(1) == 0) {
+    uint64_t slot;
+    int32_t res;
+    while (ring.reap(&slot, &res))
+      --inflight_writes;
+  }
+  for (size_t i = 0; i < inflight_jobs; ++i)
+    if (job_slot[i] != kNoSlot)
+      while (submitter.check(reinterpret_cast<qpl_job *>(
+                 job_buffers[i].get())) == QPL_STS_BEING_PROCESSED)
+        waiter.wait();
+  if (multi_engine::free_qpl(job_buffers)) {
+    LOG(WARNING) << "Failed to free resources.";
+    ret = -1;
+  }
+
+  // Index (and page map) after the last chunk and the header in front of
+  // the first one.
+  if (ret == 0) {
+    const bool reordered = layout != nullptr;
+    size_t index_size = align_up(chunk_count * sizeof(ChunkIndexEntry));
+    size_t map_size =
+        reordered ? align_up(layout->guest_pages.size() * sizeof(uint64_t))
+                  : 0;
+    SnapshotHeader header{kSnapshotMagic,
+                          kSnapshotVersion,
+                          chunk_size,
+                          reordered ? layout->original_size : src_size,
+                          chunk_count,
+                          file_offset,
+                          reordered ? file_offset + index_size : 0};
+    auto metadata = mmap_allocate(kBlockSize + index_size + map_size);
+    memset(metadata.get(), 0, kBlockSize + index_size + map_size);
+    memcpy(metadata.get(), &header, sizeof(header));
+    memcpy(metadata.get() + kBlockSize, index.data(),
+           chunk_count * sizeof(ChunkIndexEntry));
+    if (reordered)
+      memcpy(metadata.get() + kBlockSize + index_size,
+             layout->guest_pages.data(),
+             layout->guest_pages.size() * sizeof(uint64_t));
+    if (write_exact(fd, metadata.get(), kBlockSize, 0) ||
+        write_exact(fd, metadata.get() + kBlockSize, index_size + map_size,
+                    file_offset) ||
+        fdatasync(fd)) {
+      LOG(WARNING) << "Failed to write snapshot metadata.";
+      ret = -1;
+    }
+    stats->compressed_size = compressed_size;
+    stats->file_size = file_offset + index_size + map_size;
+  }
+
+  close(fd);
+  return ret;
+}
+
+} // namespace snapshot
+
+#endif
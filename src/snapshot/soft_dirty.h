@@ -0,0 +1,166 @@
+#ifndef _SOFT_DIRTY_H_
+#define _SOFT_DIRTY_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <numeric>
+#include <unistd.h>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../multi_engine/qpl_parallel.h"
+#include "../util.h"
+
+namespace incremental {
+
+static constexpr size_t kSoftDirtyPageSize = 4 * kkB;
+// Soft-dirty bit of a /proc/<pid>/pagemap entry.
+static constexpr uint64_t kPagemapSoftDirty = 1ULL << 55;
+// Pagemap entries read per pread().
+static constexpr size_t kPagemapBatch = 4096;
+
+/// Clear the soft-dirty bits of all the pages of the process.
+static int clear_soft_dirty() {
+  int fd = open("/proc/self/clear_refs", O_WRONLY);
+  if (fd == -1) {
+    LOG(WARNING) << "Failed to open /proc/self/clear_refs.";
+    return -1;
+  }
+  int ret = write(fd, "4", 1) == 1 ? 0 : -1;
+  close(fd);
+  if (ret)
+    LOG(WARNING) << "Failed to clear soft-dirty bits.";
+  return ret;
+}
+
+/// Indices of the pages of the page-aligned region @param mem of @param size
+/// bytes written since the last clear_soft_dirty().
+static int read_dirty_pages(const uint8_t *mem, size_t size,
+                            std::vector<size_t> *pages) {
+  int fd = open("/proc/self/pagemap", O_RDONLY);
+  if (fd == -1) {
+    LOG(WARNING) << "Failed to open /proc/self/pagemap.";
+    return -1;
+  }
+  const size_t first_entry =
+      reinterpret_cast<uintptr_t>(mem) / kSoftDirtyPageSize;
+  const size_t page_count =
+      (size + kSoftDirtyPageSize - 1) / kSoftDirtyPageSize;
+  std::vector<uint64_t> entries(kPagemapBatch);
+  pages->clear();
+  for (size_t page = 0; page < page_count; page += kPagemapBatch) {
+    size_t batch = std::min(kPagemapBatch, page_count - page);
+    size_t bytes = batch * sizeof(uint64_t);
+    if (pread(fd, entries.data(), bytes,
+              static_cast<off_t>((first_entry + page) * sizeof(uint64_t))) !=
+        static_cast<ssize_t>(bytes)) {
+      LOG(WARNING) << "Failed to read /proc/self/pagemap.";
+      close(fd);
+      return -1;
+    }
+    for (size_t i = 0; i < batch; ++i)
+      if (entries[i] & kPagemapSoftDirty)
+        pages->push_back(page + i);
+  }
+  close(fd);
+  return 0;
+}
+
+/// Whether the kernel tracks soft-dirty pages (CONFIG_MEM_SOFT_DIRTY).
+static bool soft_dirty_supported() {
+  auto probe = mmap_allocate(kSoftDirtyPageSize);
+  std::vector<size_t> pages;
+  probe.get()[0] = 1;
+  if (clear_soft_dirty())
+    return false;
+  *reinterpret_cast<volatile uint8_t *>(probe.get()) = 2;
+  return read_dirty_pages(probe.get(), kSoftDirtyPageSize, &pages) == 0 &&
+         pages.size() == 1;
+}
+
+//
+/// Chunked compressed store of a memory region kept up to date by
+/// recompressing only the chunks with pages written since the previous
+/// snapshot, as reported by the soft-dirty bits.
+///
+/// The region must not be written while a snapshot is taken (a VMM pauses
+/// its vCPUs): a write between reading the pagemap and clearing the bits
+/// would be missed by the next incremental snapshot.
+//
+class IncrementalSnapshot {
+public:
+  /// @param mem must be page-aligned and @param chunk_size a multiple of the
+  /// page size.
+  IncrementalSnapshot(const uint8_t *mem, size_t size, size_t chunk_size,
+                      size_t inflight_jobs)
+      : mem_(mem), size_(size), chunk_size_(chunk_size),
+        inflight_jobs_(inflight_jobs),
+        chunks_(multi_engine::make_fixed_chunks(size, chunk_size)) {}
+
+  /// Recompress the whole region.
+  int full() {
+    if (clear_soft_dirty())
+      return -1;
+    std::vector<size_t> chunks(chunks_.size());
+    std::iota(chunks.begin(), chunks.end(), 0);
+    return compress(chunks);
+  }
+
+  /// Recompress the chunks written since the previous snapshot; reports the
+  /// number of @param dirty_pages and of @param recompressed_chunks.
+  int incremental(size_t *dirty_pages, size_t *recompressed_chunks) {
+    std::vector<size_t> pages;
+    if (read_dirty_pages(mem_, size_, &pages) || clear_soft_dirty())
+      return -1;
+
+    std::vector<size_t> chunks;
+    const size_t pages_per_chunk = chunk_size_ / kSoftDirtyPageSize;
+    for (auto page : pages)
+      if (chunks.empty() || chunks.back() != page / pages_per_chunk)
+        chunks.push_back(page / pages_per_chunk);
+    *dirty_pages = pages.size();
+    *recompressed_chunks = chunks.size();
+    return compress(chunks);
+  }
+
+  /// Decompress the store into @param dst.
+  int restore(uint8_t *dst) {
+    size_t decompressed_size = 0;
+    if (multi_engine::decompress_queued(chunks_, dst, inflight_jobs_,
+                                        &decompressed_size) ||
+        decompressed_size != size_)
+      return -1;
+    return 0;
+  }
+
+  size_t compressed_size() const {
+    size_t compressed_size = 0;
+    for (const auto &[chunk, size] : chunks_)
+      compressed_size += chunk.size();
+    return compressed_size;
+  }
+
+private:
+  int compress(const std::vector<size_t> &chunks) {
+    // Restore the reserved output space of the recompressed chunks.
+    for (auto chunk : chunks) {
+      auto &[chunk_buff, size] = chunks_[chunk];
+      chunk_buff.resize(2 * size);
+    }
+    return multi_engine::compress_queued_chunks(
+        multi_engine::kParallelDynamic, mem_, size_, chunks, inflight_jobs_,
+        &chunks_);
+  }
+
+  const uint8_t *mem_;
+  size_t size_;
+  size_t chunk_size_;
+  size_t inflight_jobs_;
+  multi_engine::CompressedFormat chunks_;
+};
+
+} // namespace incremental
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef _SYNTHETIC_DATASET_H_
+#define _SYNTHETIC_DATASET_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "single_engine/qpl_compress_decompress.h"
+#include "util.h"
+
+namespace synthetic {
+
+static constexpr size_t kPageSize = 4 * kkB;
+
+//
+/// SplitMix64 generator; cheap to seed, so every page gets its own stream and
+/// the generated image does not depend on the number of threads.
+//
+class SplitMix64 {
+public:
+  explicit SplitMix64(uint64_t seed) : state_(seed) {}
+
+  uint64_t operator()() {
+    uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [0, 1).
+  double uniform() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+  // Standard normal (Box-Muller).
+  double normal() {
+    double u1 = 1.0 - uniform();
+    double u2 = uniform();
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+  }
+
+private:
+  uint64_t state_;
+};
+
+//
+/// Parameters of a synthetic microVM-like memory snapshot.
+//
+struct SnapshotProfile {
+  size_t size = 0;
+  uint64_t seed = 42;
+  // Fraction of all-zero pages.
+  double zero_page_fraction = 0.3;
+  // Fraction of pages duplicating an earlier data page.
+  double duplicate_page_fraction = 0.1;
+  // Per-page symbol entropy (bits per literal byte), normally distributed
+  // across pages and clamped to [1, 8].
+  double entropy_mean_bits = 6.0;
+  double entropy_stddev_bits = 1.5;
+  // Probability to emit a literal rather than a back-reference in data pages.
+  double literal_probability = 0.5;
+  // If > 0, literal_probability is calibrated so that the whole image
+  // compresses with the given ratio (software deflate, dynamic Huffman).
+  double target_compression_ratio = 0;
+  // 0 - use all hardware threads.
+  size_t threads = 0;
+
+  std::string name() const {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2) << "synthetic/" << size / kMB
+       << "MB_zero_" << zero_page_fraction << "_dup_"
+       << duplicate_page_fraction << "_ratio_" << target_compression_ratio
+       << "_seed_" << seed;
+    return ss.str();
+  }
+};
+
+enum PageKind { kZeroPage, kDuplicatePage, kDataPage };
+
+static SplitMix64 page_rng(const SnapshotProfile &profile, size_t page,
+                           uint64_t stream) {
+  return SplitMix64(profile.seed * 0xD1B54A32D192ED03ULL +
+                    static_cast<uint64_t>(page) * 0x9E3779B97F4A7C15ULL +
+                    stream);
+}
+
+static PageKind page_kind(const SnapshotProfile &profile, size_t page) {
+  double u = page_rng(profile, page, 0).uniform();
+  if (u < profile.zero_page_fraction)
+    return kZeroPage;
+  if (page > 0 &&
+      u < profile.zero_page_fraction + profile.duplicate_page_fraction)
+    return kDuplicatePage;
+  return kDataPage;
+}
+
+/// Data page a duplicate @param page copies; falls back to the page itself if
+/// no earlier data page is found.
+static size_t duplicate_source(const SnapshotProfile &profile, size_t page) {
+  auto rng = page_rng(profile, page, 1);
+  for (int tries = 0; tries < 8; ++tries) {
+    size_t candidate = static_cast<size_t>(rng() % page);
+    if (page_kind(profile, candidate) == kDataPage)
+      return candidate;
+  }
+  return page;
+}
+
+/// Fill @param dst with the content of data page @param page: literals from a
+/// per-page alphabet of 2^bits symbols mixed with short back-references.
+static void fill_data_page(const SnapshotProfile &profile, size_t page,
+                           uint8_t *dst, size_t size) {
+  auto rng = page_rng(profile, page, 2);
+  double bits = profile.entropy_mean_bits +
+                profile.entropy_stddev_bits * rng.normal();
+  uint64_t alphabet_mask =
+      (1ULL << static_cast<unsigned>(std::clamp(std::round(bits), 1.0, 8.0))) -
+      1;
+  uint8_t alphabet_base = static_cast<uint8_t>(rng());
+
+  size_t pos = 0;
+  while (pos < size) {
+    if (pos < 16 || rng.uniform() < profile.literal_probability) {
+      dst[pos++] =
+          static_cast<uint8_t>(alphabet_base + (rng() & alphabet_mask));
+    } else {
+      size_t len = std::min<size_t>(8 + rng() % 25, size - pos);
+      size_t dist = 1 + rng() % std::min<size_t>(pos, 1024);
+      for (size_t i = 0; i < len; ++i, ++pos)
+        dst[pos] = dst[pos - dist];
+    }
+  }
+}
+
+static void fill_page(const SnapshotProfile &profile, size_t page,
+                      uint8_t *dst, size_t size) {
+  switch (page_kind(profile, page)) {
+  case kZeroPage:
+    memset(dst, 0, size);
+    break;
+  case kDuplicatePage:
+    fill_data_page(profile, duplicate_source(profile, page), dst, size);
+    break;
+  case kDataPage:
+    fill_data_page(profile, page, dst, size);
+    break;
+  }
+}
+
+/// Generate the snapshot image of @param profile into @param mem (of
+/// profile.size bytes) in parallel. Returns the Shannon entropy of the image.
+double generate_snapshot(const SnapshotProfile &profile, uint8_t *mem) {
+  const size_t page_count = (profile.size + kPageSize - 1) / kPageSize;
+  size_t threads = profile.threads ? profile.threads
+                                   : std::thread::hardware_concurrency();
+  threads = std::max<size_t>(1, std::min(threads, page_count));
+
+  std::vector<std::vector<uint64_t>> histograms(
+      threads, std::vector<uint64_t>(256, 0));
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      size_t first = page_count * t / threads;
+      size_t last = page_count * (t + 1) / threads;
+      auto &histogram = histograms[t];
+      for (size_t page = first; page < last; ++page) {
+        uint8_t *dst = mem + page * kPageSize;
+        size_t size = std::min(kPageSize, profile.size - page * kPageSize);
+        fill_page(profile, page, dst, size);
+        for (size_t i = 0; i < size; ++i)
+          ++histogram[dst[i]];
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+
+  double entropy = 0.0;
+  for (size_t b = 0; b < 256; ++b) {
+    uint64_t count = 0;
+    for (const auto &histogram : histograms)
+      count += histogram[b];
+    double p = static_cast<double>(count) / static_cast<double>(profile.size);
+    if (p > 0.)
+      entropy -= p * std::log2(p);
+  }
+  return entropy;
+}
+
+/// Find literal_probability giving profile.target_compression_ratio on a
+/// sample of the image, by bisection with software deflate.
+SnapshotProfile calibrate(SnapshotProfile profile) {
+  if (profile.target_compression_ratio <= 0)
+    return profile;
+
+  SnapshotProfile sample = profile;
+  sample.size = std::min<size_t>(profile.size, 4 * kMB);
+  sample.threads = 1;
+  std::vector<uint8_t> src(sample.size);
+  std::vector<uint8_t> dst(2 * sample.size);
+
+  double lo = 0.0, hi = 1.0, ratio = 0.0;
+  for (int it = 0; it < 12; ++it) {
+    sample.literal_probability = (lo + hi) / 2;
+    generate_snapshot(sample, src.data());
+    size_t compressed_size = dst.size();
+    if (single_engine::compress(qpl_path_software, qpl_default_level,
+                                single_engine::kModeDynamic, nullptr, nullptr,
+                                src.data(), src.size(), dst.data(),
+                                &compressed_size)) {
+      LOG(WARNING) << "Failed to compress calibration sample, using "
+                   << profile.literal_probability << " literal probability.";
+      return profile;
+    }
+    ratio = 1.0 * src.size() / compressed_size;
+    if (ratio > profile.target_compression_ratio)
+      lo = sample.literal_probability;
+    else
+      hi = sample.literal_probability;
+  }
+
+  if (std::fabs(ratio - profile.target_compression_ratio) >
+      0.1 * profile.target_compression_ratio)
+    LOG(WARNING) << "Target compression ratio "
+                 << profile.target_compression_ratio
+                 << " is not reachable with this profile, got " << ratio;
+
+  profile.literal_probability = sample.literal_probability;
+  LOG(INFO) << "Calibrated " << profile.name() << " to literal probability "
+            << profile.literal_probability << " (ratio " << ratio << ")";
+  return profile;
+}
+
+static uint8_t *materialize(const SnapshotProfile &profile, double *entropy) {
+  auto calibrated = calibrate(profile);
+  uint8_t *mem = mmap_allocate(calibrated.size).release();
+  TimeScope time;
+  *entropy = generate_snapshot(calibrated, mem);
+  LOG(INFO) << "Generated " << profile.name() << " in "
+            << time.GetTimeStamp<std::chrono::milliseconds>() << " ms";
+  return mem;
+}
+
+/// Derive a near-copy of @param base into @param derived (both of @param size
+/// bytes): @param mutated_fraction of the 4 kB pages get one random run of
+/// 16-512 bytes overwritten, as a guest dirtying a few cache lines would.
+/// Returns the number of mutated pages.
+size_t mutate_pages(const uint8_t *base, size_t size, double mutated_fraction,
+                    uint64_t seed, uint8_t *derived) {
+  memcpy(derived, base, size);
+  SplitMix64 rng(seed);
+  size_t mutated = 0;
+  for (size_t offset = 0; offset < size; offset += kPageSize) {
+    if (rng.uniform() >= mutated_fraction)
+      continue;
+    size_t page_size = std::min(kPageSize, size - offset);
+    size_t len = std::min<size_t>(16 + rng() % 497, page_size);
+    size_t start = offset + rng() % (page_size - len + 1);
+    for (size_t i = 0; i < len; ++i)
+      derived[start + i] = static_cast<uint8_t>(rng());
+    // Make sure the page differs even if the random bytes happen to match.
+    derived[start] = static_cast<uint8_t>(~base[start]);
+    ++mutated;
+  }
+  return mutated;
+}
+
+/// Synthetic counterpart of list_corpus_dataset(); images are only generated
+/// when first accessed.
+LazyCompressionDataset
+list_synthetic_dataset(const std::vector<SnapshotProfile> &profiles) {
+  LazyCompressionDataset dataset;
+  for (const auto &profile : profiles) {
+    dataset.push_back(std::make_shared<LazyCorpusFile>(
+        profile.name(), profile.size,
+        [profile](size_t *size, double *entropy) {
+          *size = profile.size;
+          return materialize(profile, entropy);
+        }));
+  }
+  return dataset;
+}
+
+} // namespace synthetic
+
+#endif
@@ -1,17 +1,23 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
+#include <algorithm>
+#include <cassert>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <filesystem>
+#include <functional>
 #include <memory>
 #include <random>
 #include <vector>
 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include "qpl/qpl.h"
 #include <benchmark/benchmark.h>
@@ -31,6 +37,9 @@
 static constexpr uint64_t kkB = 1024;
 static constexpr uint64_t kMB = 1024 * 1024;
 
+// Used if the kernel does not report the LLC size.
+static constexpr size_t kDefaultLlcSize = 32 * kMB;
+
 //
 /// Measure time.
 //
@@ -48,6 +57,83 @@ private:
   std::chrono::time_point<std::chrono::high_resolution_clock> start_tick;
 };
 
+/// CPU time (user + system) consumed by the calling thread so far, in seconds.
+double thread_cpu_time() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage))
+    return 0;
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) /
+             1e6;
+}
+
+/// Resident set size of the process, in bytes.
+size_t current_rss() {
+  size_t pages = 0, resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr)
+    return 0;
+  if (fscanf(statm, "%zu %zu", &pages, &resident) != 2)
+    resident = 0;
+  fclose(statm);
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/// Reset the peak resident set size of the process to the current one.
+int reset_peak_rss() {
+  int fd = open("/proc/self/clear_refs", O_WRONLY);
+  if (fd == -1)
+    return -1;
+  int ret = write(fd, "5", 1) == 1 ? 0 : -1;
+  close(fd);
+  return ret;
+}
+
+/// Peak resident set size (VmHWM) of the process since the last
+/// reset_peak_rss(), in bytes.
+size_t peak_rss() {
+  FILE *status = fopen("/proc/self/status", "r");
+  if (status == nullptr)
+    return 0;
+  char line[256];
+  size_t peak_kb = 0;
+  while (fgets(line, sizeof(line), status) != nullptr)
+    if (sscanf(line, "VmHWM: %zu kB", &peak_kb) == 1)
+      break;
+  fclose(status);
+  return peak_kb * kkB;
+}
+
+/// Start measuring the memory of a benchmark: returns the current RSS.
+size_t start_rss_measurement() {
+  if (reset_peak_rss())
+    LOG(WARNING) << "Failed to reset the peak RSS.";
+  return current_rss();
+}
+
+/// Growth of the peak RSS over @param rss_before, in MB. VmHWM is only
+/// updated lazily, so it may lag behind the RSS read before.
+double peak_rss_growth_mb(size_t rss_before) {
+  return static_cast<double>(std::max(peak_rss(), rss_before) - rss_before) /
+         kMB;
+}
+
+/// Size of the last level cache of the calling CPU.
+size_t llc_size() {
+  long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  return size > 0 ? static_cast<size_t>(size) : kDefaultLlcSize;
+}
+
+/// @param p-th percentile (0..100) of @param samples; reorders the samples.
+double percentile(std::vector<double> &samples, double p) {
+  if (samples.empty())
+    return 0;
+  auto nth = samples.begin() + static_cast<std::ptrdiff_t>(
+                                   (samples.size() - 1) * p / 100.0);
+  std::nth_element(samples.begin(), nth, samples.end());
+  return *nth;
+}
+
 //
 /// Memory allocators.
 //
@@ -147,6 +233,26 @@ double init_rand_memory(uint8_t *mem, size_t size, uint16_t entropy,
     return 0;
 }
 
+/// Read the whole file @param filename into a malloc'ed buffer; the buffer is
+/// never freed as datasets live until the end of the benchmark run.
+uint8_t *read_corpus_file(const std::string &filename, size_t *size) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    LOG(FATAL) << "failed to open benchmark file " << filename << ", "
+               << strerror(errno);
+  ssize_t fd_size = lseek(fd, 0L, SEEK_END);
+  lseek(fd, 0L, SEEK_SET);
+  LOG(INFO) << "Found file: " << filename << " of size: " << fd_size << " B";
+  uint8_t *mem =
+      reinterpret_cast<uint8_t *>(malloc(static_cast<size_t>(fd_size)));
+  if (read(fd, mem, static_cast<size_t>(fd_size)) != fd_size)
+    LOG(FATAL) << "Failed to read benchmark file " << filename;
+  close(fd);
+
+  *size = static_cast<size_t>(fd_size);
+  return mem;
+}
+
 typedef std::vector<std::tuple<size_t, std::string, double, uint8_t *>>
     CompressionDataset;
 CompressionDataset load_corpus_dataset(const char *dataset_path) {
@@ -157,28 +263,94 @@ CompressionDataset load_corpus_dataset(const char *dataset_path) {
   for (const auto &entry : std::filesystem::directory_iterator(dataset_path)) {
     std::string filename = entry.path().filename();
     filename = std::string(dataset_path) + "/" + filename;
-    int fd = open(filename.c_str(), O_RDONLY);
-    if (fd == -1)
-      LOG(FATAL) << "failed to open benchmark file " << filename << ", "
-                 << strerror(errno);
-    ssize_t fd_size = lseek(fd, 0L, SEEK_END);
-    lseek(fd, 0L, SEEK_SET);
-    LOG(INFO) << "Found file: " << filename << " of size: " << fd_size << " B";
-    uint8_t *mem =
-        reinterpret_cast<uint8_t *>(malloc(static_cast<size_t>(fd_size)));
-    if (read(fd, mem, static_cast<size_t>(fd_size)) != fd_size)
-      LOG(FATAL) << "Failed to read benchmark file " << filename;
-    double entropy = compute_entropy(mem, static_cast<size_t>(fd_size));
-    dataset.push_back(std::make_tuple(fd_size, filename, entropy, mem));
+    size_t size = 0;
+    uint8_t *mem = read_corpus_file(filename, &size);
+    double entropy = compute_entropy(mem, size);
+    dataset.push_back(std::make_tuple(size, filename, entropy, mem));
   }
 
   LOG(INFO) << "Dataset with " << dataset.size() << " files is loaded";
   return dataset;
 }
 
-int create_static_huffman_tables(qpl_path_t e_path,
-                                 qpl_huffman_table_t *c_huffman_table,
-                                 const uint8_t *src, size_t src_size) {
+//
+/// Dataset file which is only read from disk (and its entropy computed) on
+/// first access, so that the benchmarks filtered out never touch it. A custom
+/// @param loader can be given for datasets which are not files (e.g.
+/// generated), it must return the data and set its size and entropy.
+//
+class LazyCorpusFile {
+public:
+  typedef std::function<uint8_t *(size_t *size, double *entropy)> Loader;
+
+  LazyCorpusFile(std::string filename, size_t size)
+      : filename_(std::move(filename)), size_(size) {
+    loader_ = [this](size_t *size, double *entropy) {
+      uint8_t *mem = read_corpus_file(filename_, size);
+      *entropy = compute_entropy(mem, *size);
+      return mem;
+    };
+  }
+
+  LazyCorpusFile(std::string name, size_t size, Loader loader)
+      : filename_(std::move(name)), size_(size), loader_(std::move(loader)) {}
+
+  LazyCorpusFile(const LazyCorpusFile &) = delete;
+  LazyCorpusFile &operator=(const LazyCorpusFile &) = delete;
+
+  const std::string &name() const { return filename_; }
+  size_t size() const { return size_; }
+  bool materialized() const { return mem_ != nullptr; }
+
+  uint8_t *data() {
+    materialize();
+    return mem_;
+  }
+
+  double entropy() {
+    materialize();
+    return entropy_;
+  }
+
+private:
+  void materialize() {
+    if (mem_ != nullptr)
+      return;
+    mem_ = loader_(&size_, &entropy_);
+  }
+
+  std::string filename_;
+  size_t size_;
+  Loader loader_;
+  uint8_t *mem_ = nullptr;
+  double entropy_ = 0;
+};
+
+typedef std::vector<std::shared_ptr<LazyCorpusFile>> LazyCompressionDataset;
+
+/// List the dataset files under @param dataset_path without reading them.
+LazyCompressionDataset list_corpus_dataset(const char *dataset_path) {
+  LazyCompressionDataset dataset;
+  if (!std::filesystem::exists(dataset_path) ||
+      !std::filesystem::is_directory(dataset_path)) {
+    LOG(WARNING) << "Dataset " << dataset_path << " not found, skipping.";
+    return dataset;
+  }
+
+  for (const auto &entry : std::filesystem::directory_iterator(dataset_path)) {
+    std::string filename = entry.path().filename();
+    filename = std::string(dataset_path) + "/" + filename;
+    dataset.push_back(std::make_shared<LazyCorpusFile>(
+        filename, static_cast<size_t>(entry.file_size())));
+  }
+
+  return dataset;
+}
+
+int create_static_huffman_tables(
+    qpl_path_t e_path, qpl_huffman_table_t *c_huffman_table,
+    const uint8_t *src, size_t src_size,
+    qpl_compression_levels level = qpl_default_level) {
   // Create Huffman tables.
   qpl_status status = qpl_deflate_huffman_table_create(
       combined_table_type, e_path, DEFAULT_ALLOCATOR_C, c_huffman_table);
@@ -190,10 +362,11 @@ int create_static_huffman_tables(qpl_path_t e_path,
   // Gather statistics.
   qpl_histogram histogram{};
   status = qpl_gather_deflate_statistics(const_cast<uint8_t *>(src), src_size,
-                                         &histogram, qpl_default_level, e_path);
+                                         &histogram, level, e_path);
   if (status != QPL_STS_OK) {
     LOG(WARNING) << "Failed to gather statistics.";
     qpl_huffman_table_destroy(*c_huffman_table);
+    *c_huffman_table = nullptr;
     return -1;
   }
 
@@ -202,6 +375,7 @@ int create_static_huffman_tables(qpl_path_t e_path,
   if (status != QPL_STS_OK) {
     LOG(WARNING) << "Failed to populate the Huffman tabels.";
     qpl_huffman_table_destroy(*c_huffman_table);
+    *c_huffman_table = nullptr;
     return -1;
   }
 
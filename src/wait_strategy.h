@@ -0,0 +1,130 @@
+#ifndef _WAIT_STRATEGY_H_
+#define _WAIT_STRATEGY_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include <cpuid.h>
+#include <immintrin.h>
+#include <sched.h>
+#include <x86intrin.h>
+
+#include "qpl/qpl.h"
+
+//
+/// How a thread waits for the completion of a submitted hardware job.
+//
+enum WaitStrategy {
+  // qpl_execute_job(): let QPL wait internally (single engine only).
+  kWaitBlocking,
+  // Spin on qpl_check_job().
+  kWaitBusyPoll,
+  // Exponentially growing number of PAUSE instructions between polls.
+  kWaitPauseBackoff,
+  // TPAUSE (WAITPKG) in C0.1 between polls; falls back to kWaitPauseBackoff
+  // where not available. UMWAIT is not used as QPL does not expose the
+  // address of the completion record to monitor.
+  kWaitTpause,
+  // sched_yield() between polls.
+  kWaitYield,
+  // Sleep between polls.
+  kWaitSleep
+};
+
+static const char *wait_strategy_name(WaitStrategy strategy) {
+  switch (strategy) {
+  case kWaitBlocking:
+    return "blocking";
+  case kWaitBusyPoll:
+    return "busy_poll";
+  case kWaitPauseBackoff:
+    return "pause_backoff";
+  case kWaitTpause:
+    return "tpause";
+  case kWaitYield:
+    return "yield";
+  case kWaitSleep:
+    return "sleep";
+  }
+  return "unknown";
+}
+
+static bool waitpkg_supported() {
+  static const bool supported = []() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+      return false;
+    return (ecx & (1u << 5)) != 0;
+  }();
+  return supported;
+}
+
+//
+/// Waits between unsuccessful completion polls according to a WaitStrategy;
+/// reset() after any progress to restart the backoff.
+//
+class CompletionWaiter {
+public:
+  static constexpr uint32_t kMaxPauseBackoff = 1024;
+  static constexpr uint64_t kTpauseCycles = 2000;
+  static constexpr auto kSleepPeriod = std::chrono::microseconds(1);
+
+  explicit CompletionWaiter(WaitStrategy strategy) : strategy_(strategy) {}
+
+  void reset() { backoff_ = 1; }
+
+  void wait() {
+    switch (strategy_) {
+    case kWaitBlocking:
+    case kWaitBusyPoll:
+      break;
+    case kWaitTpause:
+#ifdef __WAITPKG__
+      if (waitpkg_supported()) {
+        _tpause(1, __rdtsc() + kTpauseCycles);
+        break;
+      }
+#endif
+      [[fallthrough]];
+    case kWaitPauseBackoff:
+      for (uint32_t i = 0; i < backoff_; ++i)
+        _mm_pause();
+      backoff_ = std::min(2 * backoff_, kMaxPauseBackoff);
+      break;
+    case kWaitYield:
+      sched_yield();
+      break;
+    case kWaitSleep:
+      std::this_thread::sleep_for(kSleepPeriod);
+      break;
+    }
+  }
+
+private:
+  WaitStrategy strategy_;
+  uint32_t backoff_ = 1;
+};
+
+/// Poll a submitted @param job until completion.
+qpl_status wait_job(qpl_job *job, WaitStrategy strategy) {
+  CompletionWaiter waiter(strategy);
+  qpl_status status;
+  while ((status = qpl_check_job(job)) == QPL_STS_BEING_PROCESSED)
+    waiter.wait();
+  return status;
+}
+
+/// Execute @param job to completion with the given wait strategy.
+qpl_status execute_job(qpl_job *job, WaitStrategy strategy) {
+  if (strategy == kWaitBlocking)
+    return qpl_execute_job(job);
+
+  qpl_status status = qpl_submit_job(job);
+  if (status != QPL_STS_OK)
+    return status;
+  return wait_job(job, strategy);
+}
+
+#endif